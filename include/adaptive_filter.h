@@ -0,0 +1,166 @@
+#pragma once
+
+#include "base.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace bloom_filters {
+// Tuning knobs of AdaptiveFilter.
+struct AdaptiveFilterOptions {
+	// Cost, in cycles, of handling one row downstream of the filter (e.g. a hash-table probe). A filter pays off when
+	// cycles per row < (1 - pass rate) * downstream_cycles_per_row.
+	double downstream_cycles_per_row = 30.0;
+	// Probed morsels per decision. While the filter is enabled, a decision is taken after every window.
+	uint32_t sample_morsels = 8;
+	// Skipped morsels before a disabled filter is probed again to re-sample.
+	uint32_t resample_interval = 256;
+};
+
+// Decisions made by an AdaptiveFilter.
+struct AdaptiveFilterCounters {
+	uint64_t morsels_probed = 0;
+	uint64_t morsels_skipped = 0;
+	uint64_t rows_probed = 0;
+	uint64_t rows_passed = 0;
+	uint64_t rows_skipped = 0;
+	// Sampling windows evaluated, and how many of them switched the filter off or back on.
+	uint64_t num_decisions = 0;
+	uint64_t num_disables = 0;
+	uint64_t num_enables = 0;
+};
+
+// Wraps a filter used for sideways information passing and stops probing it when it does not pay off: a filter that
+// passes 95% of the rows costs more than it saves downstream. The pass rate and cycles per row are sampled over
+// morsels; while the filter is disabled, every row passes, and after resample_interval morsels a new sampling window
+// checks whether the data has changed.
+template <typename BloomFilterType, typename HashType>
+class AdaptiveFilter {
+public:
+	// Rows per morsel, the unit of measurement and of the enable/disable decision.
+	static constexpr uint32_t MORSEL_SIZE = 1024;
+
+public:
+	// The filter must outlive the wrapper.
+	explicit AdaptiveFilter(BloomFilterType &bf, const AdaptiveFilterOptions &options = AdaptiveFilterOptions())
+	    : bf(bf), options(options) {
+	}
+
+public:
+	inline void Insert(uint32_t num, HashType *key) {
+		bf.Insert(num, key);
+	}
+
+	// Same contract as the filter's Lookup; out[i] is 1 for every row of a skipped morsel.
+	inline uint32_t Lookup(uint32_t num, HashType *key, uint32_t *out) {
+		for (uint32_t base = 0; base < num; base += MORSEL_SIZE) {
+			uint32_t morsel = std::min(MORSEL_SIZE, num - base);
+			if (!ProbeNextMorsel(morsel)) {
+				std::fill(out + base, out + base + morsel, 1);
+				continue;
+			}
+			uint64_t start = CycleCount();
+			bf.Lookup(morsel, key + base, out + base);
+			uint32_t passed = 0;
+			for (uint32_t i = 0; i < morsel; i++) {
+				passed += out[base + i] != 0;
+			}
+			uint64_t end = CycleCount();
+			RecordMorsel(morsel, passed, end - start);
+		}
+		return num;
+	}
+
+	// Selection-vector Lookup; every selected row of a skipped morsel passes.
+	inline uint32_t Lookup(uint32_t num, HashType *key, const uint32_t *sel, uint32_t *sel_out) {
+		uint32_t found = 0;
+		for (uint32_t base = 0; base < num; base += MORSEL_SIZE) {
+			uint32_t morsel = std::min(MORSEL_SIZE, num - base);
+			if (!ProbeNextMorsel(morsel)) {
+				// already in place when sel_out is sel and every row so far passed, else the destination is to the left
+				if (sel_out + found != sel + base) {
+					std::copy(sel + base, sel + base + morsel, sel_out + found);
+				}
+				found += morsel;
+				continue;
+			}
+			uint64_t start = CycleCount();
+			uint32_t passed = bf.Lookup(morsel, key, sel + base, sel_out + found);
+			uint64_t end = CycleCount();
+			RecordMorsel(morsel, passed, end - start);
+			found += passed;
+		}
+		return found;
+	}
+
+	bool Enabled() const {
+		return enabled;
+	}
+
+	const AdaptiveFilterCounters &Counters() const {
+		return counters;
+	}
+
+	BloomFilterType &Filter() {
+		return bf;
+	}
+
+private:
+	// Returns whether the next morsel has to be probed, and counts it as skipped otherwise.
+	bool ProbeNextMorsel(uint32_t morsel) {
+		if (enabled || resampling) {
+			return true;
+		}
+		if (skipped_since_sample < options.resample_interval) {
+			skipped_since_sample++;
+			counters.morsels_skipped++;
+			counters.rows_skipped += morsel;
+			return false;
+		}
+		// probe a full window, then decide again
+		skipped_since_sample = 0;
+		resampling = true;
+		return true;
+	}
+
+	void RecordMorsel(uint32_t morsel, uint32_t passed, uint64_t cycles) {
+		counters.morsels_probed++;
+		counters.rows_probed += morsel;
+		counters.rows_passed += passed;
+		window_rows += morsel;
+		window_passed += passed;
+		window_cycles += cycles;
+		if (++window_morsels < options.sample_morsels) {
+			return;
+		}
+
+		double cycles_per_row = static_cast<double>(window_cycles) / static_cast<double>(window_rows);
+		double pass_rate = static_cast<double>(window_passed) / static_cast<double>(window_rows);
+		bool pays_off = cycles_per_row < (1.0 - pass_rate) * options.downstream_cycles_per_row;
+		counters.num_decisions++;
+		counters.num_disables += enabled && !pays_off;
+		counters.num_enables += !enabled && pays_off;
+		enabled = pays_off;
+		resampling = false;
+		window_morsels = 0;
+		window_rows = 0;
+		window_passed = 0;
+		window_cycles = 0;
+	}
+
+private:
+	BloomFilterType &bf;
+	AdaptiveFilterOptions options;
+	AdaptiveFilterCounters counters;
+
+	bool enabled = true;
+	// A disabled filter is probed for one window every resample_interval skipped morsels.
+	bool resampling = false;
+	uint32_t skipped_since_sample = 0;
+	// Current sampling window.
+	uint32_t window_morsels = 0;
+	uint64_t window_rows = 0;
+	uint64_t window_passed = 0;
+	uint64_t window_cycles = 0;
+};
+} // namespace bloom_filters
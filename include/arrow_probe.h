@@ -0,0 +1,147 @@
+#pragma once
+
+#include "base.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace bloom_filters {
+// Number of rows hashed and probed per chunk. Must be a multiple of 8, so every chunk starts at a byte boundary of the
+// output bitmap.
+static constexpr int64_t ARROW_BATCH_SIZE = 1024;
+
+// Header-only mirror of an Arrow fixed-width array: buffers[0] (validity) and buffers[1] (values) of an ArrowArray,
+// plus its length and offset. No dependency on the Arrow library, a column can be wrapped around the buffers of an
+// ArrowArray without copying.
+template <typename T>
+struct ArrowFixedWidthColumn {
+	static_assert(std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "only 32/64-bit integer keys");
+
+	// Values of slots [0, offset + length).
+	const T *values;
+	// LSB-first validity bitmap, bit i set if slot i is valid. nullptr if the column has no nulls.
+	const uint8_t *validity;
+	int64_t length;
+	// Arrow array offset, in slots, applied to both buffers.
+	int64_t offset = 0;
+};
+
+// Reads the 8 bits [bit_pos, bit_pos + 8) of an LSB-first bitmap, without touching bytes at or after end_bit.
+inline uint8_t ReadBitmapByte(const uint8_t *bitmap, int64_t bit_pos, int64_t end_bit) {
+	int64_t byte = bit_pos >> 3;
+	uint32_t shift = static_cast<uint32_t>(bit_pos & 7);
+	uint32_t bits = bitmap[byte] >> shift;
+	int64_t last_bit = std::min(bit_pos + 8, end_bit) - 1;
+	if (shift != 0 && (last_bit >> 3) != byte) {
+		bits |= static_cast<uint32_t>(bitmap[byte + 1]) << (8 - shift);
+	}
+	return static_cast<uint8_t>(bits);
+}
+
+// Packs num lookup results (num a multiple of 8) into an LSB-first bitmap, ANDed with the validity bits, so null rows
+// are false.
+inline void PackResults(int64_t num, const uint32_t *BF_RESTRICT out, const uint8_t *BF_RESTRICT valid,
+                        uint8_t *BF_RESTRICT bitmap) {
+	for (int64_t i = 0; i < num; i += 8) {
+#if defined(__AVX2__)
+		__m256i result = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + i));
+		__m256i is_zero = _mm256_cmpeq_epi32(result, _mm256_setzero_si256());
+		uint32_t bits = ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(is_zero))) & 0xff;
+#else
+		uint32_t bits = 0;
+		for (int64_t j = 0; j < 8; j++) {
+			bits |= static_cast<uint32_t>(out[i + j] != 0) << j;
+		}
+#endif
+		bitmap[i >> 3] = static_cast<uint8_t>(bits) & valid[i >> 3];
+	}
+}
+
+// Turns a chunk of column values into keys for HashVector. 64-bit values are used in place, 32-bit values are widened
+// into the chunk buffer.
+template <typename T>
+inline const uint64_t *ChunkKeys(const T *values, int64_t num, uint64_t *buffer) {
+	if (sizeof(T) == sizeof(uint64_t)) {
+		return reinterpret_cast<const uint64_t *>(values);
+	}
+	for (int64_t i = 0; i < num; i++) {
+		buffer[i] = static_cast<uint64_t>(values[i]);
+	}
+	return buffer;
+}
+
+// Probes an Arrow fixed-width column in place. Bit i of out_bitmap (LSB-first, (length + 7) / 8 bytes) is set if row i
+// is valid and may be in the filter; null rows are false. Chunks without any valid row are not hashed nor probed.
+// Returns the number of set bits.
+template <typename BloomFilterType, typename HashType, typename T>
+int64_t LookupArrowColumn(BloomFilterType &bf, const ArrowFixedWidthColumn<T> &column, uint8_t *out_bitmap) {
+	alignas(64) uint64_t keys[ARROW_BATCH_SIZE];
+	alignas(64) HashType hashes[ARROW_BATCH_SIZE];
+	alignas(64) uint32_t out[ARROW_BATCH_SIZE];
+	uint8_t valid[ARROW_BATCH_SIZE / 8];
+
+	int64_t num_set = 0;
+	const int64_t end_bit = column.offset + column.length;
+	for (int64_t base = 0; base < column.length; base += ARROW_BATCH_SIZE) {
+		int64_t batch = std::min(ARROW_BATCH_SIZE, column.length - base);
+		int64_t batch_bytes = (batch + 7) / 8;
+
+		// Validity of the chunk, realigned to bit 0. The padding bits of the last byte are cleared.
+		uint8_t any_valid = 0;
+		for (int64_t b = 0; b < batch_bytes; b++) {
+			valid[b] = column.validity ? ReadBitmapByte(column.validity, column.offset + base + b * 8, end_bit) : 0xff;
+			any_valid |= valid[b];
+		}
+		if (batch & 7) {
+			valid[batch_bytes - 1] &= static_cast<uint8_t>((1U << (batch & 7)) - 1);
+		}
+		if (!any_valid) {
+			std::fill_n(out_bitmap + (base >> 3), batch_bytes, 0);
+			continue;
+		}
+
+		const uint64_t *chunk_keys = ChunkKeys(column.values + column.offset + base, batch, keys);
+		HashVector(batch, chunk_keys, hashes);
+		bf.Lookup(batch, hashes, out);
+		std::fill(out + batch, out + batch_bytes * 8, 0);
+		PackResults(batch_bytes * 8, out, valid, out_bitmap + (base >> 3));
+		for (int64_t b = 0; b < batch_bytes; b++) {
+			num_set += __builtin_popcount(out_bitmap[(base >> 3) + b]);
+		}
+	}
+	return num_set;
+}
+
+// Inserts the valid rows of an Arrow fixed-width column. Null rows are compacted out of the chunk hashes before the
+// filter sees them.
+template <typename BloomFilterType, typename HashType, typename T>
+void InsertArrowColumn(BloomFilterType &bf, const ArrowFixedWidthColumn<T> &column) {
+	alignas(64) uint64_t keys[ARROW_BATCH_SIZE];
+	alignas(64) HashType hashes[ARROW_BATCH_SIZE];
+
+	for (int64_t base = 0; base < column.length; base += ARROW_BATCH_SIZE) {
+		int64_t batch = std::min(ARROW_BATCH_SIZE, column.length - base);
+		const uint64_t *chunk_keys = ChunkKeys(column.values + column.offset + base, batch, keys);
+		HashVector(batch, chunk_keys, hashes);
+
+		int64_t num_valid = batch;
+		if (column.validity) {
+			num_valid = 0;
+			for (int64_t i = 0; i < batch; i++) {
+				int64_t bit = column.offset + base + i;
+				hashes[num_valid] = hashes[i];
+				num_valid += (column.validity[bit >> 3] >> (bit & 7)) & 1;
+			}
+		}
+		if (num_valid > 0) {
+			bf.Insert(num_valid, hashes);
+		}
+	}
+}
+} // namespace bloom_filters
@@ -12,44 +12,175 @@
 #endif
 #endif
 
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
 #include <cmath>
 #include <cstring>
 #include <cstdint>
 
+#include "hash_functions.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
 namespace bloom_filters {
-// I use the same hash fucntion as in DuckDB.
-inline uint64_t MurmurHash64(uint64_t x) {
-	x ^= x >> 32;
-	x *= 0xd6e8feb86659fd93U;
-	x ^= x >> 32;
-	x *= 0xd6e8feb86659fd93U;
-	x ^= x >> 32;
-	return x;
+// Timestamp counter used by the adaptive probing code to measure the cost of a filter.
+inline uint64_t CycleCount() {
+#ifdef __x86_64__
+	return __rdtsc();
+#else
+	auto now = std::chrono::steady_clock::now();
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+#endif
 }
 
-inline uint32_t MurmurHash32(uint32_t x) {
-	x ^= x >> 16;
-	x *= 0xd6e8feb9U;
-	x ^= x >> 16;
-	x *= 0xd6e8feb9U;
-	x ^= x >> 16;
-	return x;
+// Number of selected rows probed per batch by the selection-vector Lookup overloads: the keys of a batch are gathered
+// into an L1-resident buffer, probed with the filter's dense kernel, then the batch is compacted.
+static constexpr uint32_t SELECTION_BATCH_SIZE = 64;
+
+// out[i] = key[sel[i]] for i in [0, num). Row ids must be below 2^31.
+inline void GatherKeys(uint32_t num, const uint64_t *BF_RESTRICT key, const uint32_t *BF_RESTRICT sel,
+                       uint64_t *BF_RESTRICT out) {
+	uint32_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 8 <= num; i += 8) {
+		__m256i rows = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sel + i));
+		_mm512_storeu_si512(out + i, _mm512_i32gather_epi64(rows, key, 8));
+	}
+#elif defined(__AVX2__)
+	for (; i + 4 <= num; i += 4) {
+		__m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sel + i));
+		__m256i gathered = _mm256_i32gather_epi64(reinterpret_cast<const long long *>(key), rows, 8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), gathered);
+	}
+#endif
+	for (; i < num; i++) {
+		out[i] = key[sel[i]];
+	}
+}
+
+inline void GatherKeys(uint32_t num, const uint32_t *BF_RESTRICT key, const uint32_t *BF_RESTRICT sel,
+                       uint32_t *BF_RESTRICT out) {
+	uint32_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 16 <= num; i += 16) {
+		__m512i rows = _mm512_loadu_si512(sel + i);
+		_mm512_storeu_si512(out + i, _mm512_i32gather_epi32(rows, key, 4));
+	}
+#elif defined(__AVX2__)
+	for (; i + 8 <= num; i += 8) {
+		__m256i rows = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sel + i));
+		__m256i gathered = _mm256_i32gather_epi32(reinterpret_cast<const int *>(key), rows, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), gathered);
+	}
+#endif
+	for (; i < num; i++) {
+		out[i] = key[sel[i]];
+	}
 }
 
-inline void HashVector(size_t num, const uint64_t *key, uint64_t *hashes) {
-	for (size_t i = 0; i < num; i++) {
-		hashes[i] = MurmurHash64(key[i]);
+// Writes the entries of sel[0, num) whose pass flag is non-zero to sel_out and returns how many were written.
+// sel_out may alias sel (in-place shrinking), as long as it does not start after sel.
+inline uint32_t CompactSelection(uint32_t num, const uint32_t *sel, const uint32_t *BF_RESTRICT pass,
+                                 uint32_t *sel_out) {
+	uint32_t found = 0;
+	uint32_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 16 <= num; i += 16) {
+		__m512i flags = _mm512_loadu_si512(pass + i);
+		__mmask16 keep = _mm512_test_epi32_mask(flags, flags);
+		_mm512_mask_compressstoreu_epi32(sel_out + found, keep, _mm512_loadu_si512(sel + i));
+		found += __builtin_popcount(keep);
+	}
+#endif
+	for (; i < num; i++) {
+		// branch-free: always write, only advance on a hit
+		sel_out[found] = sel[i];
+		found += pass[i] != 0;
 	}
+	return found;
 }
 
-inline void HashVector(size_t num, const uint64_t *key, uint32_t *hashes) {
-	for (size_t i = 0; i < num; i++) {
-		hashes[i] = MurmurHash32(key[i]);
+// Shared body of the selection-vector Lookup overloads. dense_lookup(n, keys, out) is the filter's dense kernel.
+template <typename HashType, typename DenseLookup>
+inline uint32_t SelectionLookup(uint32_t num, const HashType *key, const uint32_t *sel, uint32_t *sel_out,
+                                DenseLookup &&dense_lookup) {
+	alignas(64) HashType batch_key[SELECTION_BATCH_SIZE];
+	alignas(64) uint32_t pass[SELECTION_BATCH_SIZE];
+	uint32_t found = 0;
+	for (uint32_t i = 0; i < num; i += SELECTION_BATCH_SIZE) {
+		uint32_t batch = std::min(SELECTION_BATCH_SIZE, num - i);
+		GatherKeys(batch, key, sel + i, batch_key);
+		dense_lookup(batch, batch_key, pass);
+		found += CompactSelection(batch, sel + i, pass, sel_out + found);
 	}
+	return found;
 }
 
+// Number of non-zero entries of out[0, num).
+inline uint32_t CountPassed(uint32_t num, const uint32_t *out) {
+	uint32_t passed = 0;
+	for (uint32_t i = 0; i < num; i++) {
+		passed += out[i] != 0;
+	}
+	return passed;
+}
+
+// Probe kernels of the two-sector (cache-sectorized) filters. BRANCHLESS checks both sectors of every key. TWO_PHASE
+// checks sector 1 for a whole chunk, compacts the survivors and checks sector 2 only for them, which saves the second
+// load and mask of the keys that already miss in sector 1. AUTO picks one of them per chunk from the observed pass
+// rate, which it keeps in the ProbeKernelSwitch and updates on every Lookup.
+enum class ProbeKernel : uint8_t { AUTO, BRANCHLESS, TWO_PHASE };
+
+// Kernel choice of a two-sector filter, driven by an exponential moving average of the pass rate of recent chunks.
+// The default is the fixed BRANCHLESS kernel, which leaves the switch untouched, so a filter can be probed by several
+// threads at once unless AUTO is asked for.
+class ProbeKernelSwitch {
+public:
+	// Keys per chunk, each chunk is probed entirely by one kernel.
+	static constexpr uint32_t CHUNK_SIZE = 1024;
+	// Below this pass rate, the two-phase kernel is faster.
+	static constexpr double TWO_PHASE_MAX_PASS_RATE = 0.25;
+
+public:
+	explicit ProbeKernelSwitch(ProbeKernel kernel = ProbeKernel::BRANCHLESS) : kernel(kernel) {
+	}
+
+	void SetKernel(ProbeKernel new_kernel) {
+		kernel = new_kernel;
+	}
+	ProbeKernel Kernel() const {
+		return kernel;
+	}
+	double PassRate() const {
+		return pass_rate;
+	}
+
+	bool UseTwoPhase() const {
+		return kernel == ProbeKernel::TWO_PHASE ||
+		       (kernel == ProbeKernel::AUTO && pass_rate < TWO_PHASE_MAX_PASS_RATE);
+	}
+
+	// Only AUTO keeps the estimate, so a switch with a fixed kernel is never written.
+	void Observe(uint32_t num, uint32_t passed) {
+		if (kernel == ProbeKernel::AUTO && num > 0) {
+			pass_rate = 0.75 * pass_rate + 0.25 * static_cast<double>(passed) / static_cast<double>(num);
+		}
+	}
+
+private:
+	ProbeKernel kernel;
+	double pass_rate = 1.0;
+};
+
 // 64-byte aligned allocator for cache-sectorized Bloom filter
 template <typename T, std::size_t Alignment>
 class AlignedAllocator {
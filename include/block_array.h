@@ -0,0 +1,297 @@
+#pragma once
+
+#include "base.h"
+#include "filter_memory_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BF_HAVE_MMAP 1
+#endif
+
+namespace bloom_filters {
+// How the blocks of a filter are zeroed.
+enum class BlockInit : uint8_t {
+	// EAGER for small filters, LAZY from LAZY_INIT_MIN_BYTES on.
+	AUTO,
+	// Allocate and zero-fill on the constructing thread (the behavior of std::vector::resize).
+	EAGER,
+	// Anonymous mmap: the kernel maps zero pages on first touch, so construction is O(1) and the cost moves to the
+	// first insert into each page. Pages that are never written take no memory.
+	LAZY,
+	// LAZY, then num_threads threads each touch a slice of the pages, so the pages are spread over the NUMA nodes of
+	// the build threads instead of all landing on the node of the constructing thread.
+	FIRST_TOUCH,
+};
+
+// Whether the blocks live in a POSIX shared-memory segment, so that worker processes on a host share one copy of a
+// filter instead of each building or loading its own.
+enum class SharedMemory : uint8_t {
+	NONE,
+	// Create the segment StorageOptions::shm_name, zeroed and writable (fails if it exists). The name is unlinked when
+	// the filter is destroyed; processes that attached keep their mapping.
+	CREATE,
+	// Map the existing segment shm_name read-only. The filter must be constructed with the same number of keys and bits
+	// per key as the one that created it, and must only be probed: Insert would fault.
+	ATTACH,
+};
+
+// In AUTO mode, filters of at least this size are mapped lazily.
+static constexpr size_t LAZY_INIT_MIN_BYTES = 2 << 20;
+
+// Storage options, the optional last argument of every filter constructor.
+struct StorageOptions {
+	BlockInit init = BlockInit::AUTO;
+	// Threads used by BlockInit::FIRST_TOUCH, 0 for std::thread::hardware_concurrency().
+	uint32_t num_threads = 0;
+	// Ask for transparent huge pages on mapped filters, which cuts the number of page faults by 512x.
+	bool huge_pages = true;
+	// Take the blocks from this pool and give them back on destruction; init and huge_pages are then up to the pool.
+	FilterMemoryPool *pool = nullptr;
+	// Keep the blocks in the shared-memory segment shm_name ("/name", see shm_open); init and pool are then ignored.
+	SharedMemory shared = SharedMemory::NONE;
+	const char *shm_name = nullptr;
+	// Print the filter's size ("BF Size: ...") when it is constructed.
+	bool verbose = true;
+};
+
+// Fixed-size, 64-byte aligned, zero-initialized array of filter blocks. Replaces std::vector so the filters can choose
+// how the memory is obtained and zeroed.
+template <typename T>
+class BlockArray {
+public:
+	static constexpr size_t ALIGNMENT = 64;
+
+public:
+	BlockArray() = default;
+	BlockArray(const BlockArray &) = delete;
+	BlockArray &operator=(const BlockArray &) = delete;
+	BlockArray(BlockArray &&other) noexcept {
+		*this = std::move(other);
+	}
+	BlockArray &operator=(BlockArray &&other) noexcept {
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		std::swap(mapped_bytes_, other.mapped_bytes_);
+		std::swap(pool_, other.pool_);
+		std::swap(chunk_, other.chunk_);
+		std::swap(shm_name_, other.shm_name_);
+		std::swap(shared_, other.shared_);
+		return *this;
+	}
+	~BlockArray() {
+		Release();
+	}
+
+	// Allocates num zeroed blocks, replacing the current ones.
+	void Allocate(size_t num, const StorageOptions &options = StorageOptions()) {
+		Release();
+		size_ = num;
+		size_t bytes = std::max<size_t>(num * sizeof(T), 1);
+		if (options.shared != SharedMemory::NONE) {
+			return MapShared(bytes, options);
+		}
+		if (options.pool != nullptr) {
+			chunk_ = options.pool->Acquire(bytes);
+			pool_ = options.pool;
+			data_ = static_cast<T *>(chunk_.data);
+			return;
+		}
+		BlockInit init = options.init;
+		if (init == BlockInit::AUTO) {
+			init = bytes >= LAZY_INIT_MIN_BYTES ? BlockInit::LAZY : BlockInit::EAGER;
+		}
+#ifdef BF_HAVE_MMAP
+		if (init != BlockInit::EAGER) {
+			size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			size_t mapped = (bytes + page - 1) / page * page;
+			void *mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+#ifdef MADV_HUGEPAGE
+			if (options.huge_pages) {
+				madvise(mem, mapped, MADV_HUGEPAGE);
+			}
+#endif
+			data_ = static_cast<T *>(mem);
+			mapped_bytes_ = mapped;
+			if (init == BlockInit::FIRST_TOUCH) {
+				FirstTouch(options.num_threads);
+			}
+			return;
+		}
+#endif
+		// EAGER, and every mode where mmap is not available
+		data_ = static_cast<T *>(::operator new(bytes, std::align_val_t(ALIGNMENT)));
+		std::memset(static_cast<void *>(data_), 0, bytes);
+	}
+
+	// Zeroes all blocks. A mapped array returns its pages to the kernel (MADV_DONTNEED), which maps zero pages again on
+	// the next touch, so clearing costs a system call instead of a pass over the whole filter.
+	void Clear() {
+		if (shared_ == SharedMemory::ATTACH) {
+			throw std::logic_error("BlockArray: an attached shared-memory filter is read-only");
+		}
+#ifdef BF_HAVE_MMAP
+		// the pages of a shared segment are the segment's, dropping them does not zero it
+		if (mapped_bytes_ > 0 && shared_ == SharedMemory::NONE) {
+			madvise(static_cast<void *>(data_), mapped_bytes_, MADV_DONTNEED);
+			return;
+		}
+#endif
+		std::memset(static_cast<void *>(data_), 0, size_ * sizeof(T));
+	}
+
+	inline T *data() {
+		return data_;
+	}
+	inline const T *data() const {
+		return data_;
+	}
+	inline size_t size() const {
+		return size_;
+	}
+	inline T &operator[](size_t i) {
+		return data_[i];
+	}
+	inline const T &operator[](size_t i) const {
+		return data_[i];
+	}
+	// Whether the blocks are a mapping of their own (BlockInit::LAZY or FIRST_TOUCH, or shared memory).
+	inline bool IsMapped() const {
+		return mapped_bytes_ > 0;
+	}
+	inline SharedMemory Shared() const {
+		return shared_;
+	}
+
+private:
+	// Writes one zero per page, each thread on its own contiguous slice.
+	void FirstTouch(uint32_t num_threads) {
+		if (num_threads == 0) {
+			num_threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+		const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const size_t num_pages = mapped_bytes_ / page;
+		volatile char *base = reinterpret_cast<volatile char *>(data_);
+		auto touch = [base, page](size_t first, size_t last) {
+			for (size_t p = first; p < last; p++) {
+				base[p * page] = 0;
+			}
+		};
+		std::vector<std::thread> threads;
+		for (uint32_t t = 1; t < num_threads; t++) {
+			threads.emplace_back(touch, num_pages * t / num_threads, num_pages * (t + 1) / num_threads);
+		}
+		touch(0, num_pages / num_threads);
+		for (auto &thread : threads) {
+			thread.join();
+		}
+	}
+
+	// Creates or attaches the shared-memory segment options.shm_name, of bytes rounded up to whole pages.
+	void MapShared(size_t bytes, const StorageOptions &options) {
+#ifdef BF_HAVE_MMAP
+		if (options.shm_name == nullptr) {
+			throw std::invalid_argument("BlockArray: shared memory needs a segment name");
+		}
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t mapped = (bytes + page - 1) / page * page;
+		bool create = options.shared == SharedMemory::CREATE;
+		int fd = create ? shm_open(options.shm_name, O_RDWR | O_CREAT | O_EXCL, 0600)
+		                : shm_open(options.shm_name, O_RDONLY, 0);
+		if (fd < 0) {
+			throw std::system_error(errno, std::generic_category(), std::string("shm_open ") + options.shm_name);
+		}
+		struct stat st;
+		bool sized = create ? ftruncate(fd, static_cast<off_t>(mapped)) == 0
+		                    : fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == mapped;
+		void *mem = MAP_FAILED;
+		if (sized) {
+			mem = mmap(nullptr, mapped, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		}
+		int error = errno;
+		close(fd);
+		if (mem == MAP_FAILED) {
+			if (create) {
+				shm_unlink(options.shm_name);
+			}
+			if (!sized && !create) {
+				throw std::invalid_argument(std::string("BlockArray: ") + options.shm_name +
+				                            " holds a filter of another size");
+			}
+			throw std::system_error(error, std::generic_category(), std::string("mmap ") + options.shm_name);
+		}
+#ifdef MADV_HUGEPAGE
+		// takes effect where shared memory may use huge pages (shmem_enabled set to advise)
+		if (options.huge_pages) {
+			madvise(mem, mapped, MADV_HUGEPAGE);
+		}
+#endif
+		data_ = static_cast<T *>(mem);
+		mapped_bytes_ = mapped;
+		shared_ = options.shared;
+		if (create) {
+			shm_name_ = options.shm_name;
+		}
+#else
+		(void)bytes;
+		(void)options;
+		throw std::system_error(std::make_error_code(std::errc::function_not_supported), "shared-memory filters");
+#endif
+	}
+
+	void Release() {
+		if (data_ == nullptr) {
+			return;
+		}
+		if (pool_ != nullptr) {
+			pool_->Release(chunk_, size_ * sizeof(T));
+			pool_ = nullptr;
+		} else
+#ifdef BF_HAVE_MMAP
+		if (mapped_bytes_ > 0) {
+			munmap(static_cast<void *>(data_), mapped_bytes_);
+			if (!shm_name_.empty()) {
+				shm_unlink(shm_name_.c_str());
+				shm_name_.clear();
+			}
+		} else
+#endif
+		{
+			::operator delete(static_cast<void *>(data_), std::align_val_t(ALIGNMENT));
+		}
+		data_ = nullptr;
+		size_ = 0;
+		mapped_bytes_ = 0;
+		shared_ = SharedMemory::NONE;
+	}
+
+	T *data_ = nullptr;
+	size_t size_ = 0;
+	// Length of the anonymous mapping, 0 for heap and pool memory.
+	size_t mapped_bytes_ = 0;
+	// Pool the blocks came from, nullptr if the array owns them.
+	FilterMemoryPool *pool_ = nullptr;
+	PoolChunk chunk_;
+	SharedMemory shared_ = SharedMemory::NONE;
+	// Segment to unlink on release, set by the process that created it.
+	std::string shm_name_;
+};
+} // namespace bloom_filters
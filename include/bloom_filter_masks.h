@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace bloom_filters {
+// A set of pre-generated bit masks in a Word, generated at compile time.
+// https://save-buffer.github.io/bloom_filter.html
+//
+// All masks are stored as a single bit vector and the mask with id n is the kBitsPerMask bits starting at bit offset n.
+// In each consecutive kBitsPerMask bits, there are between MIN_BITS_SET and MAX_BITS_SET bits set, so every mask has
+// that many. A key's lowest LOG_NUM_MASKS hash bits pick a mask and the next log2(word bits) bits rotate it.
+//
+// More masks lower the false-positive rate (masks with neighboring ids share most of their bits, so few masks make
+// false positives correlated) but take more cache lines: 2^13 masks are 1 KiB.
+template <typename Word, int MIN_BITS_SET, int MAX_BITS_SET, int LOG_NUM_MASKS>
+struct BloomFilterMaskTable {
+	static constexpr int kWordBits = sizeof(Word) * 8;
+	// Masks are 7 bits shorter than a word because then they can be accessed at an arbitrary bit offset using a single
+	// unaligned load of a word.
+	static constexpr int kBitsPerMask = kWordBits - 7;
+	static constexpr Word kFullMask = (Word(1) << kBitsPerMask) - 1;
+
+	static constexpr int kMinBitsSet = MIN_BITS_SET;
+	static constexpr int kMaxBitsSet = MAX_BITS_SET;
+	// With as many bits entering the window as leaving it, a generator with kMinBitsSet == kMaxBitsSet could only
+	// produce shifts of its first mask.
+	static_assert(0 < MIN_BITS_SET && MIN_BITS_SET < MAX_BITS_SET && MAX_BITS_SET < kBitsPerMask,
+	              "need 0 < MIN_BITS_SET < MAX_BITS_SET < bits per mask");
+
+	static constexpr int kLogNumMasks = LOG_NUM_MASKS;
+	static constexpr int kNumMasks = 1 << kLogNumMasks;
+	static constexpr int kTotalBytes = (kNumMasks + kWordBits) / 8;
+
+	uint8_t masks_[kTotalBytes];
+	// Number of bits set, summed over all masks.
+	uint64_t total_bits_set_;
+
+	constexpr BloomFilterMaskTable() : masks_(), total_bits_set_(0) {
+		// splitmix64, since the standard engines are not constexpr
+		uint64_t state = 0;
+		auto random = [&state](uint64_t min_value, uint64_t max_value) {
+			state += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = state;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			z ^= z >> 31;
+			return min_value + z % (max_value - min_value + 1);
+		};
+
+		// Prepare the first mask
+		uint64_t num_bits_set = random(kMinBitsSet, kMaxBitsSet);
+		for (uint64_t i = 0; i < num_bits_set; i++) {
+			while (true) {
+				uint64_t bit_pos = random(0, kBitsPerMask - 1);
+				if (!GetBit(bit_pos)) {
+					SetBit(bit_pos);
+					break;
+				}
+			}
+		}
+
+		// Slide the window: every bit that enters keeps the number of bits set in [kMinBitsSet, kMaxBitsSet]
+		uint64_t num_bits_total = kNumMasks + kBitsPerMask - 1;
+		total_bits_set_ = num_bits_set;
+		for (uint64_t i = kBitsPerMask; i < num_bits_total; i++) {
+			bool bit_leaving = GetBit(i - kBitsPerMask);
+			if (bit_leaving && num_bits_set == kMinBitsSet) {
+				SetBit(i);
+			} else if (bit_leaving || num_bits_set < kMaxBitsSet) {
+				if (random(0, kBitsPerMask * 2 - 1) < kMinBitsSet + kMaxBitsSet) {
+					SetBit(i);
+					num_bits_set += !bit_leaving;
+				} else {
+					num_bits_set -= bit_leaving;
+				}
+			}
+			total_bits_set_ += num_bits_set;
+		}
+	}
+
+	inline Word Mask(Word hash) const {
+		// The lowest bits of hash pick the mask, the next ones its rotation.
+		int mask_id = static_cast<int>(hash & (kNumMasks - 1));
+		Word result = GetMask(mask_id);
+		int rotation = static_cast<int>((hash >> kLogNumMasks) & (kWordBits - 1));
+		return (result << rotation) | (result >> ((kWordBits - rotation) & (kWordBits - 1)));
+	}
+
+	// Mean number of bits set per mask.
+	constexpr double AverageBitsSet() const {
+		return static_cast<double>(total_bits_set_) / kNumMasks;
+	}
+
+private:
+	constexpr bool GetBit(uint64_t bit_pos) const {
+		return (masks_[bit_pos / 8] >> (bit_pos % 8)) & 1;
+	}
+	constexpr void SetBit(uint64_t bit_pos) {
+		masks_[bit_pos / 8] |= static_cast<uint8_t>(1 << (bit_pos % 8));
+	}
+
+	inline Word GetMask(int bit_offset) const {
+		Word value;
+		std::memcpy(&value, masks_ + bit_offset / 8, sizeof(Word));
+		return (value >> (bit_offset % 8)) & kFullMask;
+	}
+};
+
+// One table per parameter set for the whole program (an inline variable), built by the compiler.
+template <typename Word, int MIN_BITS_SET, int MAX_BITS_SET, int LOG_NUM_MASKS>
+inline constexpr BloomFilterMaskTable<Word, MIN_BITS_SET, MAX_BITS_SET, LOG_NUM_MASKS> BLOOM_FILTER_MASKS {};
+
+// A mask table chosen at run time: the same Mask as the table it views.
+template <typename Word>
+struct MaskTableView {
+	const uint8_t *masks;
+	uint32_t log_num_masks;
+	double average_bits_set;
+
+	template <int MIN_BITS_SET, int MAX_BITS_SET, int LOG_NUM_MASKS>
+	static constexpr MaskTableView
+	Of(const BloomFilterMaskTable<Word, MIN_BITS_SET, MAX_BITS_SET, LOG_NUM_MASKS> &table) {
+		return {table.masks_, LOG_NUM_MASKS, table.AverageBitsSet()};
+	}
+
+	inline Word Mask(Word hash) const {
+		constexpr int WORD_BITS = sizeof(Word) * 8;
+		constexpr Word FULL_MASK = (Word(1) << (WORD_BITS - 7)) - 1;
+		uint32_t mask_id = static_cast<uint32_t>(hash) & ((1U << log_num_masks) - 1);
+		Word result;
+		std::memcpy(&result, masks + mask_id / 8, sizeof(Word));
+		result = (result >> (mask_id % 8)) & FULL_MASK;
+		int rotation = static_cast<int>((hash >> log_num_masks) & (WORD_BITS - 1));
+		return (result << rotation) | (result >> ((WORD_BITS - rotation) & (WORD_BITS - 1)));
+	}
+};
+} // namespace bloom_filters
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "base.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace bloom_filters {
+// When a filter's Insert partitions the keys by block before inserting them.
+enum class BulkInsertMode : uint8_t { AUTO, NEVER, ALWAYS };
+
+// In AUTO mode, filters of at least this size are built bucket by bucket. Smaller filters mostly stay in the cache and
+// the partitioning pass costs more than it saves.
+static constexpr size_t BULK_INSERT_MIN_FILTER_BYTES = 64 << 20;
+// Filter bytes covered by one bucket, about the size of an L2 cache.
+static constexpr size_t BULK_INSERT_REGION_BYTES = 256 << 10;
+// At most 2^10 buckets, so the partitioning write streams stay within the L1 TLB and the L1/L2 caches.
+static constexpr uint32_t BULK_INSERT_MAX_FANOUT_LOG = 10;
+// In AUTO mode, batches with fewer keys per bucket are inserted directly.
+static constexpr size_t BULK_INSERT_MIN_KEYS_PER_BUCKET = 16;
+
+// Number of bucket bits for inserting num keys into a filter of filter_bytes, 0 to insert directly.
+inline uint32_t BulkInsertFanoutLog(size_t filter_bytes, size_t num, BulkInsertMode mode) {
+	if (mode == BulkInsertMode::NEVER ||
+	    (mode == BulkInsertMode::AUTO && filter_bytes < BULK_INSERT_MIN_FILTER_BYTES)) {
+		return 0;
+	}
+	uint32_t fanout_log = 0;
+	while (fanout_log < BULK_INSERT_MAX_FANOUT_LOG && (filter_bytes >> fanout_log) > BULK_INSERT_REGION_BYTES) {
+		fanout_log++;
+	}
+	if (mode == BulkInsertMode::AUTO && num < (BULK_INSERT_MIN_KEYS_PER_BUCKET << fanout_log)) {
+		return 0;
+	}
+	return fanout_log;
+}
+
+// Copies one 64-byte line to a 64-byte aligned destination, bypassing the cache where possible.
+inline void StreamLine(void *BF_RESTRICT dst, const void *BF_RESTRICT src) {
+#if defined(__AVX2__)
+	const __m256i *from = reinterpret_cast<const __m256i *>(src);
+	__m256i *to = reinterpret_cast<__m256i *>(dst);
+	_mm256_stream_si256(to, _mm256_load_si256(from));
+	_mm256_stream_si256(to + 1, _mm256_load_si256(from + 1));
+#else
+	std::memcpy(dst, src, 64);
+#endif
+}
+
+// Inserts key[0, num) bucket by bucket. The batch is radix-partitioned on bucket_of(key), which must be in
+// [0, 2^fanout_log) and select a contiguous, cache-sized region of the filter (the top bits of the block index), then
+// insert_kernel(n, keys) runs once per bucket. Each region is loaded from DRAM once and all its keys are ORed in while
+// it stays in the cache, instead of one random read-modify-write into DRAM per key. The whole batch is partitioned at
+// once (scratch memory of num hashes): with smaller chunks, a line would see too few keys per chunk to be reused.
+template <typename HashType, typename BucketOf, typename InsertKernel>
+void BucketedInsert(size_t num, const HashType *key, uint32_t fanout_log, BucketOf &&bucket_of,
+                    InsertKernel &&insert_kernel) {
+	constexpr uint32_t LINE = 64 / sizeof(HashType);
+	const uint32_t fanout = 1U << fanout_log;
+
+	// histogram
+	std::vector<size_t> counts(fanout, 0);
+	for (size_t i = 0; i < num; i++) {
+		counts[bucket_of(key[i])]++;
+	}
+	// every bucket starts on a line, so the partitioning can write whole lines
+	std::vector<size_t> starts(fanout);
+	std::vector<size_t> cursors(fanout);
+	size_t total = 0;
+	for (uint32_t b = 0; b < fanout; b++) {
+		starts[b] = cursors[b] = total;
+		total += (counts[b] + LINE - 1) / LINE * LINE;
+	}
+	// not value-initialized, every slot that is read is written first
+	AlignedAllocator<HashType, 64> allocator;
+	auto deallocate = [&allocator, total](HashType *p) { allocator.deallocate(p, total); };
+	std::unique_ptr<HashType[], decltype(deallocate)> partitioned(allocator.allocate(total), deallocate);
+
+	// scatter through one line-sized write-combining buffer per bucket, full lines are streamed out
+	std::vector<HashType, AlignedAllocator<HashType, 64>> buffers(static_cast<size_t>(fanout) * LINE);
+	for (size_t i = 0; i < num; i++) {
+		uint32_t bucket = bucket_of(key[i]);
+		size_t pos = cursors[bucket]++;
+		HashType *buffer = buffers.data() + static_cast<size_t>(bucket) * LINE;
+		buffer[pos % LINE] = key[i];
+		if (pos % LINE == LINE - 1) {
+			StreamLine(partitioned.get() + pos + 1 - LINE, buffer);
+		}
+	}
+#if defined(__AVX2__)
+	_mm_sfence();
+#endif
+	for (uint32_t b = 0; b < fanout; b++) {
+		size_t rest = cursors[b] % LINE;
+		std::copy(buffers.data() + static_cast<size_t>(b) * LINE, buffers.data() + static_cast<size_t>(b) * LINE + rest,
+		          partitioned.get() + cursors[b] - rest);
+	}
+
+	// one cache-sized region of the filter at a time
+	for (uint32_t b = 0; b < fanout; b++) {
+		if (counts[b] > 0) {
+			insert_kernel(counts[b], partitioned.get() + starts[b]);
+		}
+	}
+}
+} // namespace bloom_filters
@@ -1,5 +1,12 @@
+#pragma once
+
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
+#include "bulk_insert.h"
+#include "cache_sectorized_probe.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <cstdint>
@@ -13,50 +20,118 @@ class CacheSectorizedBF32Bit {
 public:
 	const uint32_t MAX_NUM_BLOCKS = (1 << 26);
 	static constexpr auto MIN_NUM_BITS = 512;
+	// 3 bits in one 32-bit sector of a 64-byte line and 4 in a sector of its other half
+	static constexpr FilterGeometry GEOMETRY = {32, 16, 2, 3.5};
 	static constexpr auto SIMD_BATCH_SIZE = 16;
 	static constexpr auto SIMD_ALIGNMENT = 64;
 
 public:
-	explicit CacheSectorizedBF32Bit(size_t n_key, uint32_t n_bits_per_key) {
+	explicit CacheSectorizedBF32Bit(size_t n_key, uint32_t n_bits_per_key,
+	                                const StorageOptions &storage = StorageOptions()) {
 		uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
 		num_blocks = (min_bits >> 5) + 1;
 		num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
 		num_blocks = std::min(1U << num_blocks_log, MAX_NUM_BLOCKS);
-		blocks_.resize(num_blocks);
-		std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		blocks_.Allocate(num_blocks, storage);
+		if (storage.verbose) {
+			std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		}
 	}
 
 public:
+	// Probes chunk by chunk with the kernel chosen by the filter's kernel switch (see ProbeKernel and SetProbeKernel).
 	inline uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out) {
-		return CacheSectorizedLookup(num, key, blocks_.data(), out);
+		return Lookup(num, key, out, kernel_switch_);
+	}
+	// Same, with a kernel switch owned by the caller: with ProbeKernel::AUTO only the switch is written, so threads
+	// that share the filter can each keep their own and adapt to their own probes.
+	inline uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out, ProbeKernelSwitch &kernel_switch) const {
+		for (uint32_t base = 0; base < num; base += ProbeKernelSwitch::CHUNK_SIZE) {
+			uint32_t batch = std::min(ProbeKernelSwitch::CHUNK_SIZE, num - base);
+			if (kernel_switch.UseTwoPhase()) {
+				uint32_t passed = TwoPhaseLookup(batch, key + base, blocks_.data(), num_blocks, out + base);
+				kernel_switch.Observe(batch, passed);
+			} else {
+				CacheSectorizedLookup(batch, key + base, blocks_.data(), out + base);
+				if (kernel_switch.Kernel() == ProbeKernel::AUTO) {
+					kernel_switch.Observe(batch, CountPassed(batch, out + base));
+				}
+			}
+		}
+		return num;
+	}
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint64_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint64_t *batch_key, uint32_t *out) {
+			CacheSectorizedLookup(n, batch_key, blocks_.data(), out);
+		});
 	}
+	// Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+	inline bool LookupOne(uint64_t key) const {
+		return LookupOne(static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32), blocks_.data());
+	}
+	inline void InsertOne(uint64_t key) {
+		InsertOne(static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32), blocks_.data());
+	}
+	// Large filters are built bucket by bucket (see BucketedInsert).
 	inline void Insert(uint32_t num, uint64_t *key) {
-		return CacheSectorizedInsert(num, key, blocks_.data());
+		uint32_t fanout_log = BulkInsertFanoutLog(num_blocks * sizeof(uint32_t), num, bulk_insert_mode_);
+		if (fanout_log == 0) {
+			return CacheSectorizedInsert(num, key, blocks_.data());
+		}
+		// both sectors of a key are in the same 64-byte line, so its first block selects the bucket
+		uint32_t shift = __builtin_ctz(num_blocks) - fanout_log;
+		BucketedInsert(
+		    num, key, fanout_log,
+		    [this, shift](uint64_t k) { return GetBlock1(static_cast<uint32_t>(k), k >> 32) >> shift; },
+		    [this](size_t n, uint64_t *bucket_key) { CacheSectorizedInsert(n, bucket_key, blocks_.data()); });
+	}
+
+	// Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+	inline void Clear() {
+		blocks_.Clear();
+	}
+
+	// The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+	inline BlockArray<uint32_t> &Blocks() {
+		return blocks_;
+	}
+	inline const BlockArray<uint32_t> &Blocks() const {
+		return blocks_;
+	}
+
+	// Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+	inline FilterStats Stats(uint32_t num_threads = 1) const {
+		return ComputeFilterStats(blocks_, GEOMETRY, num_threads);
+	}
+
+	inline void SetBulkInsertMode(BulkInsertMode mode) {
+		bulk_insert_mode_ = mode;
+	}
+
+	// Sets the probe kernel of the 3-argument Lookup; BRANCHLESS by default. ProbeKernel::AUTO switches on the
+	// observed pass rate, which Lookup then writes to the filter: a filter probed by several threads must keep a fixed
+	// kernel, or have each thread pass its own ProbeKernelSwitch.
+	inline void SetProbeKernel(ProbeKernel kernel) {
+		kernel_switch_.SetKernel(kernel);
+	}
+	inline const ProbeKernelSwitch &KernelSwitch() const {
+		return kernel_switch_;
 	}
 
 private:
-	// key_lo |5:bit3|5:bit2|5:bit1|  13:block   |4:sector1 | bit layout (32:total)
-	// key_hi |5:bit4|5:bit3|5:bit2|5:bit1|9:block|3:sector2| bit layout (32:total)
+	// Bit layout of the key: see cache_sectorized_probe.h, shared with the other cache-sectorized filter.
 	inline uint32_t GetMask1(uint32_t key_lo) const {
-		// 3 bits in key_lo
-		return (1u << ((key_lo >> 17) & 31)) | (1u << ((key_lo >> 22) & 31)) | (1u << ((key_lo >> 27) & 31));
+		return SectorizedMask1(key_lo);
 	}
-
 	inline uint32_t GetMask2(uint32_t key_hi) const {
-		// 4 bits in key_hi
-		return (1u << ((key_hi >> 12) & 31)) | (1u << ((key_hi >> 17) & 31)) | (1u << ((key_hi >> 22) & 31)) |
-		       (1u << ((key_hi >> 27) & 31));
+		return SectorizedMask2(key_hi);
 	}
-
 	inline uint32_t GetBlock1(uint32_t key_lo, uint32_t key_hi) const {
-		// block: 13 bits in key_lo and 9 bits in key_hi
-		// sector 1: 4 bits in key_lo
-		return ((key_lo & ((1 << 17) - 1)) + ((key_hi << 14) & (((1 << 9) - 1) << 17))) & (num_blocks - 1);
+		return SectorizedBlock1(key_lo, key_hi, num_blocks);
 	}
-
 	inline uint32_t GetBlock2(uint32_t key_hi, uint32_t block1) const {
-		// sector 2: 3 bits in key_hi
-		return block1 ^ (8 + (key_hi & 7));
+		return SectorizedBlock2(key_hi, block1);
 	}
 
 	inline void InsertOne(uint32_t key_lo, uint32_t key_hi, uint32_t *BF_RESTRICT bf) {
@@ -137,6 +212,8 @@ private:
 
 	uint32_t num_blocks;
 	uint32_t num_blocks_log;
-	std::vector<uint32_t, AlignedAllocator<uint32_t, SIMD_ALIGNMENT>> blocks_;
+	BlockArray<uint32_t> blocks_;
+	ProbeKernelSwitch kernel_switch_;
+	BulkInsertMode bulk_insert_mode_ = BulkInsertMode::AUTO;
 };
 } // namespace bloom_filters
\ No newline at end of file
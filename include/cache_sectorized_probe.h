@@ -0,0 +1,198 @@
+#pragma once
+
+#include "base.h"
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace bloom_filters {
+// Bit layout and two-phase probe kernel shared by the two cache-sectorized filters (CacheSectorizedBF32Bit,
+// NewCacheSectorizedBF32Bit), which only differ in their batch kernels. num_blocks is the filter's number of 32-bit
+// blocks, a power of two.
+//
+// key_lo |5:bit3|5:bit2|5:bit1|  13:block   |4:sector1 | bit layout (32:total)
+// key_hi |5:bit4|5:bit3|5:bit2|5:bit1|9:block|3:sector2| bit layout (32:total)
+inline uint32_t SectorizedMask1(uint32_t key_lo) {
+	// 3 bits in key_lo
+	return (1u << ((key_lo >> 17) & 31)) | (1u << ((key_lo >> 22) & 31)) | (1u << ((key_lo >> 27) & 31));
+}
+
+inline uint32_t SectorizedMask2(uint32_t key_hi) {
+	// 4 bits in key_hi
+	return (1u << ((key_hi >> 12) & 31)) | (1u << ((key_hi >> 17) & 31)) | (1u << ((key_hi >> 22) & 31)) |
+	       (1u << ((key_hi >> 27) & 31));
+}
+
+inline uint32_t SectorizedBlock1(uint32_t key_lo, uint32_t key_hi, uint32_t num_blocks) {
+	// block: 13 bits in key_lo and 9 bits in key_hi
+	// sector 1: 4 bits in key_lo
+	return ((key_lo & ((1 << 17) - 1)) + ((key_hi << 14) & (((1 << 9) - 1) << 17))) & (num_blocks - 1);
+}
+
+inline uint32_t SectorizedBlock2(uint32_t key_hi, uint32_t block1) {
+	// sector 2: 3 bits in key_hi
+	return block1 ^ (8 + (key_hi & 7));
+}
+
+// Phase 2 of TwoPhaseLookup: sets out[survivors[k]] for the keys that also pass sector 2 and returns how many there
+// are.
+inline uint32_t SectorTwoLookup(uint32_t num_survivors, const uint32_t *BF_RESTRICT survivors,
+                                const uint32_t *BF_RESTRICT key, const uint32_t *BF_RESTRICT bf, uint32_t num_blocks,
+                                uint32_t *BF_RESTRICT out) {
+	uint32_t passed = 0;
+	uint32_t k = 0;
+#if defined(__AVX512F__)
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m512i five_bits = _mm512_set1_epi32(31);
+	for (; k + 16 <= num_survivors; k += 16) {
+		__m512i rows = _mm512_loadu_si512(survivors + k);
+		__m512i lo_pos = _mm512_add_epi32(rows, rows);
+		__m512i key_lo = _mm512_i32gather_epi32(lo_pos, key, 4);
+		__m512i key_hi = _mm512_i32gather_epi32(lo_pos, key + 1, 4);
+		// SectorizedBlock1, SectorizedBlock2 and SectorizedMask2, 16 keys at a time
+		__m512i block = _mm512_add_epi32(_mm512_and_si512(key_lo, _mm512_set1_epi32((1 << 17) - 1)),
+		                                 _mm512_and_si512(_mm512_slli_epi32(key_hi, 14),
+		                                                  _mm512_set1_epi32(((1 << 9) - 1) << 17)));
+		block = _mm512_and_si512(block, _mm512_set1_epi32(num_blocks - 1));
+		block = _mm512_xor_si512(block, _mm512_add_epi32(_mm512_set1_epi32(8),
+		                                                 _mm512_and_si512(key_hi, _mm512_set1_epi32(7))));
+		__m512i mask = _mm512_or_si512(
+		    _mm512_or_si512(_mm512_sllv_epi32(one, _mm512_and_si512(_mm512_srli_epi32(key_hi, 12), five_bits)),
+		                    _mm512_sllv_epi32(one, _mm512_and_si512(_mm512_srli_epi32(key_hi, 17), five_bits))),
+		    _mm512_or_si512(_mm512_sllv_epi32(one, _mm512_and_si512(_mm512_srli_epi32(key_hi, 22), five_bits)),
+		                    _mm512_sllv_epi32(one, _mm512_srli_epi32(key_hi, 27))));
+		__m512i words = _mm512_i32gather_epi32(block, bf, 4);
+		__mmask16 hit = _mm512_cmpeq_epi32_mask(_mm512_and_si512(words, mask), mask);
+		_mm512_i32scatter_epi32(out, rows, _mm512_maskz_mov_epi32(hit, one), 4);
+		passed += __builtin_popcount(hit);
+	}
+#elif defined(__AVX2__)
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i five_bits = _mm256_set1_epi32(31);
+	for (; k + 8 <= num_survivors; k += 8) {
+		__m256i rows = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(survivors + k));
+		__m256i lo_pos = _mm256_add_epi32(rows, rows);
+		__m256i key_lo = _mm256_i32gather_epi32(reinterpret_cast<const int *>(key), lo_pos, 4);
+		__m256i key_hi = _mm256_i32gather_epi32(reinterpret_cast<const int *>(key + 1), lo_pos, 4);
+		// SectorizedBlock1, SectorizedBlock2 and SectorizedMask2, 8 keys at a time
+		__m256i block = _mm256_add_epi32(_mm256_and_si256(key_lo, _mm256_set1_epi32((1 << 17) - 1)),
+		                                 _mm256_and_si256(_mm256_slli_epi32(key_hi, 14),
+		                                                  _mm256_set1_epi32(((1 << 9) - 1) << 17)));
+		block = _mm256_and_si256(block, _mm256_set1_epi32(num_blocks - 1));
+		block = _mm256_xor_si256(block, _mm256_add_epi32(_mm256_set1_epi32(8),
+		                                                 _mm256_and_si256(key_hi, _mm256_set1_epi32(7))));
+		__m256i mask = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_sllv_epi32(one, _mm256_and_si256(_mm256_srli_epi32(key_hi, 12), five_bits)),
+		                    _mm256_sllv_epi32(one, _mm256_and_si256(_mm256_srli_epi32(key_hi, 17), five_bits))),
+		    _mm256_or_si256(_mm256_sllv_epi32(one, _mm256_and_si256(_mm256_srli_epi32(key_hi, 22), five_bits)),
+		                    _mm256_sllv_epi32(one, _mm256_srli_epi32(key_hi, 27))));
+		__m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(bf), block, 4);
+		__m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(words, mask), mask);
+		alignas(32) uint32_t result[8];
+		_mm256_store_si256(reinterpret_cast<__m256i *>(result), _mm256_and_si256(hit, one));
+		for (uint32_t j = 0; j < 8; j++) {
+			out[survivors[k + j]] = result[j];
+		}
+		passed += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+	}
+#endif
+	for (; k < num_survivors; k++) {
+		uint32_t i = survivors[k];
+		uint32_t key_lo = key[i + i];
+		uint32_t key_hi = key[i + i + 1];
+		uint32_t mask2 = SectorizedMask2(key_hi);
+		uint32_t hit = (bf[SectorizedBlock2(key_hi, SectorizedBlock1(key_lo, key_hi, num_blocks))] & mask2) == mask2;
+		out[i] = hit;
+		passed += hit;
+	}
+	return passed;
+}
+
+// Phase 1 of TwoPhaseLookup: clears out[0, num), writes the keys that pass sector 1 to survivors and returns how
+// many there are.
+inline uint32_t SectorOneSurvivors(uint32_t num, const uint32_t *BF_RESTRICT key, const uint32_t *BF_RESTRICT bf,
+                                   uint32_t num_blocks, uint32_t *BF_RESTRICT out, uint32_t *BF_RESTRICT survivors) {
+	uint32_t num_survivors = 0;
+	uint32_t i = 0;
+#if defined(__AVX512F__)
+	const __m512i lo_index = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	const __m512i hi_index = _mm512_add_epi32(lo_index, _mm512_set1_epi32(1));
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m512i five_bits = _mm512_set1_epi32(31);
+	__m512i rows = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	for (; i + 16 <= num; i += 16) {
+		__m512i keys_a = _mm512_loadu_si512(key + 2 * i);
+		__m512i keys_b = _mm512_loadu_si512(key + 2 * i + 16);
+		__m512i key_lo = _mm512_permutex2var_epi32(keys_a, lo_index, keys_b);
+		__m512i key_hi = _mm512_permutex2var_epi32(keys_a, hi_index, keys_b);
+		// SectorizedBlock1 and SectorizedMask1, 16 keys at a time
+		__m512i block = _mm512_add_epi32(_mm512_and_si512(key_lo, _mm512_set1_epi32((1 << 17) - 1)),
+		                                 _mm512_and_si512(_mm512_slli_epi32(key_hi, 14),
+		                                                  _mm512_set1_epi32(((1 << 9) - 1) << 17)));
+		block = _mm512_and_si512(block, _mm512_set1_epi32(num_blocks - 1));
+		__m512i mask = _mm512_or_si512(
+		    _mm512_or_si512(_mm512_sllv_epi32(one, _mm512_and_si512(_mm512_srli_epi32(key_lo, 17), five_bits)),
+		                    _mm512_sllv_epi32(one, _mm512_and_si512(_mm512_srli_epi32(key_lo, 22), five_bits))),
+		    _mm512_sllv_epi32(one, _mm512_srli_epi32(key_lo, 27)));
+		__m512i words = _mm512_i32gather_epi32(block, bf, 4);
+		__mmask16 hit = _mm512_cmpeq_epi32_mask(_mm512_and_si512(words, mask), mask);
+		_mm512_storeu_si512(out + i, _mm512_setzero_si512());
+		_mm512_mask_compressstoreu_epi32(survivors + num_survivors, hit, rows);
+		num_survivors += __builtin_popcount(hit);
+		rows = _mm512_add_epi32(rows, _mm512_set1_epi32(16));
+	}
+#elif defined(__AVX2__)
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i five_bits = _mm256_set1_epi32(31);
+	for (; i + 8 <= num; i += 8) {
+		__m256 keys_a = _mm256_loadu_ps(reinterpret_cast<const float *>(key + 2 * i));
+		__m256 keys_b = _mm256_loadu_ps(reinterpret_cast<const float *>(key + 2 * i + 8));
+		// de-interleave, shuffle_ps leaves the 64-bit pairs in the order 0, 2, 1, 3
+		__m256i key_lo = _mm256_permute4x64_epi64(
+		    _mm256_castps_si256(_mm256_shuffle_ps(keys_a, keys_b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i key_hi = _mm256_permute4x64_epi64(
+		    _mm256_castps_si256(_mm256_shuffle_ps(keys_a, keys_b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+		// SectorizedBlock1 and SectorizedMask1, 8 keys at a time
+		__m256i block = _mm256_add_epi32(_mm256_and_si256(key_lo, _mm256_set1_epi32((1 << 17) - 1)),
+		                                 _mm256_and_si256(_mm256_slli_epi32(key_hi, 14),
+		                                                  _mm256_set1_epi32(((1 << 9) - 1) << 17)));
+		block = _mm256_and_si256(block, _mm256_set1_epi32(num_blocks - 1));
+		__m256i mask = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_sllv_epi32(one, _mm256_and_si256(_mm256_srli_epi32(key_lo, 17), five_bits)),
+		                    _mm256_sllv_epi32(one, _mm256_and_si256(_mm256_srli_epi32(key_lo, 22), five_bits))),
+		    _mm256_sllv_epi32(one, _mm256_srli_epi32(key_lo, 27)));
+		__m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(bf), block, 4);
+		__m256i passed = _mm256_cmpeq_epi32(_mm256_and_si256(words, mask), mask);
+		uint32_t hit = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(passed)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_setzero_si256());
+		// few survivors at the pass rates this kernel is chosen for
+		while (hit) {
+			survivors[num_survivors++] = i + __builtin_ctz(hit);
+			hit &= hit - 1;
+		}
+	}
+#endif
+	for (; i < num; i++) {
+		uint32_t key_lo = key[i + i];
+		uint32_t key_hi = key[i + i + 1];
+		uint32_t mask1 = SectorizedMask1(key_lo);
+		out[i] = 0;
+		// branch-free: always write, only advance on a hit
+		survivors[num_survivors] = i;
+		num_survivors += (bf[SectorizedBlock1(key_lo, key_hi, num_blocks)] & mask1) == mask1;
+	}
+	return num_survivors;
+}
+
+// Checks sector 1 of every key, compacts the keys that pass and checks sector 2 only for them. num must not exceed
+// ProbeKernelSwitch::CHUNK_SIZE. Returns the number of keys that pass both sectors.
+inline uint32_t TwoPhaseLookup(uint32_t num, const uint64_t *BF_RESTRICT key64, const uint32_t *BF_RESTRICT bf,
+                               uint32_t num_blocks, uint32_t *BF_RESTRICT out) {
+	const uint32_t *BF_RESTRICT key = reinterpret_cast<const uint32_t * BF_RESTRICT>(key64);
+	uint32_t survivors[ProbeKernelSwitch::CHUNK_SIZE];
+	uint32_t num_survivors = SectorOneSurvivors(num, key, bf, num_blocks, out, survivors);
+
+	// phase 2: sector 2 of the survivors only
+	return SectorTwoLookup(num_survivors, survivors, key, bf, num_blocks, out);
+}
+} // namespace bloom_filters
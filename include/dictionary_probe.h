@@ -0,0 +1,225 @@
+#pragma once
+
+#include "base.h"
+#include "hash_functions.h"
+#include "string_hash.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <type_traits>
+#include <vector>
+
+namespace bloom_filters {
+// Dictionary entries hashed and probed per chunk.
+static constexpr size_t DICTIONARY_BATCH_SIZE = 1024;
+
+// Filter result of every entry of a dictionary: bit c is set if dictionary entry c may be in the filter. A column of
+// codes into the dictionary is then probed by reading one bit per row (MapCodes, MapRunEndCodes) instead of hashing
+// and probing every row.
+class DictionaryResult {
+public:
+	// Dictionaries of up to this many entries are mapped with a permute of the bitmap held in one register, larger
+	// ones with a gather.
+#if defined(__AVX512F__)
+	static constexpr size_t PERMUTE_MAX_ENTRIES = 512;
+#else
+	static constexpr size_t PERMUTE_MAX_ENTRIES = 256;
+#endif
+
+public:
+	// out[c] is the filter's Lookup result of dictionary entry c.
+	DictionaryResult(size_t num_entries, const uint32_t *out) : num_entries(num_entries) {
+		// at least one register's worth of words, for the permute
+		words.assign(std::max((num_entries + 31) / 32, PERMUTE_MAX_ENTRIES / 32), 0);
+		for (size_t c = 0; c < num_entries; c++) {
+			words[c >> 5] |= static_cast<uint32_t>(out[c] != 0) << (c & 31);
+			num_passed += out[c] != 0;
+		}
+	}
+
+	inline bool Passes(uint32_t code) const {
+		return (words[code >> 5] >> (code & 31)) & 1;
+	}
+	inline size_t NumEntries() const {
+		return num_entries;
+	}
+	// Dictionary entries that pass the filter.
+	inline size_t NumPassed() const {
+		return num_passed;
+	}
+	inline const uint32_t *Words() const {
+		return words.data();
+	}
+
+private:
+	size_t num_entries;
+	size_t num_passed = 0;
+	// LSB-first bitmap, padded to PERMUTE_MAX_ENTRIES bits
+	std::vector<uint32_t> words;
+};
+
+// Probes a dictionary of integer keys with any filter, once per entry.
+template <typename BloomFilterType, typename HashType>
+DictionaryResult ProbeDictionary(BloomFilterType &bf, size_t num_entries, const uint64_t *dictionary) {
+	alignas(64) HashType hashes[DICTIONARY_BATCH_SIZE];
+	std::vector<uint32_t> out(num_entries);
+	for (size_t base = 0; base < num_entries; base += DICTIONARY_BATCH_SIZE) {
+		size_t batch = std::min(DICTIONARY_BATCH_SIZE, num_entries - base);
+		HashVector(batch, dictionary + base, hashes);
+		bf.Lookup(batch, hashes, out.data() + base);
+	}
+	return DictionaryResult(num_entries, out.data());
+}
+
+// Probes a dictionary of strings with any filter, once per entry (see LookupStrings).
+template <typename BloomFilterType, typename HashType>
+DictionaryResult ProbeStringDictionary(BloomFilterType &bf, size_t num_entries, const StringColumn &dictionary) {
+	std::vector<uint32_t> out(num_entries);
+	LookupStrings<BloomFilterType, HashType>(bf, num_entries, dictionary, out.data());
+	return DictionaryResult(num_entries, out.data());
+}
+
+#if defined(__AVX2__)
+// Loads 8 codes of 8, 16 or 32 bits, zero-extended to 32 bits.
+template <typename CodeType>
+inline __m256i LoadCodes8(const CodeType *codes) {
+	if (sizeof(CodeType) == 1) {
+		return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(codes)));
+	} else if (sizeof(CodeType) == 2) {
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(codes)));
+	}
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes));
+}
+#endif
+
+#if defined(__AVX512F__)
+// Loads 16 codes of 8, 16 or 32 bits, zero-extended to 32 bits.
+template <typename CodeType>
+inline __m512i LoadCodes16(const CodeType *codes) {
+	if (sizeof(CodeType) == 1) {
+		return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(codes)));
+	} else if (sizeof(CodeType) == 2) {
+		return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes)));
+	}
+	return _mm512_loadu_si512(codes);
+}
+#endif
+
+// out[i] = 1 if dictionary entry codes[i] passes the filter, else 0: the same contract as the filter's Lookup on the
+// decoded rows. Every code must be below result.NumEntries(). Per vector of codes, the bitmap word of each code is
+// picked with one permute of the register-resident bitmap for small dictionaries, or one gather for larger ones, and
+// shifted to the code's bit. Without AVX2, every code is tested with Passes().
+template <typename CodeType>
+size_t MapCodes(const DictionaryResult &result, size_t num, const CodeType *codes, uint32_t *out) {
+	static_assert(std::is_unsigned<CodeType>::value && sizeof(CodeType) <= 4, "codes are 8, 16 or 32-bit unsigned");
+	size_t i = 0;
+#if defined(__AVX2__)
+	const uint32_t *words = result.Words();
+	const __m256i low_bits = _mm256_set1_epi32(31);
+	const __m256i one = _mm256_set1_epi32(1);
+	if (result.NumEntries() <= DictionaryResult::PERMUTE_MAX_ENTRIES) {
+#if defined(__AVX512F__)
+		const __m512i bitmap = _mm512_loadu_si512(words);
+		for (; i + 16 <= num; i += 16) {
+			__m512i code = LoadCodes16(codes + i);
+			__m512i word = _mm512_permutexvar_epi32(_mm512_srli_epi32(code, 5), bitmap);
+			__m512i bit = _mm512_srlv_epi32(word, _mm512_and_si512(code, _mm512_set1_epi32(31)));
+			_mm512_storeu_si512(out + i, _mm512_and_si512(bit, _mm512_set1_epi32(1)));
+		}
+#else
+		const __m256i bitmap = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words));
+		for (; i + 8 <= num; i += 8) {
+			__m256i code = LoadCodes8(codes + i);
+			__m256i word = _mm256_permutevar8x32_epi32(bitmap, _mm256_srli_epi32(code, 5));
+			__m256i bit = _mm256_srlv_epi32(word, _mm256_and_si256(code, low_bits));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(bit, one));
+		}
+#endif
+	} else {
+		for (; i + 8 <= num; i += 8) {
+			__m256i code = LoadCodes8(codes + i);
+			__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int *>(words), _mm256_srli_epi32(code, 5), 4);
+			__m256i bit = _mm256_srlv_epi32(word, _mm256_and_si256(code, low_bits));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(bit, one));
+		}
+	}
+#endif
+	for (; i < num; i++) {
+		out[i] = result.Passes(codes[i]);
+	}
+	return num;
+}
+
+// Selection-vector form of MapCodes: writes the rows of sel[0, num) whose code passes to sel_out (which may be sel
+// itself) and returns their number.
+template <typename CodeType>
+size_t MapCodes(const DictionaryResult &result, size_t num, const CodeType *codes, const uint32_t *sel,
+                uint32_t *sel_out) {
+	static_assert(std::is_unsigned<CodeType>::value && sizeof(CodeType) <= 4, "codes are 8, 16 or 32-bit unsigned");
+	size_t found = 0;
+	for (size_t i = 0; i < num; i++) {
+		// branch-free: always write, only advance on a hit
+		uint32_t row = sel[i];
+		sel_out[found] = row;
+		found += result.Passes(codes[row]);
+	}
+	return found;
+}
+
+// Run-end encoded codes (the layout of Arrow's run-end encoded arrays): run r covers rows [run_ends[r - 1],
+// run_ends[r]) (run 0 starts at row 0), all with code run_codes[r]. Fills out[0, run_ends[num_runs - 1]) with one
+// bit test per run, and returns the number of rows. With AVX2, a run is written with 8-row stores that may spill
+// into the rows of the next runs, which overwrite them, so short runs cost one or two stores and no loop over a
+// remainder.
+template <typename CodeType>
+size_t MapRunEndCodes(const DictionaryResult &result, size_t num_runs, const CodeType *run_codes,
+                      const uint32_t *run_ends, uint32_t *out) {
+	static_assert(std::is_unsigned<CodeType>::value && sizeof(CodeType) <= 4, "codes are 8, 16 or 32-bit unsigned");
+	if (num_runs == 0) {
+		return 0;
+	}
+	const uint32_t num_rows = run_ends[num_runs - 1];
+	uint32_t start = 0;
+	for (size_t r = 0; r < num_runs; r++) {
+		const uint32_t end = run_ends[r];
+		const uint32_t pass = result.Passes(run_codes[r]);
+#if defined(__AVX2__)
+		if (end + 8 <= num_rows) {
+			const __m256i value = _mm256_set1_epi32(static_cast<int>(pass));
+			for (uint32_t row = start; row < end; row += 8) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + row), value);
+			}
+		} else {
+			std::fill(out + start, out + end, pass);
+		}
+#else
+		std::fill(out + start, out + end, pass);
+#endif
+		start = end;
+	}
+	return num_rows;
+}
+
+// Selection-vector form of MapRunEndCodes: writes the rows of every run whose code passes, in order, to sel_out
+// (room for all rows) and returns their number. Runs that fail are skipped without touching their rows.
+template <typename CodeType>
+size_t SelectRunEndCodes(const DictionaryResult &result, size_t num_runs, const CodeType *run_codes,
+                         const uint32_t *run_ends, uint32_t *sel_out) {
+	static_assert(std::is_unsigned<CodeType>::value && sizeof(CodeType) <= 4, "codes are 8, 16 or 32-bit unsigned");
+	size_t found = 0;
+	uint32_t start = 0;
+	for (size_t r = 0; r < num_runs; r++) {
+		if (result.Passes(run_codes[r])) {
+			for (uint32_t row = start; row < run_ends[r]; row++) {
+				sel_out[found++] = row;
+			}
+		}
+		start = run_ends[r];
+	}
+	return found;
+}
+} // namespace bloom_filters
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "base.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace bloom_filters {
+// Encoding of a filter's blocks on the wire.
+enum class WireFormat : uint8_t {
+	// The smallest of the formats below, estimated from the fill of the filter. RICE decodes an order of magnitude
+	// slower than the others; force RAW when the network is faster than that.
+	AUTO,
+	// The blocks as they are. Smallest for filters at their design load (about half the bits set).
+	RAW,
+	// A bitmap with one bit per 64-bit word, followed by the non-zero words. For filters with few keys for their size,
+	// whose set bits share words with no other set bit.
+	SPARSE,
+	// The gaps between set bits, Golomb-Rice coded: gap >> r in unary (zeros ended by a one), then the low r bits.
+	// Within a few percent of the entropy of a filter whose bits are set independently, smallest for fills between
+	// about 0.5% and 25%.
+	RICE,
+};
+
+// Header of an encoded filter; all fields are in host byte order.
+struct WireHeader {
+	static constexpr uint32_t MAGIC = 0x31574642; // "BFW1"
+	uint32_t magic = MAGIC;
+	WireFormat format = WireFormat::RAW;
+	// Rice parameter r of WireFormat::RICE.
+	uint8_t rice_bits = 0;
+	uint16_t reserved = 0;
+	// Size of the filter's blocks.
+	uint64_t payload_bytes = 0;
+	// Number of set bits.
+	uint64_t num_ones = 0;
+};
+
+// Bytes of zero padding behind the SPARSE and RICE payloads, so the decoders can always load a whole word.
+static constexpr size_t WIRE_PADDING = 8;
+
+// Sizes of the encodings of a filter, in bytes without the header, and the Rice parameter they assume.
+struct WireSizes {
+	size_t raw = 0;
+	size_t sparse = 0;
+	size_t rice = 0;
+	uint8_t rice_bits = 0;
+	uint64_t num_ones = 0;
+};
+
+// Bitmap of SPARSE: one bit per word, stored in whole 64-bit words.
+inline size_t SparseBitmapBytes(size_t num_words) {
+	return (num_words + 63) / 64 * 8;
+}
+
+// Counts the set bits and non-zero words of the blocks. The Rice size is an upper bound: the unary parts of all gaps
+// add up to at most (bits - ones) >> r.
+inline WireSizes EstimateWireSizes(const uint64_t *words, size_t num_words) {
+	WireSizes sizes;
+	size_t non_zero = 0;
+	for (size_t i = 0; i < num_words; i++) {
+		sizes.num_ones += __builtin_popcountll(words[i]);
+		non_zero += words[i] != 0;
+	}
+	sizes.raw = num_words * 8;
+	sizes.sparse = SparseBitmapBytes(num_words) + non_zero * 8 + WIRE_PADDING;
+	uint64_t num_bits = num_words * 64;
+	uint64_t best_bits = UINT64_MAX;
+	for (uint8_t r = 0; r < 48; r++) {
+		uint64_t bits = sizes.num_ones * (r + 1) + ((num_bits - sizes.num_ones) >> r);
+		if (bits < best_bits) {
+			best_bits = bits;
+			sizes.rice_bits = r;
+		}
+	}
+	sizes.rice = (best_bits + 63) / 64 * 8 + WIRE_PADDING;
+	return sizes;
+}
+
+// Appends bits to a little-endian bit stream, least significant bit first.
+class WireBitWriter {
+public:
+	explicit WireBitWriter(std::vector<uint8_t> &out) : out_(out) {
+	}
+
+	// Writes the low num (< 64) bits of value.
+	inline void Put(uint64_t value, uint32_t num) {
+		buffer_ |= value << fill_;
+		if (fill_ + num >= 64) {
+			Flush(buffer_);
+			buffer_ = fill_ == 0 ? 0 : value >> (64 - fill_);
+			fill_ = fill_ + num - 64;
+		} else {
+			fill_ += num;
+		}
+	}
+	inline void PutZeros(uint64_t num) {
+		for (; num >= 63; num -= 63) {
+			Put(0, 63);
+		}
+		Put(0, static_cast<uint32_t>(num));
+	}
+	inline void Finish() {
+		if (fill_ > 0) {
+			Flush(buffer_);
+		}
+		buffer_ = 0;
+		fill_ = 0;
+	}
+
+private:
+	inline void Flush(uint64_t word) {
+		size_t pos = out_.size();
+		out_.resize(pos + 8);
+		std::memcpy(out_.data() + pos, &word, 8);
+	}
+
+	std::vector<uint8_t> &out_;
+	uint64_t buffer_ = 0;
+	uint32_t fill_ = 0;
+};
+
+// Encodes bytes (a multiple of 8) of filter blocks: a WireHeader, then the payload in the given format.
+inline std::vector<uint8_t> EncodeBlocks(const void *blocks, size_t bytes, WireFormat format = WireFormat::AUTO) {
+	if (bytes % 8 != 0) {
+		throw std::invalid_argument("EncodeBlocks: the blocks must be a multiple of 8 bytes");
+	}
+	const uint64_t *words = static_cast<const uint64_t *>(blocks);
+	const size_t num_words = bytes / 8;
+	WireSizes sizes = EstimateWireSizes(words, num_words);
+	if (format == WireFormat::AUTO) {
+		// ties go to the format that decodes faster
+		format = WireFormat::RAW;
+		size_t best = sizes.raw;
+		if (sizes.sparse < best) {
+			format = WireFormat::SPARSE;
+			best = sizes.sparse;
+		}
+		if (sizes.rice < best) {
+			format = WireFormat::RICE;
+		}
+	}
+
+	WireHeader header;
+	header.format = format;
+	header.rice_bits = format == WireFormat::RICE ? sizes.rice_bits : 0;
+	header.payload_bytes = bytes;
+	header.num_ones = sizes.num_ones;
+	std::vector<uint8_t> out(sizeof(WireHeader));
+	out.reserve(sizeof(WireHeader) + (format == WireFormat::RAW      ? sizes.raw
+	                                  : format == WireFormat::SPARSE ? sizes.sparse
+	                                                                 : sizes.rice));
+	std::memcpy(out.data(), &header, sizeof(WireHeader));
+
+	switch (format) {
+	case WireFormat::SPARSE: {
+		size_t bitmap_pos = out.size();
+		out.resize(bitmap_pos + SparseBitmapBytes(num_words));
+		uint8_t *bitmap = out.data() + bitmap_pos;
+		size_t non_zero = 0;
+		for (size_t i = 0; i < num_words; i++) {
+			if (words[i] != 0) {
+				bitmap[i / 8] |= static_cast<uint8_t>(1U << (i % 8));
+				non_zero++;
+			}
+		}
+		size_t pos = out.size();
+		out.resize(pos + non_zero * 8 + WIRE_PADDING);
+		uint8_t *dst = out.data() + pos;
+		for (size_t i = 0; i < num_words; i++) {
+			if (words[i] != 0) {
+				std::memcpy(dst, words + i, 8);
+				dst += 8;
+			}
+		}
+		break;
+	}
+	case WireFormat::RICE: {
+		const uint32_t r = header.rice_bits;
+		WireBitWriter writer(out);
+		uint64_t next = 0; // first position the next gap counts from
+		for (size_t i = 0; i < num_words; i++) {
+			for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+				uint64_t pos = i * 64 + __builtin_ctzll(word);
+				uint64_t gap = pos - next;
+				writer.PutZeros(gap >> r);
+				writer.Put(1, 1);
+				if (r > 0) {
+					writer.Put(gap & ((1ULL << r) - 1), r);
+				}
+				next = pos + 1;
+			}
+		}
+		writer.Finish();
+		out.resize(out.size() + WIRE_PADDING);
+		break;
+	}
+	default: {
+		size_t pos = out.size();
+		out.resize(pos + bytes);
+		std::memcpy(out.data() + pos, blocks, bytes);
+		break;
+	}
+	}
+	return out;
+}
+
+// Reads and checks the header of an encoded filter; throws std::invalid_argument if it is not one.
+inline WireHeader ReadWireHeader(const uint8_t *data, size_t size) {
+	WireHeader header;
+	if (size < sizeof(WireHeader)) {
+		throw std::invalid_argument("ReadWireHeader: truncated header");
+	}
+	std::memcpy(&header, data, sizeof(WireHeader));
+	if (header.magic != WireHeader::MAGIC || header.format == WireFormat::AUTO ||
+	    header.format > WireFormat::RICE || header.payload_bytes % 8 != 0) {
+		throw std::invalid_argument("ReadWireHeader: not an encoded filter");
+	}
+	return header;
+}
+
+#if defined(__AVX2__) && !defined(__AVX512F__)
+// AVX2 has no expand-load. Per 4-bit group of the SPARSE bitmap, a permute of 32-bit lanes moves the group's present
+// words, loaded packed, to their lanes; absent lanes take lane 3, which the masked load leaves zero unless all four
+// words are present.
+struct SparseExpandTable {
+	alignas(32) int32_t index[16][8];
+
+	constexpr SparseExpandTable() : index() {
+		for (int group = 0; group < 16; group++) {
+			int next = 0;
+			for (int lane = 0; lane < 4; lane++) {
+				int from = (group >> lane) & 1 ? next++ : 3;
+				index[group][2 * lane] = 2 * from;
+				index[group][2 * lane + 1] = 2 * from + 1;
+			}
+		}
+	}
+};
+static constexpr SparseExpandTable SPARSE_EXPAND_TABLE;
+// The load mask of the first n words is the 4 words at SPARSE_LOAD_MASK + 4 - n.
+alignas(64) static constexpr int64_t SPARSE_LOAD_MASK[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+#endif
+
+// Expands the non-zero words of SPARSE into words[0, num_words). Every word is written, so the destination need not be
+// zeroed. src must be readable 8 bytes past its last word.
+inline void DecodeSparse(const uint8_t *BF_RESTRICT bitmap, const uint8_t *BF_RESTRICT src, uint64_t *BF_RESTRICT words,
+                         size_t num_words) {
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 8 <= num_words; i += 8) {
+		__mmask8 present = bitmap[i / 8];
+		_mm512_storeu_si512(words + i, _mm512_maskz_expandloadu_epi64(present, src));
+		src += 8 * __builtin_popcount(present);
+	}
+#elif defined(__AVX2__)
+	for (; i + 4 <= num_words; i += 4) {
+		const uint32_t group = (bitmap[i / 8] >> (i % 8)) & 0xF;
+		const int count = __builtin_popcount(group);
+		// masked, so it never reads past the group's words
+		const __m256i load_mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(SPARSE_LOAD_MASK + 4 - count));
+		const __m256i packed = _mm256_maskload_epi64(reinterpret_cast<const long long *>(src), load_mask);
+		const __m256i index = _mm256_load_si256(reinterpret_cast<const __m256i *>(SPARSE_EXPAND_TABLE.index[group]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(words + i), _mm256_permutevar8x32_epi32(packed, index));
+		src += 8 * count;
+	}
+#endif
+	// branch-free: always load the next word, keep it and advance only if it is present
+	for (; i < num_words; i++) {
+		uint64_t present = (bitmap[i / 8] >> (i % 8)) & 1;
+		uint64_t word;
+		std::memcpy(&word, src, 8);
+		words[i] = word & (0 - present);
+		src += 8 * present;
+	}
+}
+
+// Sets the num_ones bits of a RICE stream of stream_bytes (plus WIRE_PADDING) in words[0, num_words), which must be
+// zeroed. Each load yields a window of at least 57 bits, from which as many whole codes are decoded as fit, a count of
+// trailing zeros for the unary part and a shift for the remainder each, so the loop-carried dependency is the shift of
+// the window rather than a load. Throws std::invalid_argument if the stream runs out or a bit falls outside the words.
+inline void DecodeRice(const uint8_t *BF_RESTRICT stream, size_t stream_bytes, uint64_t num_ones, uint32_t r,
+                       uint64_t *BF_RESTRICT words, size_t num_words) {
+	const uint64_t low_mask = (1ULL << r) - 1;
+	const uint64_t end_bit = stream_bytes * 8;
+	const uint64_t num_bits = num_words * 64;
+	uint64_t bit = 0;      // read position in the stream
+	uint64_t next = 0;     // position the next gap counts from
+	uint64_t quotient = 0; // unary part of the current code read so far
+	uint64_t n = 0;
+	while (n < num_ones) {
+		if (bit >= end_bit) {
+			throw std::invalid_argument("DecodeRice: truncated stream");
+		}
+		uint64_t window;
+		std::memcpy(&window, stream + (bit >> 3), 8);
+		window >>= bit & 7;
+		const uint32_t valid = 64 - static_cast<uint32_t>(bit & 7);
+		uint32_t used = 0;
+		while (n < num_ones) {
+			if (window == 0) {
+				// the rest of the window is part of a unary run
+				quotient += valid - used;
+				used = valid;
+				break;
+			}
+			uint32_t zeros = __builtin_ctzll(window);
+			uint32_t length = zeros + 1 + r;
+			if (used + length > valid) {
+				// the code continues in the next window; keep its zeros
+				quotient += zeros;
+				used += zeros;
+				break;
+			}
+			uint64_t rest = (window >> zeros) >> 1;
+			uint64_t pos = next + (((quotient + zeros) << r) | (rest & low_mask));
+			if (pos >= num_bits) {
+				throw std::invalid_argument("DecodeRice: malformed stream");
+			}
+			words[pos >> 6] |= 1ULL << (pos & 63);
+			next = pos + 1;
+			quotient = 0;
+			window = rest >> r;
+			used += length;
+			n++;
+		}
+		bit += used;
+	}
+	if (bit > end_bit) {
+		throw std::invalid_argument("DecodeRice: truncated stream");
+	}
+}
+
+// Decodes an encoded filter into bytes of filter blocks; throws std::invalid_argument if the encoding is malformed or
+// was made from blocks of another size. For a filter built from a FilterMemoryPool this writes straight into pooled
+// memory.
+inline void DecodeBlocks(const uint8_t *data, size_t size, void *blocks, size_t bytes) {
+	WireHeader header = ReadWireHeader(data, size);
+	if (header.payload_bytes != bytes) {
+		throw std::invalid_argument("DecodeBlocks: the filter was encoded with another size");
+	}
+	const uint8_t *payload = data + sizeof(WireHeader);
+	const size_t payload_size = size - sizeof(WireHeader);
+	const size_t num_words = bytes / 8;
+	uint64_t *words = static_cast<uint64_t *>(blocks);
+	switch (header.format) {
+	case WireFormat::SPARSE: {
+		const size_t bitmap_bytes = SparseBitmapBytes(num_words);
+		if (payload_size < bitmap_bytes + WIRE_PADDING) {
+			throw std::invalid_argument("DecodeBlocks: truncated payload");
+		}
+		size_t non_zero = 0;
+		for (size_t i = 0; i < bitmap_bytes; i++) {
+			non_zero += __builtin_popcount(payload[i]);
+		}
+		if (payload_size < bitmap_bytes + non_zero * 8 + WIRE_PADDING) {
+			throw std::invalid_argument("DecodeBlocks: truncated payload");
+		}
+		DecodeSparse(payload, payload + bitmap_bytes, words, num_words);
+		break;
+	}
+	case WireFormat::RICE: {
+		// at least one bit per set bit, and no gap may leave the blocks
+		if (header.rice_bits >= 57 || header.num_ones > num_words * 64 ||
+		    payload_size < (header.num_ones + 63) / 64 * 8 + WIRE_PADDING) {
+			throw std::invalid_argument("DecodeBlocks: malformed payload");
+		}
+		std::memset(blocks, 0, bytes);
+		DecodeRice(payload, payload_size - WIRE_PADDING, header.num_ones, header.rice_bits, words, num_words);
+		break;
+	}
+	default:
+		if (payload_size < bytes) {
+			throw std::invalid_argument("DecodeBlocks: truncated payload");
+		}
+		std::memcpy(blocks, payload, bytes);
+		break;
+	}
+}
+
+// Encodes the blocks of any filter in this repository (see WireFormat).
+template <typename Filter>
+std::vector<uint8_t> EncodeFilter(const Filter &bf, WireFormat format = WireFormat::AUTO) {
+	const auto &blocks = bf.Blocks();
+	return EncodeBlocks(blocks.data(), blocks.size() * sizeof(blocks[0]), format);
+}
+
+// Decodes into a filter constructed with the same number of keys and bits per key as the encoded one, e.g. with
+// StorageOptions::pool set so that a probe node's filters come from its pool.
+template <typename Filter>
+void DecodeFilter(const uint8_t *data, size_t size, Filter &bf) {
+	auto &blocks = bf.Blocks();
+	DecodeBlocks(data, size, blocks.data(), blocks.size() * sizeof(blocks[0]));
+}
+} // namespace bloom_filters
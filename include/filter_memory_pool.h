@@ -0,0 +1,323 @@
+#pragma once
+
+#include "base.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace bloom_filters {
+// When the pool zeroes recycled memory.
+enum class PoolZeroing : uint8_t {
+	// The thread that acquires a recycled chunk zeroes the bytes it asks for (and only those the previous owner used).
+	ON_ACQUIRE,
+	// A background thread zeroes released chunks, so acquiring a chunk that is already clean costs a list pop. A chunk
+	// that is still dirty when it is needed is zeroed on acquire.
+	BACKGROUND,
+};
+
+struct PoolOptions {
+	PoolZeroing zeroing = PoolZeroing::ON_ACQUIRE;
+	// Cap on the memory the pool holds, in use and cached, 0 for no cap. Acquire evicts cached chunks to stay under the
+	// cap and throws std::bad_alloc when the chunks in use alone would exceed it.
+	size_t max_bytes = 0;
+	// Chunks of at least this size are mmapped with transparent huge pages, smaller ones come from the heap.
+	size_t mmap_min_bytes = 2 << 20;
+};
+
+struct PoolCounters {
+	size_t num_acquires = 0;
+	// Acquires served from a cached chunk, and how many of those found the chunk already zeroed.
+	size_t num_hits = 0;
+	size_t num_clean_hits = 0;
+	size_t num_evictions = 0;
+	size_t bytes_zeroed_on_acquire = 0;
+	size_t bytes_zeroed_in_background = 0;
+	size_t bytes_in_use = 0;
+	size_t bytes_cached = 0;
+};
+
+// Memory handed out by FilterMemoryPool. Only the pool reads the fields.
+struct PoolChunk {
+	void *data = nullptr;
+	size_t bytes = 0;
+	// Prefix that may be non-zero: written by the previous owner and not zeroed since.
+	size_t dirty_bytes = 0;
+	uint8_t size_class = 0;
+	bool mapped = false;
+};
+
+// Size-class pool for the block arrays of short-lived filters (one per query or join), passed to the filters through
+// StorageOptions::pool. Chunks are powers of two from MIN_CHUNK_BYTES on and are recycled instead of going back to the
+// allocator, so a new filter costs a list pop and zeroing the bytes it will use instead of an allocation, page faults
+// and a full zero-fill. Thread-safe; the pool must outlive every filter that takes storage from it.
+class FilterMemoryPool {
+public:
+	static constexpr size_t MIN_CHUNK_BYTES = 4 << 10;
+	static constexpr uint32_t NUM_SIZE_CLASSES = 40;
+	static constexpr size_t ALIGNMENT = 64;
+
+public:
+	explicit FilterMemoryPool(const PoolOptions &options = PoolOptions()) : options_(options) {
+		if (options_.zeroing == PoolZeroing::BACKGROUND) {
+			zeroer_ = std::thread([this] { ZeroInBackground(); });
+		}
+	}
+	FilterMemoryPool(const FilterMemoryPool &) = delete;
+	FilterMemoryPool &operator=(const FilterMemoryPool &) = delete;
+	~FilterMemoryPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			stop_ = true;
+		}
+		dirty_cv_.notify_all();
+		if (zeroer_.joinable()) {
+			zeroer_.join();
+		}
+		for (auto &list : clean_) {
+			for (auto &chunk : list) {
+				Free(chunk);
+			}
+		}
+		for (auto &chunk : dirty_) {
+			Free(chunk);
+		}
+	}
+
+	// Returns a 64-byte aligned chunk whose first bytes bytes are zero.
+	PoolChunk Acquire(size_t bytes) {
+		uint8_t size_class = SizeClass(bytes);
+		PoolChunk chunk;
+		bool found = false;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			counters_.num_acquires++;
+			found = TakeCached(size_class, chunk);
+			if (found) {
+				counters_.num_hits++;
+				counters_.num_clean_hits += chunk.dirty_bytes == 0;
+				counters_.bytes_cached -= chunk.bytes;
+			} else {
+				size_t chunk_bytes = ClassBytes(size_class);
+				EvictFor(chunk_bytes);
+				if (options_.max_bytes > 0 && counters_.bytes_in_use + chunk_bytes > options_.max_bytes) {
+					throw std::bad_alloc();
+				}
+			}
+			// reserve before allocating, so concurrent misses cannot overshoot the cap together
+			counters_.bytes_in_use += ClassBytes(size_class);
+		}
+		if (!found) {
+			try {
+				chunk = Allocate(size_class);
+			} catch (...) {
+				std::lock_guard<std::mutex> guard(lock_);
+				counters_.bytes_in_use -= ClassBytes(size_class);
+				throw;
+			}
+			return chunk;
+		}
+		size_t zero = std::min(chunk.dirty_bytes, bytes);
+		if (zero > 0) {
+			std::memset(chunk.data, 0, zero);
+			std::lock_guard<std::mutex> guard(lock_);
+			counters_.bytes_zeroed_on_acquire += zero;
+		}
+		// bytes past the request stay dirty, the next owner zeroes them if it needs them
+		if (zero == chunk.dirty_bytes) {
+			chunk.dirty_bytes = 0;
+		}
+		return chunk;
+	}
+
+	// Returns a chunk to the pool; used_bytes is the prefix the owner may have written.
+	void Release(PoolChunk chunk, size_t used_bytes) {
+		chunk.dirty_bytes = std::min(chunk.bytes, std::max(chunk.dirty_bytes, used_bytes));
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			counters_.bytes_in_use -= chunk.bytes;
+			counters_.bytes_cached += chunk.bytes;
+			if (chunk.dirty_bytes > 0 && options_.zeroing == PoolZeroing::BACKGROUND) {
+				dirty_.push_back(chunk);
+			} else {
+				clean_[chunk.size_class].push_back(chunk);
+			}
+		}
+		if (chunk.dirty_bytes > 0 && options_.zeroing == PoolZeroing::BACKGROUND) {
+			dirty_cv_.notify_one();
+		}
+	}
+
+	// Frees every cached chunk.
+	void Trim() {
+		std::vector<PoolChunk> evicted;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			for (auto &list : clean_) {
+				evicted.insert(evicted.end(), list.begin(), list.end());
+				list.clear();
+			}
+			evicted.insert(evicted.end(), dirty_.begin(), dirty_.end());
+			dirty_.clear();
+			counters_.bytes_cached -= TotalBytes(evicted);
+			counters_.num_evictions += evicted.size();
+		}
+		for (auto &chunk : evicted) {
+			Free(chunk);
+		}
+	}
+
+	PoolCounters Counters() const {
+		std::lock_guard<std::mutex> guard(lock_);
+		return counters_;
+	}
+
+	static size_t ClassBytes(uint8_t size_class) {
+		return MIN_CHUNK_BYTES << size_class;
+	}
+
+private:
+	static uint8_t SizeClass(size_t bytes) {
+		uint8_t size_class = 0;
+		while (ClassBytes(size_class) < bytes) {
+			size_class++;
+		}
+		if (size_class >= NUM_SIZE_CLASSES) {
+			throw std::bad_alloc();
+		}
+		return size_class;
+	}
+
+	static size_t TotalBytes(const std::vector<PoolChunk> &chunks) {
+		size_t total = 0;
+		for (auto &chunk : chunks) {
+			total += chunk.bytes;
+		}
+		return total;
+	}
+
+	// Pops a cached chunk of the class, preferring one that is already zeroed. Caller holds lock_.
+	bool TakeCached(uint8_t size_class, PoolChunk &chunk) {
+		auto &list = clean_[size_class];
+		if (!list.empty()) {
+			chunk = list.back();
+			list.pop_back();
+			return true;
+		}
+		for (size_t i = 0; i < dirty_.size(); i++) {
+			if (dirty_[i].size_class == size_class) {
+				chunk = dirty_[i];
+				dirty_[i] = dirty_.back();
+				dirty_.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Frees cached chunks, largest first, until bytes more fit under the cap. Caller holds lock_.
+	void EvictFor(size_t bytes) {
+		if (options_.max_bytes == 0) {
+			return;
+		}
+		bytes += zeroing_bytes_;
+		for (int c = NUM_SIZE_CLASSES - 1; c >= 0; c--) {
+			auto &list = clean_[c];
+			while (!list.empty() && counters_.bytes_in_use + counters_.bytes_cached + bytes > options_.max_bytes) {
+				Evict(list.back());
+				list.pop_back();
+			}
+		}
+		while (!dirty_.empty() && counters_.bytes_in_use + counters_.bytes_cached + bytes > options_.max_bytes) {
+			Evict(dirty_.back());
+			dirty_.pop_back();
+		}
+	}
+
+	void Evict(const PoolChunk &chunk) {
+		counters_.bytes_cached -= chunk.bytes;
+		counters_.num_evictions++;
+		Free(chunk);
+	}
+
+	PoolChunk Allocate(uint8_t size_class) {
+		PoolChunk chunk;
+		chunk.size_class = size_class;
+		chunk.bytes = ClassBytes(size_class);
+#if defined(__unix__) || defined(__APPLE__)
+		if (chunk.bytes >= options_.mmap_min_bytes) {
+			void *mem = mmap(nullptr, chunk.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+#ifdef MADV_HUGEPAGE
+			madvise(mem, chunk.bytes, MADV_HUGEPAGE);
+#endif
+			chunk.data = mem;
+			chunk.mapped = true;
+			return chunk;
+		}
+#endif
+		chunk.data = ::operator new(chunk.bytes, std::align_val_t(ALIGNMENT));
+		std::memset(chunk.data, 0, chunk.bytes);
+		return chunk;
+	}
+
+	static void Free(const PoolChunk &chunk) {
+#if defined(__unix__) || defined(__APPLE__)
+		if (chunk.mapped) {
+			munmap(chunk.data, chunk.bytes);
+			return;
+		}
+#endif
+		::operator delete(chunk.data, std::align_val_t(ALIGNMENT));
+	}
+
+	// Background zeroing thread: takes dirty chunks off dirty_, zeroes them unlocked and files them as clean. A chunk
+	// being zeroed is in neither list, so Acquire allocates a new one rather than waiting for it.
+	void ZeroInBackground() {
+		std::unique_lock<std::mutex> guard(lock_);
+		while (true) {
+			dirty_cv_.wait(guard, [this] { return stop_ || !dirty_.empty(); });
+			if (stop_) {
+				return;
+			}
+			PoolChunk chunk = dirty_.back();
+			dirty_.pop_back();
+			counters_.bytes_cached -= chunk.bytes;
+			zeroing_bytes_ += chunk.bytes;
+			guard.unlock();
+			std::memset(chunk.data, 0, chunk.dirty_bytes);
+			guard.lock();
+			counters_.bytes_zeroed_in_background += chunk.dirty_bytes;
+			chunk.dirty_bytes = 0;
+			zeroing_bytes_ -= chunk.bytes;
+			counters_.bytes_cached += chunk.bytes;
+			clean_[chunk.size_class].push_back(chunk);
+		}
+	}
+
+	PoolOptions options_;
+	mutable std::mutex lock_;
+	std::condition_variable dirty_cv_;
+	std::thread zeroer_;
+	bool stop_ = false;
+	// Cached chunks with dirty_bytes == 0 (any dirty_bytes in ON_ACQUIRE mode), by size class.
+	std::vector<PoolChunk> clean_[NUM_SIZE_CLASSES];
+	// Released chunks waiting for the background thread.
+	std::vector<PoolChunk> dirty_;
+	// Bytes held by the background thread while it zeroes them, not counted as cached.
+	size_t zeroing_bytes_ = 0;
+	PoolCounters counters_;
+};
+} // namespace bloom_filters
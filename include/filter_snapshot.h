@@ -0,0 +1,210 @@
+#pragma once
+
+#include "base.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bloom_filters {
+// Holder of the current version of a long-lived filter that is probed by many threads and rebuilt from time to time.
+// A writer builds the next filter off to the side and publishes it with one pointer swap; readers never lock and never
+// execute an atomic read-modify-write. Old versions are reclaimed epoch by epoch: every registered reader has its own
+// cache line where it announces the epoch it entered a read section in, and a retired filter is destroyed once no
+// reader is still inside a section that started before the swap.
+//
+// Readers probe through a Reader handle, one per thread. The filter's Lookup must not write the filter: the
+// cache-sectorized filters must keep a fixed probe kernel (the default), since ProbeKernel::AUTO keeps a pass rate
+// estimate in the filter.
+template <typename Filter>
+class FilterSnapshot {
+public:
+	static constexpr uint32_t DEFAULT_MAX_READERS = 256;
+
+private:
+	// One cache line per reader, so readers never write a line another thread reads on its hot path.
+	struct alignas(64) ReaderSlot {
+		// Epoch the reader entered its current read section in, 0 outside of read sections.
+		std::atomic<uint64_t> epoch {0};
+		std::atomic<bool> in_use {false};
+	};
+
+public:
+	// Read section: the filter it points to stays alive until the guard is destroyed. Read sections of one reader
+	// must not nest.
+	class ReadGuard {
+	public:
+		ReadGuard(const ReadGuard &) = delete;
+		ReadGuard &operator=(const ReadGuard &) = delete;
+		~ReadGuard() {
+			slot_->epoch.store(0, std::memory_order_release);
+		}
+		inline Filter *operator->() const {
+			return filter_;
+		}
+		inline Filter *Get() const {
+			return filter_;
+		}
+
+	private:
+		friend class FilterSnapshot;
+		ReadGuard(const FilterSnapshot &snapshot, ReaderSlot *slot) : slot_(slot) {
+			// Acquire pairs with the epoch_.fetch_add in Publish: a reader that sees the new epoch also sees the
+			// exchange of current_ before it, so it never announces the new epoch and then reads the retired filter.
+			slot_->epoch.store(snapshot.epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+			// The announcement must be visible before the filter pointer is read: either the writer's scan sees this
+			// reader, or this load sees the writer's swap. A fence, not a read-modify-write, and one per read section.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			filter_ = snapshot.current_.load(std::memory_order_acquire);
+		}
+
+		ReaderSlot *slot_;
+		Filter *filter_;
+	};
+
+	// A registered reader, to be used by one thread at a time.
+	class Reader {
+	public:
+		Reader(Reader &&other) noexcept : snapshot_(other.snapshot_), slot_(other.slot_) {
+			other.slot_ = nullptr;
+		}
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+		Reader &operator=(Reader &&) = delete;
+		~Reader() {
+			if (slot_ != nullptr) {
+				slot_->in_use.store(false, std::memory_order_release);
+			}
+		}
+
+		// Starts a read section on the current filter, which may be nullptr before the first Publish.
+		inline ReadGuard Pin() const {
+			return ReadGuard(*snapshot_, slot_);
+		}
+
+		// Probes the current filter; a batch is probed entirely by one version. Without a filter every key passes.
+		template <typename HashType>
+		inline uint32_t Lookup(uint32_t num, HashType *key, uint32_t *out) const {
+			ReadGuard guard = Pin();
+			if (guard.Get() == nullptr) {
+				std::fill(out, out + num, 1U);
+				return num;
+			}
+			return guard->Lookup(num, key, out);
+		}
+		template <typename HashType>
+		inline uint32_t Lookup(uint32_t num, HashType *key, const uint32_t *sel, uint32_t *sel_out) const {
+			ReadGuard guard = Pin();
+			if (guard.Get() == nullptr) {
+				std::copy(sel, sel + num, sel_out);
+				return num;
+			}
+			return guard->Lookup(num, key, sel, sel_out);
+		}
+
+	private:
+		friend class FilterSnapshot;
+		Reader(const FilterSnapshot *snapshot, ReaderSlot *slot) : snapshot_(snapshot), slot_(slot) {
+		}
+
+		const FilterSnapshot *snapshot_;
+		ReaderSlot *slot_;
+	};
+
+public:
+	explicit FilterSnapshot(std::unique_ptr<Filter> initial = nullptr, uint32_t max_readers = DEFAULT_MAX_READERS)
+	    : current_(initial.release()), num_slots_(max_readers), slots_(new ReaderSlot[max_readers]) {
+	}
+	FilterSnapshot(const FilterSnapshot &) = delete;
+	FilterSnapshot &operator=(const FilterSnapshot &) = delete;
+	// Every Reader must be gone.
+	~FilterSnapshot() {
+		delete current_.load(std::memory_order_relaxed);
+	}
+
+	// Claims a reader slot; throws std::length_error when all max_readers slots are taken.
+	Reader RegisterReader() const {
+		for (uint32_t i = 0; i < num_slots_; i++) {
+			bool expected = false;
+			if (!slots_[i].in_use.load(std::memory_order_relaxed) &&
+			    slots_[i].in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+				return Reader(this, &slots_[i]);
+			}
+		}
+		throw std::length_error("FilterSnapshot: all reader slots are taken");
+	}
+
+	// Makes next the filter new read sections see, retires the previous one and destroys the retired filters that no
+	// reader can still see. Publishing writers are serialized.
+	void Publish(std::unique_ptr<Filter> next) {
+		std::lock_guard<std::mutex> guard(writer_lock_);
+		Filter *previous = current_.exchange(next.release(), std::memory_order_seq_cst);
+		// Read sections that start from here on announce at least retire_epoch and see the new filter.
+		uint64_t retire_epoch = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+		if (previous != nullptr) {
+			retired_.emplace_back(retire_epoch, std::unique_ptr<Filter>(previous));
+		}
+		ReclaimLocked();
+	}
+
+	// Destroys the retired filters no reader can still see and returns the number that are left.
+	size_t Reclaim() {
+		std::lock_guard<std::mutex> guard(writer_lock_);
+		return ReclaimLocked();
+	}
+
+	// Waits until every retired filter is destroyed, i.e. until every read section that started before the last
+	// Publish has ended.
+	void Synchronize() {
+		while (Reclaim() > 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Number of Publish calls so far plus one.
+	uint64_t Epoch() const {
+		return epoch_.load(std::memory_order_relaxed);
+	}
+
+private:
+	size_t ReclaimLocked() {
+		if (retired_.empty()) {
+			return 0;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// oldest epoch a reader is still reading in
+		uint64_t oldest = UINT64_MAX;
+		for (uint32_t i = 0; i < num_slots_; i++) {
+			uint64_t epoch = slots_[i].epoch.load(std::memory_order_acquire);
+			if (epoch != 0) {
+				oldest = std::min(oldest, epoch);
+			}
+		}
+		// a filter retired in epoch e is invisible to read sections that started in e or later
+		size_t kept = 0;
+		for (auto &entry : retired_) {
+			if (entry.first > oldest) {
+				retired_[kept++] = std::move(entry);
+			}
+		}
+		retired_.resize(kept);
+		return kept;
+	}
+
+	std::atomic<Filter *> current_;
+	// Starts at 1, 0 marks a reader outside of read sections.
+	std::atomic<uint64_t> epoch_ {1};
+	const uint32_t num_slots_;
+	const std::unique_ptr<ReaderSlot[]> slots_;
+
+	std::mutex writer_lock_;
+	// (retire epoch, filter) of filters that readers may still see.
+	std::vector<std::pair<uint64_t, std::unique_ptr<Filter>>> retired_;
+};
+} // namespace bloom_filters
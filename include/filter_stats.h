@@ -0,0 +1,257 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace bloom_filters {
+// How a filter places the bits of a key, as far as its statistics are concerned: the filter's words are cut into
+// sectors of sector_bits bits, sectors_per_block consecutive sectors form a block, and a key picks one block and sets
+// bits_per_sector bits (on average, drawn with replacement) in each of sectors_per_key sectors of it.
+struct FilterGeometry {
+	uint32_t sector_bits;
+	uint32_t sectors_per_block;
+	uint32_t sectors_per_key;
+	double bits_per_sector;
+
+	inline constexpr double BitsPerKey() const {
+		return bits_per_sector * sectors_per_key;
+	}
+};
+
+// State of a built filter, see ComputeFilterStats.
+struct FilterStats {
+	uint64_t num_bits = 0;
+	uint64_t num_ones = 0;
+	// num_ones / num_bits; a filter at its designed load is about half full, one near 1 is overloaded.
+	double fill_ratio = 0;
+	uint32_t sector_bits = 0;
+	// occupancy[c] is the number of sectors with c bits set, c in [0, sector_bits].
+	std::vector<uint64_t> occupancy;
+	// False-positive rate of a key that was never inserted, from the observed fill of every block.
+	double estimated_fpr = 0;
+	// Number of distinct keys inserted, from the number of bits set in every sector (linear counting).
+	double estimated_keys = 0;
+};
+
+// popcount of every sector_bits-bit (32 or 64) sector in words[0, num_bytes), written to counts. num_bytes must be a
+// multiple of sector_bits / 8.
+inline void SectorPopcounts(const uint8_t *BF_RESTRICT words, size_t num_bytes, uint32_t sector_bits,
+                            uint32_t *BF_RESTRICT counts) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	// popcount of every byte with a nibble lookup table, then summed per sector
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	                                     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+	auto byte_popcounts = [&](__m256i v) {
+		__m256i lo = _mm256_and_si256(v, low_nibble);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+		return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+	};
+	if (sector_bits == 32) {
+		const __m256i ones8 = _mm256_set1_epi8(1);
+		const __m256i ones16 = _mm256_set1_epi16(1);
+		for (; i + 32 <= num_bytes; i += 32) {
+			__m256i bytes = byte_popcounts(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i)));
+			__m256i sums = _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, ones8), ones16);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(counts + i / 4), sums);
+		}
+	} else {
+		const __m256i even_lanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+		for (; i + 32 <= num_bytes; i += 32) {
+			__m256i bytes = byte_popcounts(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i)));
+			__m256i sums = _mm256_permutevar8x32_epi32(_mm256_sad_epu8(bytes, _mm256_setzero_si256()), even_lanes);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(counts + i / 8), _mm256_castsi256_si128(sums));
+		}
+	}
+#endif
+	if (sector_bits == 32) {
+		for (; i < num_bytes; i += 4) {
+			uint32_t word;
+			std::memcpy(&word, words + i, 4);
+			counts[i / 4] = __builtin_popcount(word);
+		}
+	} else {
+		for (; i < num_bytes; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, words + i, 8);
+			counts[i / 8] = __builtin_popcountll(word);
+		}
+	}
+}
+
+// Statistics of a filter of num_bytes bytes with the given geometry, in one pass over the filter split over num_threads
+// threads (0 for std::thread::hardware_concurrency()):
+//
+// - the fill ratio and the occupancy histogram of the sectors;
+// - the false-positive rate: a key that was never inserted passes a block with probability p = (c / sector_bits)^
+//   bits_per_sector per sector it touches, c being the sector's popcount. If a key touches every sector of its block
+//   this is the product over the block's sectors, otherwise the mean over the block's sectors raised to
+//   sectors_per_key (the sectors are treated as drawn with replacement). The estimate is the mean of p over all blocks,
+//   so it accounts for the uneven load of the blocks rather than assuming the average fill everywhere;
+// - the number of distinct keys: a sector of w bits with c bits set has taken about ln(1 - c / w) / ln(1 - 1 / w)
+//   bit insertions, and every key makes BitsPerKey() of them. Full sectors count as holding w - 1/2 bits, so the
+//   estimate saturates rather than diverges on an overloaded filter.
+//
+// The filter is read once, a chunk of sectors at a time: popcounts with AVX2 (SectorPopcounts) into a buffer that stays
+// in L1, then the histogram and the per-block model from that buffer.
+inline FilterStats ComputeFilterStats(const void *data, size_t num_bytes, const FilterGeometry &geometry,
+                                      uint32_t num_threads = 1) {
+	const uint32_t w = geometry.sector_bits;
+	const size_t sector_bytes = w / 8;
+	const size_t block_bytes = sector_bytes * geometry.sectors_per_block;
+	const size_t num_blocks = num_bytes / block_bytes;
+	const bool touches_all = geometry.sectors_per_key == geometry.sectors_per_block;
+
+	// probability that a sector with c bits set passes a key's bits_per_sector bits
+	std::vector<double> pass(w + 1);
+	for (uint32_t c = 0; c <= w; c++) {
+		pass[c] = std::pow(static_cast<double>(c) / w, geometry.bits_per_sector);
+	}
+
+	// for the gathers; a block's pass probability is at least 2^-80 for the geometries here, well within float's range
+	std::vector<float> pass_float(pass.begin(), pass.end());
+	// probability that a key passes a block whose sectors pass with probability mean on average
+	auto block_pass = [&geometry](double mean) {
+		double p = 1;
+		for (uint32_t k = 0; k < geometry.sectors_per_key; k++) {
+			p *= mean;
+		}
+		return p;
+	};
+
+	if (num_threads == 0) {
+		num_threads = std::max(1U, std::thread::hardware_concurrency());
+	}
+	num_threads = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(num_threads, num_blocks)));
+	struct Partial {
+		std::vector<uint64_t> occupancy;
+		double fpr_sum = 0;
+	};
+	std::vector<Partial> partials(num_threads);
+
+	auto scan = [&](uint32_t t) {
+		constexpr size_t CHUNK_BYTES = 4096;
+		const size_t blocks_per_chunk = std::max<size_t>(1, CHUNK_BYTES / block_bytes);
+		std::vector<uint32_t> counts(blocks_per_chunk * geometry.sectors_per_block);
+		// histogram of pairs of consecutive sectors, so there is one increment per two sectors; it is folded into the
+		// occupancy histogram at the end
+		std::vector<uint64_t> pairs((w + 1) * (w + 1), 0);
+		uint64_t occupancy[65] = {};
+		double fpr_sum = 0;
+		const auto *words = static_cast<const uint8_t *>(data);
+		size_t end = num_blocks * (t + 1) / num_threads;
+		for (size_t block = num_blocks * t / num_threads; block < end; block += blocks_per_chunk) {
+			size_t n = std::min(blocks_per_chunk, end - block);
+			size_t num_sectors = n * geometry.sectors_per_block;
+			SectorPopcounts(words + block * block_bytes, n * block_bytes, w, counts.data());
+			const uint32_t *c = counts.data();
+			size_t s = 0;
+			for (; s + 2 <= num_sectors; s += 2) {
+				pairs[c[s] * (w + 1) + c[s + 1]]++;
+			}
+			for (; s < num_sectors; s++) {
+				occupancy[c[s]]++;
+			}
+			if (geometry.sectors_per_block == 1) {
+				// the false-positive rate follows from the histogram
+				continue;
+			}
+			const uint32_t spb = geometry.sectors_per_block;
+			size_t b = 0;
+#if defined(__AVX2__)
+			// eight sectors at a time: gather their pass probabilities, multiply (add) the block's vectors together and
+			// reduce across the lanes
+			if (w == 32 && spb % 8 == 0) {
+				for (; b < n; b++, c += spb) {
+					auto gather = [&](uint32_t j) {
+						__m256i sector_counts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c + j));
+						return _mm256_i32gather_ps(pass_float.data(), sector_counts, 4);
+					};
+					__m256 v = gather(0);
+					for (uint32_t j = 8; j < spb; j += 8) {
+						v = touches_all ? _mm256_mul_ps(v, gather(j)) : _mm256_add_ps(v, gather(j));
+					}
+					__m128 h = _mm256_castps256_ps128(v);
+					__m128 hi = _mm256_extractf128_ps(v, 1);
+					h = touches_all ? _mm_mul_ps(h, hi) : _mm_add_ps(h, hi);
+					hi = _mm_movehl_ps(h, h);
+					h = touches_all ? _mm_mul_ps(h, hi) : _mm_add_ps(h, hi);
+					hi = _mm_shuffle_ps(h, h, 1);
+					h = touches_all ? _mm_mul_ss(h, hi) : _mm_add_ss(h, hi);
+					fpr_sum += touches_all ? _mm_cvtss_f32(h) : block_pass(_mm_cvtss_f32(h) / spb);
+				}
+			}
+#endif
+			for (; b < n; b++, c += spb) {
+				double p = 1;
+				double sum = 0;
+				for (uint32_t j = 0; j < spb; j++) {
+					p *= pass[c[j]];
+					sum += pass[c[j]];
+				}
+				fpr_sum += touches_all ? p : block_pass(sum / spb);
+			}
+		}
+		partials[t].occupancy.assign(w + 1, 0);
+		for (uint32_t c = 0; c <= w; c++) {
+			partials[t].occupancy[c] = occupancy[c];
+			for (uint32_t d = 0; d <= w; d++) {
+				partials[t].occupancy[c] += pairs[c * (w + 1) + d] + pairs[d * (w + 1) + c];
+			}
+		}
+		partials[t].fpr_sum = fpr_sum;
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t t = 1; t < num_threads; t++) {
+		threads.emplace_back(scan, t);
+	}
+	scan(0);
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	FilterStats stats;
+	stats.sector_bits = w;
+	stats.num_bits = num_blocks * block_bytes * 8;
+	stats.occupancy.assign(w + 1, 0);
+	double fpr_sum = 0;
+	for (const auto &partial : partials) {
+		for (uint32_t c = 0; c <= w; c++) {
+			stats.occupancy[c] += partial.occupancy[c];
+		}
+		fpr_sum += partial.fpr_sum;
+	}
+	double insertions = 0;
+	const double log_miss = std::log1p(-1.0 / w);
+	for (uint32_t c = 0; c <= w; c++) {
+		double count = static_cast<double>(stats.occupancy[c]);
+		stats.num_ones += stats.occupancy[c] * c;
+		if (geometry.sectors_per_block == 1) {
+			fpr_sum += count * pass[c];
+		}
+		double ones = std::min<double>(c, w - 0.5);
+		insertions += count * std::log1p(-ones / w) / log_miss;
+	}
+	if (num_blocks > 0) {
+		stats.fill_ratio = static_cast<double>(stats.num_ones) / static_cast<double>(stats.num_bits);
+		stats.estimated_fpr = fpr_sum / static_cast<double>(num_blocks);
+	}
+	stats.estimated_keys = insertions / geometry.BitsPerKey();
+	return stats;
+}
+
+template <typename T>
+inline FilterStats ComputeFilterStats(const BlockArray<T> &blocks, const FilterGeometry &geometry,
+                                      uint32_t num_threads = 1) {
+	return ComputeFilterStats(blocks.data(), blocks.size() * sizeof(T), geometry, num_threads);
+}
+} // namespace bloom_filters
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "base.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__SSE4_2__) || defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+namespace bloom_filters {
+// Hash families that can be used to turn keys into the hashes consumed by the filters. A filter is always probed with
+// the same family it was built with.
+enum class HashFamily : uint8_t {
+	// Murmur finalizer, as in DuckDB. Best mixing, two 64-bit multiplies per key.
+	MURMUR,
+	// SSE4.2 crc32. One instruction per 32 bits of output, but linear (no avalanche across the whole word).
+	CRC32,
+	// Single multiply followed by a shift. Cheapest, only the upper bits of the product are well mixed.
+	MULTIPLY_SHIFT
+};
+
+inline const char *HashFamilyName(HashFamily family) {
+	switch (family) {
+	case HashFamily::MURMUR:
+		return "murmur";
+	case HashFamily::CRC32:
+		return "crc32";
+	case HashFamily::MULTIPLY_SHIFT:
+		return "multiply-shift";
+	}
+	return "unknown";
+}
+
+// I use the same hash fucntion as in DuckDB.
+inline uint64_t MurmurHash64(uint64_t x) {
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93U;
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93U;
+	x ^= x >> 32;
+	return x;
+}
+
+inline uint32_t MurmurHash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0xd6e8feb9U;
+	x ^= x >> 16;
+	x *= 0xd6e8feb9U;
+	x ^= x >> 16;
+	return x;
+}
+
+// Seeds of the two crc32 halves of a 64-bit CRC hash. CRC is linear, so crc(a, x) ^ crc(b, x) only depends on the
+// seeds: the high half additionally hashes the byte-swapped key, otherwise both halves would be perfectly correlated.
+static constexpr uint32_t CRC_SEED_LO = 0x2d358dccU;
+static constexpr uint32_t CRC_SEED_HI = 0xaa6c4b3eU;
+
+inline uint32_t CRC32U64(uint32_t crc, uint64_t x) {
+#if defined(__SSE4_2__)
+	return static_cast<uint32_t>(_mm_crc32_u64(crc, x));
+#else
+	// Bitwise CRC-32C, identical to the hardware instruction but slow. Only there so the code builds everywhere.
+	for (int i = 0; i < 64; i++) {
+		uint32_t bit = (crc ^ static_cast<uint32_t>(x >> i)) & 1;
+		crc = (crc >> 1) ^ (0x82f63b78U & (0U - bit));
+	}
+	return crc;
+#endif
+}
+
+inline uint32_t CRC32Hash32(uint64_t x) {
+	return CRC32U64(CRC_SEED_LO, x);
+}
+
+inline uint64_t CRC32Hash64(uint64_t x) {
+	return (static_cast<uint64_t>(CRC32U64(CRC_SEED_HI, __builtin_bswap64(x))) << 32) | CRC32U64(CRC_SEED_LO, x);
+}
+
+// Multiplier of the multiply-shift hashes (2^64 / golden ratio, odd).
+static constexpr uint64_t MULTIPLY_SHIFT_CONSTANT = 0x9e3779b97f4a7c15ULL;
+
+// Dietzfelbinger's multiply-shift: the high half of the product is the hash.
+inline uint32_t MultiplyShiftHash32(uint64_t x) {
+	return static_cast<uint32_t>((x * MULTIPLY_SHIFT_CONSTANT) >> 32);
+}
+
+// The 64-bit variant folds the high half into the low half, since the low bits of the product only depend on the low
+// bits of the key.
+inline uint64_t MultiplyShiftHash64(uint64_t x) {
+	x *= MULTIPLY_SHIFT_CONSTANT;
+	return x ^ (x >> 32);
+}
+
+#if defined(__AVX2__)
+// AVX2 has no 64-bit mullo. a * b (mod 2^64) = lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32).
+inline __m256i Mullo64AVX2(__m256i a, __m256i b_lo, __m256i b_hi) {
+	__m256i lo_lo = _mm256_mul_epu32(a, b_lo);
+	__m256i hi_lo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo);
+	__m256i lo_hi = _mm256_mul_epu32(a, b_hi);
+	__m256i cross = _mm256_slli_epi64(_mm256_add_epi64(hi_lo, lo_hi), 32);
+	return _mm256_add_epi64(lo_lo, cross);
+}
+#endif
+
+// Hash kernels of a single family. Each kernel processes as many keys as it can with SIMD and finishes the tail with
+// the scalar function, so all kernels produce exactly the scalar hash values.
+template <HashFamily FAMILY>
+struct HashKernel;
+
+template <>
+struct HashKernel<HashFamily::MURMUR> {
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint64_t *BF_RESTRICT hashes) {
+		size_t i = 0;
+#if defined(__AVX512DQ__)
+		const __m512i c = _mm512_set1_epi64(static_cast<int64_t>(0xd6e8feb86659fd93ULL));
+		for (; i + 8 <= num; i += 8) {
+			__m512i x = _mm512_loadu_si512(key + i);
+			x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 32));
+			x = _mm512_mullo_epi64(x, c);
+			x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 32));
+			x = _mm512_mullo_epi64(x, c);
+			x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 32));
+			_mm512_storeu_si512(hashes + i, x);
+		}
+#elif defined(__AVX2__)
+		const __m256i c_lo = _mm256_set1_epi64x(static_cast<int64_t>(0xd6e8feb86659fd93ULL & 0xffffffffULL));
+		const __m256i c_hi = _mm256_set1_epi64x(static_cast<int64_t>(0xd6e8feb86659fd93ULL >> 32));
+		for (; i + 4 <= num; i += 4) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i));
+			x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+			x = Mullo64AVX2(x, c_lo, c_hi);
+			x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+			x = Mullo64AVX2(x, c_lo, c_hi);
+			x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(hashes + i), x);
+		}
+#endif
+		for (; i < num; i++) {
+			hashes[i] = MurmurHash64(key[i]);
+		}
+	}
+
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint32_t *BF_RESTRICT hashes) {
+		// 32-bit mullo exists in every SIMD extension, the compiler vectorizes this loop on its own.
+		for (size_t i = 0; i < num; i++) {
+			hashes[i] = MurmurHash32(static_cast<uint32_t>(key[i]));
+		}
+	}
+};
+
+template <>
+struct HashKernel<HashFamily::CRC32> {
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint64_t *BF_RESTRICT hashes) {
+		// crc32 is a scalar instruction with a latency of 3 cycles and a throughput of 1, the iterations are
+		// independent so they pipeline well.
+		for (size_t i = 0; i < num; i++) {
+			hashes[i] = CRC32Hash64(key[i]);
+		}
+	}
+
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint32_t *BF_RESTRICT hashes) {
+		for (size_t i = 0; i < num; i++) {
+			hashes[i] = CRC32Hash32(key[i]);
+		}
+	}
+};
+
+template <>
+struct HashKernel<HashFamily::MULTIPLY_SHIFT> {
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint64_t *BF_RESTRICT hashes) {
+		size_t i = 0;
+#if defined(__AVX512DQ__)
+		const __m512i c = _mm512_set1_epi64(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT));
+		for (; i + 8 <= num; i += 8) {
+			__m512i x = _mm512_mullo_epi64(_mm512_loadu_si512(key + i), c);
+			_mm512_storeu_si512(hashes + i, _mm512_xor_si512(x, _mm512_srli_epi64(x, 32)));
+		}
+#elif defined(__AVX2__)
+		const __m256i c_lo = _mm256_set1_epi64x(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT & 0xffffffffULL));
+		const __m256i c_hi = _mm256_set1_epi64x(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT >> 32));
+		for (; i + 4 <= num; i += 4) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i));
+			x = Mullo64AVX2(x, c_lo, c_hi);
+			x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(hashes + i), x);
+		}
+#endif
+		for (; i < num; i++) {
+			hashes[i] = MultiplyShiftHash64(key[i]);
+		}
+	}
+
+	static inline void Hash(size_t num, const uint64_t *BF_RESTRICT key, uint32_t *BF_RESTRICT hashes) {
+		size_t i = 0;
+#if defined(__AVX512DQ__)
+		const __m512i c = _mm512_set1_epi64(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT));
+		for (; i + 8 <= num; i += 8) {
+			__m512i x = _mm512_mullo_epi64(_mm512_loadu_si512(key + i), c);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(hashes + i),
+			                    _mm512_cvtepi64_epi32(_mm512_srli_epi64(x, 32)));
+		}
+#elif defined(__AVX2__)
+		const __m256i c_lo = _mm256_set1_epi64x(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT & 0xffffffffULL));
+		const __m256i c_hi = _mm256_set1_epi64x(static_cast<int64_t>(MULTIPLY_SHIFT_CONSTANT >> 32));
+		// Picks the odd 32-bit lanes (the high halves of the products) of two vectors.
+		const __m256i odd_lanes = _mm256_setr_epi32(1, 3, 5, 7, 0, 2, 4, 6);
+		for (; i + 4 <= num; i += 4) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i));
+			x = _mm256_permutevar8x32_epi32(Mullo64AVX2(x, c_lo, c_hi), odd_lanes);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(hashes + i), _mm256_castsi256_si128(x));
+		}
+#endif
+		for (; i < num; i++) {
+			hashes[i] = MultiplyShiftHash32(key[i]);
+		}
+	}
+};
+
+template <HashFamily FAMILY>
+inline void HashVector(size_t num, const uint64_t *key, uint64_t *hashes) {
+	HashKernel<FAMILY>::Hash(num, key, hashes);
+}
+
+template <HashFamily FAMILY>
+inline void HashVector(size_t num, const uint64_t *key, uint32_t *hashes) {
+	HashKernel<FAMILY>::Hash(num, key, hashes);
+}
+
+inline void HashVector(size_t num, const uint64_t *key, uint64_t *hashes) {
+	HashKernel<HashFamily::MURMUR>::Hash(num, key, hashes);
+}
+
+inline void HashVector(size_t num, const uint64_t *key, uint32_t *hashes) {
+	HashKernel<HashFamily::MURMUR>::Hash(num, key, hashes);
+}
+} // namespace bloom_filters
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
 
 #include <cmath>
 #include <cstddef>
@@ -34,30 +36,104 @@ public:
 
     // Minimum number of bits that should be used in the Bloom Filter
     static constexpr uint32_t MIN_NUM_BITS = 256;
+    // one bit in each 32-bit word of a 256-bit block
+    static constexpr FilterGeometry GEOMETRY = {32, 8, 8, 1};
 
 	static constexpr auto SIMD_ALIGNMENT = 64;
 
-    explicit ImpalaBlockedBF64Bit(size_t n_key, uint32_t n_bits_per_key) {
+    // Keys inserted or probed per iteration of the batch loops, with AVX-512 two per MakeMaskPair.
+    static constexpr uint32_t GROUP_SIZE = 4;
+
+    explicit ImpalaBlockedBF64Bit(size_t n_key, uint32_t n_bits_per_key,
+                                  const StorageOptions &storage = StorageOptions()) {
         uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
     	num_blocks = std::min(min_bits >> 8, MAX_NUM_BLOCKS);
         num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
         num_blocks = std::min(1U << num_blocks_log, MAX_NUM_BLOCKS);  // Ensure num_blocks doesn't exceed the max
 
-        blocks.resize(num_blocks << 3);  // Resize the blocks vector to hold the necessary number of blocks
-        std::cout << "BF Size: " << num_blocks * 4 * 8 / 1024 << " KiB\n";  // Output the size of the filter
+        blocks.Allocate(num_blocks << 3, storage);  // Allocate 8 32-bit values per block
+        if (storage.verbose) {
+            std::cout << "BF Size: " << num_blocks * 4 * 8 / 1024 << " KiB\n";  // Output the size of the filter
+        }
     }
 
     inline void Insert(size_t num, uint64_t* key) {
         InsertInternal(num, key, blocks.data());
     }
 
+    // Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+    inline void Clear() {
+        blocks.Clear();
+    }
+
+    // The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+    inline BlockArray<uint32_t> &Blocks() {
+        return blocks;
+    }
+    inline const BlockArray<uint32_t> &Blocks() const {
+        return blocks;
+    }
+
+    // Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+    inline FilterStats Stats(uint32_t num_threads = 1) const {
+        return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+    }
+
     inline size_t Lookup(size_t num, uint64_t* key, uint32_t* out) {
         return LookupInternal(num, key, blocks.data(), out);
     }
 
+    // Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+    inline uint32_t Lookup(uint32_t num, uint64_t* key, const uint32_t* sel, uint32_t* sel_out) {
+        return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint64_t* batch_key, uint32_t* out) {
+            LookupInternal(n, batch_key, blocks.data(), out);
+        });
+    }
+
+    // Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+    inline bool LookupOne(uint64_t key) const {
+        const __m256i bucket = reinterpret_cast<const __m256i*>(blocks.data())[key & (num_blocks - 1)];
+        return _mm256_testc_si256(bucket, MakeMask(key >> 32));
+    }
+    inline void InsertOne(uint64_t key) {
+        __m256i* bucket = &reinterpret_cast<__m256i*>(blocks.data())[key & (num_blocks - 1)];
+        _mm256_store_si256(bucket, _mm256_or_si256(*bucket, MakeMask(key >> 32)));
+    }
+
 private:
     void InsertInternal(size_t num, uint64_t* BF_RESTRICT key, uint32_t* BF_RESTRICT bf) const {
-		for (uint32_t i = 0; i < num; i++){
+        size_t i = 0;
+#if defined(__AVX512F__)
+        // GROUP_SIZE keys per iteration, two masks per MakeMaskPair; the read-modify-writes stay in key order, as two
+        // keys of a group may share a bucket
+        __m256i* buckets = reinterpret_cast<__m256i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            __m256i mask[GROUP_SIZE];
+            for (uint32_t j = 0; j < GROUP_SIZE; j += 2) {
+                const __m512i pair = MakeMaskPair(key + i + j);
+                mask[j] = _mm512_castsi512_si256(pair);
+                mask[j + 1] = _mm512_extracti64x4_epi64(pair, 1);
+            }
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                __m256i* bucket = &buckets[key[i + j] & (num_blocks - 1)];
+                _mm256_store_si256(bucket, _mm256_or_si256(*bucket, mask[j]));
+            }
+        }
+#elif defined(__AVX2__)
+        // GROUP_SIZE keys per iteration, all masks first; the read-modify-writes stay in key order
+        __m256i* buckets = reinterpret_cast<__m256i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            __m256i mask[GROUP_SIZE];
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                mask[j] = MakeMask(key[i + j] >> 32);
+            }
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                __m256i* bucket = &buckets[key[i + j] & (num_blocks - 1)];
+                _mm256_store_si256(bucket, _mm256_or_si256(*bucket, mask[j]));
+            }
+        }
+#endif
+		for (; i < num; i++){
 			uint32_t block = key[i] & (num_blocks - 1);
         	const __m256i mask = MakeMask(key[i] >> 32);  // Generate the mask based on the key
 			__m256i* bucket = &reinterpret_cast<__m256i*>(bf)[block];  // Access the appropriate bucket
@@ -68,7 +144,34 @@ private:
 
     size_t LookupInternal(size_t num, uint64_t* BF_RESTRICT key, uint32_t* BF_RESTRICT bf,
                           uint32_t* BF_RESTRICT out) const {
-		for (uint32_t i = 0; i < num; i++){
+        size_t i = 0;
+#if defined(__AVX512F__)
+        // GROUP_SIZE keys per iteration, two masks per MakeMaskPair
+        const __m256i* buckets = reinterpret_cast<const __m256i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            for (uint32_t j = 0; j < GROUP_SIZE; j += 2) {
+                const __m512i pair = MakeMaskPair(key + i + j);
+                const __m256i bucket0 = buckets[key[i + j] & (num_blocks - 1)];
+                const __m256i bucket1 = buckets[key[i + j + 1] & (num_blocks - 1)];
+                out[i + j] = _mm256_testc_si256(bucket0, _mm512_castsi512_si256(pair));
+                out[i + j + 1] = _mm256_testc_si256(bucket1, _mm512_extracti64x4_epi64(pair, 1));
+            }
+        }
+#elif defined(__AVX2__)
+        // GROUP_SIZE keys per iteration: all masks and bucket loads are issued before the first test
+        const __m256i* buckets = reinterpret_cast<const __m256i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            __m256i mask[GROUP_SIZE], bucket[GROUP_SIZE];
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                mask[j] = MakeMask(key[i + j] >> 32);
+                bucket[j] = buckets[key[i + j] & (num_blocks - 1)];
+            }
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                out[i + j] = _mm256_testc_si256(bucket[j], mask[j]);
+            }
+        }
+#endif
+		for (; i < num; i++){
 			uint32_t block = key[i] & (num_blocks - 1);
 	        const __m256i mask = MakeMask(key[i] >> 32);  // Generate the mask based on the key
 	        const __m256i bucket = reinterpret_cast<__m256i*>(bf)[block];  // Access the appropriate bucket
@@ -97,6 +200,23 @@ private:
 	// }
 	// out[i] = all_present ? 1 : 0;
 
+#if defined(__AVX512F__)
+    // The masks of key[0] and key[1] in the low and high half of one 512-bit register: one load, one permute that
+    // broadcasts the upper 32 bits of each key to its half, and one multiply, shift and sllv for both keys, where
+    // MakeMask spends a multiply, shift and sllv on each. Same masks as MakeMask.
+    static inline __m512i MakeMaskPair(const uint64_t* key) {
+        const __m512i ones = _mm512_set1_epi32(1);
+        const __m512i rehash = _mm512_broadcast_i32x8(_mm256_setr_epi32(
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U));
+        const __m512i high_halves = _mm512_setr_epi32(1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, 3);
+        const __m128i two_keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+        __m512i hash_data = _mm512_permutexvar_epi32(high_halves, _mm512_castsi128_si512(two_keys));
+        hash_data = _mm512_mullo_epi32(rehash, hash_data);
+        hash_data = _mm512_srli_epi32(hash_data, 27);
+        return _mm512_sllv_epi32(ones, hash_data);
+    }
+#endif
+
     static inline __m256i MakeMask(const uint32_t hash) {
         const __m256i ones = _mm256_set1_epi32(1);  // Set all bits to 1
     	const __m256i rehash = _mm256_setr_epi32(0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
@@ -117,8 +237,8 @@ private:
 
     uint32_t num_blocks;          // Number of blocks in the Bloom Filter
     uint32_t num_blocks_log;      // Log2 of the number of blocks (for optimization)
-	// Align the blocks vector to 64-byte boundaries to ensure SIMD compatibility
-	std::vector<uint32_t, AlignedAllocator<uint32_t, SIMD_ALIGNMENT>> blocks; // Internal array to hold the Bloom Filter blocks
+	// BlockArray is 64-byte aligned, as required by the SIMD loads
+	BlockArray<uint32_t> blocks; // Internal array to hold the Bloom Filter blocks
 };
 
 } // namespace bloom_filters
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
 
 #include <cmath>
 #include <cstddef>
@@ -34,30 +36,85 @@ public:
 
     // Minimum number of bits that should be used in the Bloom Filter
     static constexpr uint32_t MIN_NUM_BITS = 512;  // Increased for AVX512
+    // one bit in each 32-bit word of a 512-bit block
+    static constexpr FilterGeometry GEOMETRY = {32, 16, 16, 1};
 
     static constexpr auto SIMD_ALIGNMENT = 64;
+    // Keys inserted or probed per iteration of the batch loops; all masks and bucket loads of a group come first.
+    static constexpr uint32_t GROUP_SIZE = 4;
 
-    explicit ImpalaBlockedBF64BitAVX512(size_t n_key, uint32_t n_bits_per_key) {
+    explicit ImpalaBlockedBF64BitAVX512(size_t n_key, uint32_t n_bits_per_key,
+                                        const StorageOptions &storage = StorageOptions()) {
         uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
         num_blocks = std::min(min_bits >> 9, MAX_NUM_BLOCKS);  // Changed from >>8 to >>9 (512 bits per block)
         num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
         num_blocks = std::min(1U << num_blocks_log, MAX_NUM_BLOCKS);  // Ensure num_blocks doesn't exceed the max
 
-        blocks.resize(num_blocks << 4);  // Resize to hold 16 32-bit values per block (64 bytes)
-        std::cout << "BF Size: " << num_blocks * 8 * 8 / 1024 << " KiB\n";  // Output the size of the filter
+        blocks.Allocate(num_blocks << 4, storage);  // Allocate 16 32-bit values per block (64 bytes)
+        if (storage.verbose) {
+            std::cout << "BF Size: " << num_blocks * 8 * 8 / 1024 << " KiB\n";  // Output the size of the filter
+        }
     }
 
     inline void Insert(size_t num, uint64_t* key) {
         InsertInternal(num, key, blocks.data());
     }
 
+    // Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+    inline void Clear() {
+        blocks.Clear();
+    }
+
+    // The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+    inline BlockArray<uint32_t> &Blocks() {
+        return blocks;
+    }
+    inline const BlockArray<uint32_t> &Blocks() const {
+        return blocks;
+    }
+
+    // Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+    inline FilterStats Stats(uint32_t num_threads = 1) const {
+        return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+    }
+
     inline size_t Lookup(size_t num, uint64_t* key, uint32_t* out) {
         return LookupInternal(num, key, blocks.data(), out);
     }
 
+    // Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+    inline uint32_t Lookup(uint32_t num, uint64_t* key, const uint32_t* sel, uint32_t* sel_out) {
+        return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint64_t* batch_key, uint32_t* out) {
+            LookupInternal(n, batch_key, blocks.data(), out);
+        });
+    }
+
+    // Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+    inline bool LookupOne(uint64_t key) const {
+        const __m512i bucket = reinterpret_cast<const __m512i*>(blocks.data())[key & (num_blocks - 1)];
+        const __m512i mask = MakeMask(key >> 32);
+        return _mm512_test_epi32_mask(mask, _mm512_andnot_si512(bucket, mask)) == 0;
+    }
+    inline void InsertOne(uint64_t key) {
+        __m512i* bucket = &reinterpret_cast<__m512i*>(blocks.data())[key & (num_blocks - 1)];
+        _mm512_store_si512(bucket, _mm512_or_si512(*bucket, MakeMask(key >> 32)));
+    }
+
 private:
     void InsertInternal(size_t num, uint64_t* BF_RESTRICT key, uint32_t* BF_RESTRICT bf) const {
-        for (uint32_t i = 0; i < num; i++){
+        size_t i = 0;
+        __m512i* buckets = reinterpret_cast<__m512i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            __m512i mask[GROUP_SIZE];
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                mask[j] = MakeMask(key[i + j] >> 32);
+            }
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                __m512i* bucket = &buckets[key[i + j] & (num_blocks - 1)];
+                _mm512_store_si512(bucket, _mm512_or_si512(*bucket, mask[j]));
+            }
+        }
+        for (; i < num; i++){
             uint32_t block = key[i] & (num_blocks - 1);
             const __m512i mask = MakeMask(key[i] >> 32);  // Generate the mask based on the key
             __m512i* bucket = &reinterpret_cast<__m512i*>(bf)[block];  // Access the appropriate bucket
@@ -67,17 +124,25 @@ private:
 
     size_t LookupInternal(size_t num, uint64_t* BF_RESTRICT key, uint32_t* BF_RESTRICT bf,
                           uint32_t* BF_RESTRICT out) const {
-        for (uint32_t i = 0; i < num; i++){
+        size_t i = 0;
+        const __m512i* buckets = reinterpret_cast<const __m512i*>(bf);
+        for (; i + GROUP_SIZE <= num; i += GROUP_SIZE) {
+            __m512i mask[GROUP_SIZE], bucket[GROUP_SIZE];
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                mask[j] = MakeMask(key[i + j] >> 32);
+                bucket[j] = buckets[key[i + j] & (num_blocks - 1)];
+            }
+            for (uint32_t j = 0; j < GROUP_SIZE; j++) {
+                out[i + j] = _mm512_test_epi32_mask(mask[j], _mm512_andnot_si512(bucket[j], mask[j])) == 0;
+            }
+        }
+        for (; i < num; i++){
             uint32_t block = key[i] & (num_blocks - 1);
             const __m512i mask = MakeMask(key[i] >> 32);  // Generate the mask based on the key
             const __m512i bucket = reinterpret_cast<__m512i*>(bf)[block];  // Access the appropriate bucket
-            // Similar to AVX2's _mm256_testc_si256, we check if all bits in mask are present in bucket
-            // _mm512_test_epi32_mask tests if (bucket & mask) != 0 for each lane
-            // We want to check if (bucket & mask) == mask for each lane
-            const __m512i and_result = _mm512_and_si512(bucket, mask);
-            const __mmask16 test_result = _mm512_cmpeq_epi32_mask(and_result, mask);
-            // If all 16 lanes match (all bits set), then the element might be present
-            out[i] = (test_result == 0xFFFF) ? 1 : 0;
+            // Similar to AVX2's _mm256_testc_si256, we check if all bits in mask are present in bucket:
+            // mask & ~bucket is zero in every lane, one andnot and one test (instead of and, compare, compare)
+            out[i] = _mm512_test_epi32_mask(mask, _mm512_andnot_si512(bucket, mask)) == 0;
         }
         return num;
     }
@@ -109,8 +174,8 @@ private:
 
     uint32_t num_blocks;          // Number of blocks in the Bloom Filter
     uint32_t num_blocks_log;      // Log2 of the number of blocks (for optimization)
-    // Align the blocks vector to 64-byte boundaries to ensure SIMD compatibility
-    std::vector<uint32_t, AlignedAllocator<uint32_t, SIMD_ALIGNMENT>> blocks; // Internal array to hold the Bloom Filter blocks
+    // BlockArray is 64-byte aligned, as required by the SIMD loads
+    BlockArray<uint32_t> blocks; // Internal array to hold the Bloom Filter blocks
 };
 
 } // namespace bloom_filters
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "base.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace bloom_filters {
+// Probes one batch of keys against several filters of different types, e.g. the dimension-table filters of a
+// star-schema query. Each key column is hashed once per batch (with HashVector, for 64-bit and, if needed, 32-bit
+// filters), and the filters run as a chain of selection-vector lookups, so a row is not probed any further once a
+// filter rejects it. The filters are reordered by observed cost per rejected row, which is the optimal order for
+// independent predicates.
+//
+// Every filter must have been built with HashVector of its own hash type on the keys of its column.
+class MultiFilterProbe {
+public:
+	// Rows processed per chunk. The hashes of a chunk stay in L1/L2.
+	static constexpr uint32_t BATCH_SIZE = 1024;
+	// Chunks between two reorderings. The statistics are halved at each reordering, so old observations fade out.
+	static constexpr uint32_t REORDER_INTERVAL = 16;
+
+	// Observations of one filter since it was added.
+	struct FilterStats {
+		std::string name;
+		uint32_t column;
+		// Rows probed, rows that passed and cycles spent, decayed at each reordering.
+		double rows_in = 0;
+		double rows_out = 0;
+		double cycles = 0;
+		// Totals, never decayed.
+		uint64_t total_rows_in = 0;
+		uint64_t total_rows_out = 0;
+
+		double PassRate() const {
+			return rows_in > 0 ? rows_out / rows_in : 1.0;
+		}
+		double CyclesPerRow() const {
+			return rows_in > 0 ? cycles / rows_in : 0.0;
+		}
+	};
+
+public:
+	// With adaptive = false the filters are always probed in the order they were added.
+	explicit MultiFilterProbe(uint32_t num_columns = 1, bool adaptive = true)
+	    : adaptive_(adaptive), hashes64_(num_columns, std::vector<uint64_t>(BATCH_SIZE)),
+	      hashes32_(num_columns, std::vector<uint32_t>(BATCH_SIZE)) {
+	}
+
+	// Adds a filter probed with the keys of the given column. The filter must outlive the probe.
+	template <typename BloomFilterType, typename HashType>
+	void AddFilter(BloomFilterType &bf, uint32_t column = 0, const std::string &name = "") {
+		stages_.emplace_back(new FilterStage<BloomFilterType, HashType>(bf, column));
+		stats_.push_back(FilterStats {name.empty() ? "filter " + std::to_string(stats_.size()) : name, column});
+		order_.push_back(static_cast<uint32_t>(order_.size()));
+	}
+
+	// Single key column. Writes the rows passing all filters to sel_out and returns how many there are.
+	uint32_t Probe(uint32_t num, const uint64_t *key, uint32_t *sel_out) {
+		return Probe(num, &key, sel_out);
+	}
+
+	// key_columns[c] holds the num keys of column c.
+	uint32_t Probe(uint32_t num, const uint64_t *const *key_columns, uint32_t *sel_out) {
+		uint32_t found = 0;
+		for (uint32_t base = 0; base < num; base += BATCH_SIZE) {
+			uint32_t batch = std::min(BATCH_SIZE, num - base);
+			found += ProbeChunk(batch, key_columns, base, sel_out + found);
+			if (adaptive_ && ++num_chunks_ % REORDER_INTERVAL == 0) {
+				Reorder();
+			}
+		}
+		return found;
+	}
+
+	// Current probe order, as indexes into Stats().
+	const std::vector<uint32_t> &Order() const {
+		return order_;
+	}
+
+	const std::vector<FilterStats> &Stats() const {
+		return stats_;
+	}
+
+private:
+	struct ProbeStage {
+		explicit ProbeStage(uint32_t column) : column(column) {
+		}
+		virtual ~ProbeStage() = default;
+		virtual bool Uses32BitHashes() const = 0;
+		virtual uint32_t Lookup(uint32_t num, uint64_t *hashes64, uint32_t *hashes32, const uint32_t *sel,
+		                        uint32_t *sel_out) = 0;
+		uint32_t column;
+	};
+
+	template <typename BloomFilterType, typename HashType>
+	struct FilterStage : public ProbeStage {
+		FilterStage(BloomFilterType &bf, uint32_t column) : ProbeStage(column), bf(bf) {
+		}
+		bool Uses32BitHashes() const override {
+			return sizeof(HashType) == sizeof(uint32_t);
+		}
+		uint32_t Lookup(uint32_t num, uint64_t *hashes64, uint32_t *hashes32, const uint32_t *sel,
+		                uint32_t *sel_out) override {
+			// the last argument only selects the hash array matching HashType
+			return LookupWith(num, hashes64, hashes32, sel, sel_out, static_cast<HashType *>(nullptr));
+		}
+		uint32_t LookupWith(uint32_t num, uint64_t *hashes64, uint32_t *, const uint32_t *sel, uint32_t *sel_out,
+		                    uint64_t *) {
+			return bf.Lookup(num, hashes64, sel, sel_out);
+		}
+		uint32_t LookupWith(uint32_t num, uint64_t *, uint32_t *hashes32, const uint32_t *sel, uint32_t *sel_out,
+		                    uint32_t *) {
+			return bf.Lookup(num, hashes32, sel, sel_out);
+		}
+		BloomFilterType &bf;
+	};
+
+	uint32_t ProbeChunk(uint32_t batch, const uint64_t *const *key_columns, uint32_t base, uint32_t *sel_out) {
+		// Columns are hashed at most once per chunk, when the first filter on them runs.
+		hashed64_.assign(hashes64_.size(), false);
+		hashed32_.assign(hashes32_.size(), false);
+
+		std::iota(sel_, sel_ + batch, 0);
+		uint32_t num_sel = batch;
+		for (uint32_t index : order_) {
+			if (num_sel == 0) {
+				break;
+			}
+			ProbeStage &stage = *stages_[index];
+			uint32_t c = stage.column;
+			if (stage.Uses32BitHashes() ? !hashed32_[c] : !hashed64_[c]) {
+				if (stage.Uses32BitHashes()) {
+					HashVector(batch, key_columns[c] + base, hashes32_[c].data());
+					hashed32_[c] = true;
+				} else {
+					HashVector(batch, key_columns[c] + base, hashes64_[c].data());
+					hashed64_[c] = true;
+				}
+			}
+
+			uint64_t start = CycleCount();
+			uint32_t passed = stage.Lookup(num_sel, hashes64_[c].data(), hashes32_[c].data(), sel_, sel_);
+			uint64_t end = CycleCount();
+
+			FilterStats &stats = stats_[index];
+			stats.rows_in += num_sel;
+			stats.rows_out += passed;
+			stats.cycles += static_cast<double>(end - start);
+			stats.total_rows_in += num_sel;
+			stats.total_rows_out += passed;
+			num_sel = passed;
+		}
+		for (uint32_t i = 0; i < num_sel; i++) {
+			sel_out[i] = sel_[i] + base;
+		}
+		return num_sel;
+	}
+
+	// Sorts the filters by cycles per rejected row, cost / (1 - pass rate), ascending.
+	void Reorder() {
+		auto rank = [this](uint32_t index) {
+			const FilterStats &stats = stats_[index];
+			double rejected = 1.0 - stats.PassRate();
+			return rejected > 0 ? stats.CyclesPerRow() / rejected : std::numeric_limits<double>::max();
+		};
+		std::stable_sort(order_.begin(), order_.end(),
+		                 [&rank](uint32_t a, uint32_t b) { return rank(a) < rank(b); });
+		for (auto &stats : stats_) {
+			stats.rows_in /= 2;
+			stats.rows_out /= 2;
+			stats.cycles /= 2;
+		}
+	}
+
+	std::vector<std::unique_ptr<ProbeStage>> stages_;
+	std::vector<FilterStats> stats_;
+	std::vector<uint32_t> order_;
+	bool adaptive_;
+	uint64_t num_chunks_ = 0;
+
+	std::vector<std::vector<uint64_t>> hashes64_;
+	std::vector<std::vector<uint32_t>> hashes32_;
+	std::vector<bool> hashed64_;
+	std::vector<bool> hashed32_;
+	uint32_t sel_[BATCH_SIZE];
+};
+} // namespace bloom_filters
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+#include "hash_functions.h"
+
+#include <algorithm>
+#include <cstdint>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <vector>
+
+namespace bloom_filters {
+// Exact set of 64-bit fingerprints, small enough to stay in L1/L2: 8-way set-associative, one 64-byte line per set,
+// probed with two AVX2 compares (eight scalar ones without AVX2). When a set is full, an entry that has not been hit
+// since the set's reference bits were last cleared is evicted (not-recently-used), so entries that keep getting hit
+// stay.
+class NegativeCache {
+public:
+	static constexpr uint32_t NUM_WAYS = 8;
+	// 32 KiB of fingerprints.
+	static constexpr uint32_t DEFAULT_ENTRIES = 4096;
+
+public:
+	// num_entries is rounded up to a power of two, and to at least one set.
+	explicit NegativeCache(uint32_t num_entries = DEFAULT_ENTRIES) {
+		num_sets = 1;
+		while (num_sets * NUM_WAYS < num_entries) {
+			num_sets <<= 1;
+		}
+		slots.Allocate(size_t(num_sets) * NUM_WAYS);
+		sets.assign(num_sets, SetState());
+	}
+
+public:
+	// Whether fingerprint is in the set; marks it as recently used.
+	inline bool Contains(uint64_t fingerprint) {
+		uint32_t set = SetOf(fingerprint);
+		uint32_t match = Match(set, fingerprint);
+		sets[set].referenced |= match;
+		return match != 0;
+	}
+
+	inline void Add(uint64_t fingerprint) {
+		uint32_t set = SetOf(fingerprint);
+		if (Match(set, fingerprint)) {
+			return;
+		}
+		SetState &state = sets[set];
+		uint32_t way;
+		if (state.valid != 0xFF) {
+			way = __builtin_ctz(~state.valid & 0xFFU);
+			num_entries++;
+		} else {
+			// the first way from the hand on that was not hit recently; if all were, start a new period
+			if (state.referenced == 0xFF) {
+				state.referenced = 0;
+			}
+			uint32_t candidates = ~state.referenced & 0xFFU;
+			uint32_t rotated = ((candidates >> state.hand) | (candidates << (NUM_WAYS - state.hand))) & 0xFFU;
+			way = (state.hand + __builtin_ctz(rotated)) % NUM_WAYS;
+			state.hand = static_cast<uint8_t>((way + 1) % NUM_WAYS);
+			num_evictions++;
+		}
+		slots[size_t(set) * NUM_WAYS + way] = fingerprint;
+		state.valid |= 1U << way;
+		state.referenced &= ~(1U << way);
+	}
+
+	inline void Erase(uint64_t fingerprint) {
+		uint32_t set = SetOf(fingerprint);
+		uint32_t match = Match(set, fingerprint);
+		if (match) {
+			sets[set].valid &= ~match;
+			num_entries--;
+		}
+	}
+
+	inline void Clear() {
+		sets.assign(num_sets, SetState());
+		num_entries = 0;
+	}
+
+	inline size_t Size() const {
+		return num_entries;
+	}
+	inline size_t Capacity() const {
+		return size_t(num_sets) * NUM_WAYS;
+	}
+	// Fingerprints evicted to make room for new ones since construction.
+	inline uint64_t NumEvictions() const {
+		return num_evictions;
+	}
+
+private:
+	struct SetState {
+		// one bit per way
+		uint8_t valid = 0;
+		uint8_t referenced = 0;
+		// where the search for a way to evict starts
+		uint8_t hand = 0;
+	};
+
+	// Remixed, as filter positives share the hash bits the filter indexes with.
+	inline uint32_t SetOf(uint64_t fingerprint) const {
+		return static_cast<uint32_t>((fingerprint * MULTIPLY_SHIFT_CONSTANT) >> 32) & (num_sets - 1);
+	}
+
+	// Bit w is set if way w of set holds fingerprint.
+	inline uint32_t Match(uint32_t set, uint64_t fingerprint) const {
+#if defined(__AVX2__)
+		const __m256i *line = reinterpret_cast<const __m256i *>(slots.data() + size_t(set) * NUM_WAYS);
+		const __m256i needle = _mm256_set1_epi64x(static_cast<int64_t>(fingerprint));
+		uint32_t lo = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_load_si256(line), needle)));
+		uint32_t hi = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_load_si256(line + 1), needle)));
+		return (lo | (hi << 4)) & sets[set].valid;
+#else
+		const uint64_t *line = slots.data() + size_t(set) * NUM_WAYS;
+		uint32_t match = 0;
+		for (uint32_t way = 0; way < NUM_WAYS; way++) {
+			match |= static_cast<uint32_t>(line[way] == fingerprint) << way;
+		}
+		return match & sets[set].valid;
+#endif
+	}
+
+	uint32_t num_sets;
+	// NUM_WAYS fingerprints per set; BlockArray is 64-byte aligned, so a set is one cache line
+	BlockArray<uint64_t> slots;
+	std::vector<SetState> sets;
+	size_t num_entries = 0;
+	uint64_t num_evictions = 0;
+};
+
+// What a NegativeCachedFilter did.
+struct NegativeCacheCounters {
+	uint64_t rows_probed = 0;
+	// Rows that passed the filter, and those of them the cache then rejected.
+	uint64_t filter_positives = 0;
+	uint64_t cache_hits = 0;
+	uint64_t negatives_added = 0;
+};
+
+// Wraps a filter with a NegativeCache of keys the caller has found, downstream, not to be members even though the
+// filter passed them. Under a skewed probe distribution the same few false positives come back over and over, and
+// every one of them costs a hash-table probe or a disk read; once such a key is in the cache, it is rejected after
+// the filter Lookup and never goes downstream again. Only filter positives are looked up in the cache.
+//
+// The fingerprints are the 64-bit hashes the filter is probed with, which must come from HashVector<FAMILY> of
+// 64-bit integer keys. Only MURMUR and MULTIPLY_SHIFT are allowed: they are bijective on 64 bits, so two keys never
+// share a fingerprint and a member is never rejected. CRC32 hashes and string digests collide, and a cached negative
+// would reject every member it collides with. Keys inserted through the wrapper are erased from the cache. Not
+// thread-safe: Lookup updates the cache's reference bits.
+template <typename BloomFilterType, HashFamily FAMILY>
+class NegativeCachedFilter {
+	static_assert(FAMILY == HashFamily::MURMUR || FAMILY == HashFamily::MULTIPLY_SHIFT,
+	              "the cache is only exact for hash families that are bijective on 64-bit keys");
+
+public:
+	using HashType = uint64_t;
+
+	// The filter must outlive the wrapper.
+	explicit NegativeCachedFilter(BloomFilterType &bf, uint32_t num_entries = NegativeCache::DEFAULT_ENTRIES)
+	    : bf(bf), cache(num_entries) {
+	}
+
+public:
+	inline void Insert(uint32_t num, HashType *key) {
+		bf.Insert(num, key);
+		for (uint32_t i = 0; i < num && cache.Size() > 0; i++) {
+			cache.Erase(key[i]);
+		}
+	}
+
+	// Same contract as the filter's Lookup, with cached negatives reported as 0.
+	inline uint32_t Lookup(uint32_t num, HashType *key, uint32_t *out) {
+		bf.Lookup(num, key, out);
+		uint32_t positives = 0;
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < num; i++) {
+			if (out[i]) {
+				positives++;
+				if (cache.Contains(key[i])) {
+					out[i] = 0;
+					hits++;
+				}
+			}
+		}
+		RecordBatch(num, positives, hits);
+		return num;
+	}
+
+	// Selection-vector Lookup: the rows that pass the filter and are not cached negatives.
+	inline uint32_t Lookup(uint32_t num, HashType *key, const uint32_t *sel, uint32_t *sel_out) {
+		uint32_t positives = bf.Lookup(num, key, sel, sel_out);
+		uint32_t found = 0;
+		for (uint32_t i = 0; i < positives; i++) {
+			uint32_t row = sel_out[i];
+			sel_out[found] = row;
+			found += !cache.Contains(key[row]);
+		}
+		RecordBatch(num, positives, positives - found);
+		return found;
+	}
+
+	// Feedback from downstream: key[sel[0, num)] passed the filter but are not members.
+	inline void AddNegatives(uint32_t num, const HashType *key, const uint32_t *sel) {
+		for (uint32_t i = 0; i < num; i++) {
+			cache.Add(key[sel[i]]);
+		}
+		counters.negatives_added += num;
+	}
+	inline void AddNegative(HashType key) {
+		cache.Add(key);
+		counters.negatives_added++;
+	}
+
+	// Clears the filter and the cache.
+	inline void Clear() {
+		bf.Clear();
+		cache.Clear();
+	}
+
+	const NegativeCacheCounters &Counters() const {
+		return counters;
+	}
+
+	NegativeCache &Cache() {
+		return cache;
+	}
+
+	BloomFilterType &Filter() {
+		return bf;
+	}
+
+private:
+	inline void RecordBatch(uint32_t num, uint32_t positives, uint32_t hits) {
+		counters.rows_probed += num;
+		counters.filter_positives += positives;
+		counters.cache_hits += hits;
+	}
+
+private:
+	BloomFilterType &bf;
+	NegativeCache cache;
+	NegativeCacheCounters counters;
+};
+} // namespace bloom_filters
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace bloom_filters {
+// Size of one partition's sub-filter the partition count is chosen for, so that a sub-filter stays in the L2 cache
+// while its keys are inserted or probed.
+static constexpr size_t PARTITION_TARGET_BYTES = 256 << 10;
+// At most 2^10 partitions, the fanout a radix-partitioning pass handles without TLB and cache thrashing.
+static constexpr uint32_t MAX_PARTITION_BITS = 10;
+
+struct PartitionedFilterOptions {
+	// Number of partition bits p, or AUTO_PARTITION_BITS to choose p from target_partition_bytes.
+	static constexpr uint32_t AUTO_PARTITION_BITS = ~0U;
+	uint32_t partition_bits = AUTO_PARTITION_BITS;
+	size_t target_partition_bytes = PARTITION_TARGET_BYTES;
+	// Threads that build the partitions in Insert, 0 for std::thread::hardware_concurrency().
+	uint32_t num_threads = 1;
+	// Storage of every sub-filter.
+	StorageOptions storage;
+};
+
+// Filter made of 2^p independent sub-filters, selected by the top p bits of the hash: the same bits a radix-partitioned
+// hash join partitions on, so partition i of the build side builds sub-filter i and partition i of the probe side
+// only probes sub-filter i, which stays in the L2 cache instead of every probe being a random access into one large
+// filter.
+//
+// Input that is already partitioned goes to InsertPartition / LookupPartition. Mixed batches go to Insert / Lookup,
+// which radix-partition the batch first and probe it partition by partition.
+//
+// Inside a partition the top p bits are constant, so the sub-filters see the hash multiplied by an odd constant, a
+// bijection that spreads the remaining entropy over all bits the sub-filter uses.
+template <typename Filter, typename HashType = uint64_t>
+class PartitionedFilter {
+public:
+	// Keys partitioned per pass of the mixed-batch Lookup. The scratch keys, row ids and results of a chunk (1 MiB)
+	// and the results it scatters back stay in the L2 cache; in the benchmark smaller chunks gave each partition too
+	// few keys and larger ones spilled the scratch memory.
+	static constexpr uint32_t LOOKUP_CHUNK_SIZE = 1 << 16;
+
+public:
+	PartitionedFilter(size_t n_key, uint32_t n_bits_per_key,
+	                  const PartitionedFilterOptions &options = PartitionedFilterOptions())
+	    : num_threads_(options.num_threads) {
+		partition_bits_ = options.partition_bits;
+		if (partition_bits_ == PartitionedFilterOptions::AUTO_PARTITION_BITS) {
+			partition_bits_ = 0;
+			size_t total_bytes = n_key * n_bits_per_key / 8;
+			while (partition_bits_ < MAX_PARTITION_BITS &&
+			       (total_bytes >> partition_bits_) > options.target_partition_bytes) {
+				partition_bits_++;
+			}
+		}
+		partition_bits_ = std::min(partition_bits_, MAX_PARTITION_BITS);
+		if (num_threads_ == 0) {
+			num_threads_ = std::max(1U, std::thread::hardware_concurrency());
+		}
+
+		// the sub-filters stay quiet, the total is printed once instead
+		StorageOptions partition_storage = options.storage;
+		partition_storage.verbose = false;
+		size_t keys_per_partition = (n_key >> partition_bits_) + 1;
+		for (uint32_t p = 0; p < NumPartitions(); p++) {
+			partitions_.emplace_back(new Filter(keys_per_partition, n_bits_per_key, partition_storage));
+		}
+		if (options.storage.verbose) {
+			std::cout << "BF Size: " << NumPartitions() << " partitions for " << keys_per_partition << " keys each\n";
+		}
+	}
+
+public:
+	inline uint32_t NumPartitions() const {
+		return 1U << partition_bits_;
+	}
+	inline uint32_t PartitionBits() const {
+		return partition_bits_;
+	}
+	// Partition of a hash: its top p bits.
+	inline uint32_t PartitionOf(HashType hash) const {
+		return partition_bits_ == 0 ? 0 : static_cast<uint32_t>(hash >> (HASH_BITS - partition_bits_));
+	}
+	inline Filter &Partition(uint32_t partition) {
+		return *partitions_[partition];
+	}
+
+	// Inserts a mixed batch: the batch is radix-partitioned, then the partitions are built by num_threads threads.
+	void Insert(uint32_t num, HashType *key) {
+		if (partition_bits_ == 0) {
+			return InsertPartition(0, num, key);
+		}
+		std::vector<HashType> partitioned(num);
+		PartitionBatch(num, key, partitioned.data(), nullptr);
+		ForEachPartition([&](uint32_t p) {
+			uint32_t begin = offsets_[p], end = offsets_[p + 1];
+			if (end > begin) {
+				partitions_[p]->Insert(end - begin, partitioned.data() + begin);
+			}
+		});
+	}
+
+	// Inserts keys that all belong to the given partition (PartitionOf). Calls for different partitions may run
+	// concurrently.
+	void InsertPartition(uint32_t partition, uint32_t num, const HashType *key) {
+		HashType mixed[SUB_BATCH_SIZE];
+		for (uint32_t base = 0; base < num; base += SUB_BATCH_SIZE) {
+			uint32_t batch = std::min(SUB_BATCH_SIZE, num - base);
+			Remix(batch, key + base, mixed);
+			partitions_[partition]->Insert(batch, mixed);
+		}
+	}
+
+	// Probes a mixed batch partition by partition, LOOKUP_CHUNK_SIZE keys at a time; out[i] is the result of key[i].
+	uint32_t Lookup(uint32_t num, HashType *key, uint32_t *out) {
+		if (partition_bits_ == 0) {
+			return LookupPartition(0, num, key, out);
+		}
+		uint32_t chunk_size = std::min(num, LOOKUP_CHUNK_SIZE);
+		if (scratch_keys_.size() < chunk_size) {
+			scratch_keys_.resize(chunk_size);
+			scratch_rows_.resize(chunk_size);
+			scratch_results_.resize(chunk_size);
+		}
+		for (uint32_t base = 0; base < num; base += LOOKUP_CHUNK_SIZE) {
+			uint32_t batch = std::min(LOOKUP_CHUNK_SIZE, num - base);
+			PartitionBatch(batch, key + base, scratch_keys_.data(), scratch_rows_.data());
+			for (uint32_t p = 0; p < NumPartitions(); p++) {
+				uint32_t begin = offsets_[p], end = offsets_[p + 1];
+				if (end > begin) {
+					partitions_[p]->Lookup(end - begin, scratch_keys_.data() + begin, scratch_results_.data() + begin);
+				}
+			}
+			uint32_t *chunk_out = out + base;
+			for (uint32_t i = 0; i < batch; i++) {
+				chunk_out[scratch_rows_[i]] = scratch_results_[i];
+			}
+		}
+		return num;
+	}
+
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, HashType *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, HashType *batch_key, uint32_t *out) {
+			LookupDirect(n, batch_key, out);
+		});
+	}
+
+	// Probes keys that all belong to the given partition (PartitionOf). Calls may run concurrently as long as the
+	// sub-filters' Lookup does not write the filter (see FilterSnapshot).
+	uint32_t LookupPartition(uint32_t partition, uint32_t num, const HashType *key, uint32_t *out) {
+		HashType mixed[SUB_BATCH_SIZE];
+		for (uint32_t base = 0; base < num; base += SUB_BATCH_SIZE) {
+			uint32_t batch = std::min(SUB_BATCH_SIZE, num - base);
+			Remix(batch, key + base, mixed);
+			partitions_[partition]->Lookup(batch, mixed, out + base);
+		}
+		return num;
+	}
+
+	void Clear() {
+		for (auto &partition : partitions_) {
+			partition->Clear();
+		}
+	}
+
+private:
+	static constexpr uint32_t HASH_BITS = sizeof(HashType) * 8;
+	// Keys remixed per call of a sub-filter in the already-partitioned paths.
+	static constexpr uint32_t SUB_BATCH_SIZE = 1024;
+	static constexpr HashType MIX = static_cast<HashType>(0x9E3779B97F4A7C15ULL);
+
+	static inline void Remix(uint32_t num, const HashType *BF_RESTRICT key, HashType *BF_RESTRICT out) {
+		for (uint32_t i = 0; i < num; i++) {
+			out[i] = key[i] * MIX;
+		}
+	}
+
+	// Probes key by key without partitioning, for the small batches of the selection-vector overload.
+	void LookupDirect(uint32_t num, const HashType *key, uint32_t *out) {
+		HashType mixed;
+		for (uint32_t i = 0; i < num; i++) {
+			mixed = key[i] * MIX;
+			partitions_[PartitionOf(key[i])]->Lookup(1, &mixed, out + i);
+		}
+	}
+
+	// Radix-partitions key[0, num) into out (remixed), partition p in [offsets_[p], offsets_[p + 1]). With rows set,
+	// rows[j] is the position in key of out[j].
+	void PartitionBatch(uint32_t num, const HashType *BF_RESTRICT key, HashType *BF_RESTRICT out,
+	                    uint32_t *BF_RESTRICT rows) {
+		const uint32_t shift = HASH_BITS - partition_bits_;
+		offsets_.assign(NumPartitions() + 1, 0);
+		uint32_t *BF_RESTRICT counts = offsets_.data() + 1;
+		for (uint32_t i = 0; i < num; i++) {
+			counts[key[i] >> shift]++;
+		}
+		for (uint32_t p = 0; p < NumPartitions(); p++) {
+			offsets_[p + 1] += offsets_[p];
+		}
+		cursors_.assign(offsets_.begin(), offsets_.end() - 1);
+		uint32_t *BF_RESTRICT cursors = cursors_.data();
+		for (uint32_t i = 0; i < num; i++) {
+			uint32_t pos = cursors[key[i] >> shift]++;
+			out[pos] = key[i] * MIX;
+			if (rows != nullptr) {
+				rows[pos] = i;
+			}
+		}
+	}
+
+	// Runs fn(p) for every partition on num_threads_ threads, partitions interleaved over the threads.
+	template <typename Fn>
+	void ForEachPartition(Fn &&fn) {
+		uint32_t num_threads = std::min(num_threads_, NumPartitions());
+		auto work = [&](uint32_t t) {
+			for (uint32_t p = t; p < NumPartitions(); p += num_threads) {
+				fn(p);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (uint32_t t = 1; t < num_threads; t++) {
+			threads.emplace_back(work, t);
+		}
+		work(0);
+		for (auto &thread : threads) {
+			thread.join();
+		}
+	}
+
+	uint32_t partition_bits_;
+	uint32_t num_threads_;
+	std::vector<std::unique_ptr<Filter>> partitions_;
+	// Partition boundaries of the last PartitionBatch, and scratch memory of the mixed-batch Lookup, kept across calls
+	// so that large batches do not fault in fresh pages every time.
+	std::vector<uint32_t> offsets_;
+	std::vector<uint32_t> cursors_;
+	std::vector<HashType> scratch_keys_;
+	std::vector<uint32_t> scratch_rows_;
+	std::vector<uint32_t> scratch_results_;
+};
+} // namespace bloom_filters
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bloom_filters {
+// Events PerfCounters collects.
+enum class PerfEvent : uint8_t {
+	CYCLES,
+	INSTRUCTIONS,
+	BRANCH_MISSES,
+	// L1 data cache read misses.
+	L1D_MISSES,
+	// Last-level cache read misses.
+	LLC_MISSES,
+	// Data TLB read misses.
+	DTLB_MISSES,
+	// Page faults, a software event: counted even where the hardware counters are not (e.g. in a VM without a PMU).
+	PAGE_FAULTS,
+};
+static constexpr uint32_t NUM_PERF_EVENTS = 7;
+
+inline const char *PerfEventName(PerfEvent event) {
+	switch (event) {
+	case PerfEvent::CYCLES: return "core_cycles";
+	case PerfEvent::INSTRUCTIONS: return "instructions";
+	case PerfEvent::BRANCH_MISSES: return "branch_misses";
+	case PerfEvent::L1D_MISSES: return "l1d_misses";
+	case PerfEvent::LLC_MISSES: return "llc_misses";
+	case PerfEvent::DTLB_MISSES: return "dtlb_misses";
+	case PerfEvent::PAGE_FAULTS: return "page_faults";
+	}
+	return "unknown";
+}
+
+// Event counts of one measured region. An event is missing if the kernel or the hardware does not provide it, or if
+// it was never scheduled on a counter during the region.
+struct PerfSample {
+	double value[NUM_PERF_EVENTS] = {};
+	bool valid[NUM_PERF_EVENTS] = {};
+
+	inline bool Has(PerfEvent event) const {
+		return valid[static_cast<uint32_t>(event)];
+	}
+	inline double Get(PerfEvent event) const {
+		return value[static_cast<uint32_t>(event)];
+	}
+	// Count per tuple, or -1 if the event is missing.
+	inline double PerTuple(PerfEvent event, size_t num_tuples) const {
+		return Has(event) && num_tuples > 0 ? Get(event) / static_cast<double>(num_tuples) : -1;
+	}
+};
+
+// Hardware performance counters of the calling thread (and the threads it creates afterwards), read with Linux
+// perf_event_open. Each event has a counter of its own, so an event the CPU lacks does not take the others down; when
+// there are more events than hardware counters the kernel multiplexes them and the counts are scaled by the time each
+// one ran.
+//
+// Without perf_event_open (another OS, a container with perf_event_open blocked, or kernel.perf_event_paranoid > 2) no
+// counter opens: Available() is false, Error() says why, and Start / Stop cost nothing and return an empty sample. A VM
+// without a virtual PMU only has the software event PAGE_FAULTS.
+class PerfCounters {
+public:
+	// With open = false no counter is opened, so Start and Stop do nothing.
+	explicit PerfCounters(bool open = true) {
+		if (!open) {
+			error_ = "disabled";
+			return;
+		}
+#if defined(__linux__)
+		for (uint32_t e = 0; e < NUM_PERF_EVENTS; e++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			Describe(static_cast<PerfEvent>(e), attr);
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds_[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+			if (fds_[e] < 0 && error_.empty()) {
+				error_ = std::string("perf_event_open(") + PerfEventName(static_cast<PerfEvent>(e)) +
+				         "): " + std::strerror(errno);
+			}
+		}
+#else
+		error_ = "perf_event_open is only available on Linux";
+#endif
+	}
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+	~PerfCounters() {
+#if defined(__linux__)
+		for (int fd : fds_) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	// Whether any event could be opened.
+	inline bool Available() const {
+		for (int fd : fds_) {
+			if (fd >= 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+	inline bool Available(PerfEvent event) const {
+		return fds_[static_cast<uint32_t>(event)] >= 0;
+	}
+	// Why the first event that failed to open did, empty if all opened.
+	inline const std::string &Error() const {
+		return error_;
+	}
+
+	// Zeroes and starts all counters.
+	void Start() {
+#if defined(__linux__)
+		for (int fd : fds_) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	// Stops all counters and returns the counts since Start.
+	PerfSample Stop() {
+		PerfSample sample;
+#if defined(__linux__)
+		for (int fd : fds_) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+		for (uint32_t e = 0; e < NUM_PERF_EVENTS; e++) {
+			// value, time enabled, time running
+			uint64_t data[3];
+			if (fds_[e] < 0 || read(fds_[e], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) ||
+			    data[2] == 0) {
+				continue;
+			}
+			sample.value[e] =
+			    static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+			sample.valid[e] = true;
+		}
+#endif
+		return sample;
+	}
+
+private:
+#if defined(__linux__)
+	static void Describe(PerfEvent event, perf_event_attr &attr) {
+		auto cache = [&attr](uint64_t cache_id) {
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = cache_id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		};
+		switch (event) {
+		case PerfEvent::CYCLES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		case PerfEvent::INSTRUCTIONS:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case PerfEvent::BRANCH_MISSES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+		case PerfEvent::L1D_MISSES:
+			cache(PERF_COUNT_HW_CACHE_L1D);
+			break;
+		case PerfEvent::LLC_MISSES:
+			cache(PERF_COUNT_HW_CACHE_LL);
+			break;
+		case PerfEvent::DTLB_MISSES:
+			cache(PERF_COUNT_HW_CACHE_DTLB);
+			break;
+		case PerfEvent::PAGE_FAULTS:
+			attr.type = PERF_TYPE_SOFTWARE;
+			attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+			break;
+		}
+	}
+#endif
+
+	int fds_[NUM_PERF_EVENTS] = {-1, -1, -1, -1, -1, -1, -1};
+	std::string error_;
+};
+
+// Counts the events of a scope (a benchmark phase or any probe region) into sample:
+//
+//   PerfSample sample;
+//   {
+//       PerfRegion region(counters, sample);
+//       bf.Lookup(num, hashes, out);
+//   }
+//   double misses_per_key = sample.PerTuple(PerfEvent::LLC_MISSES, num);
+class PerfRegion {
+public:
+	PerfRegion(PerfCounters &counters, PerfSample &sample) : counters_(counters), sample_(sample) {
+		counters_.Start();
+	}
+	PerfRegion(const PerfRegion &) = delete;
+	PerfRegion &operator=(const PerfRegion &) = delete;
+	~PerfRegion() {
+		sample_ = counters_.Stop();
+	}
+
+private:
+	PerfCounters &counters_;
+	PerfSample &sample_;
+};
+} // namespace bloom_filters
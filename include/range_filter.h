@@ -0,0 +1,254 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+#include "hash_functions.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bloom_filters {
+struct RangeFilterOptions {
+	// Prefix levels 0..max_level are stored: level l holds key >> l of every key, so ranges up to 2^(max_level + 1)
+	// wide are covered by at most two intervals per level.
+	uint32_t max_level = 20;
+	// A range whose dyadic cover needs more intervals than this (i.e. is much wider than 2^max_level) is not probed
+	// and reported as possibly non-empty.
+	uint32_t max_cover = 64;
+	// Whether an interval that passes is confirmed by descending to its children, level by level down to level 0
+	// (see RangeFilter). Without it a range passes as soon as one interval of its cover passes.
+	bool descend = true;
+	// A range that has more passing intervals than this in one round of the descent is reported as non-empty
+	// without descending further: that many false positives at once are far less likely than a range full of keys.
+	uint32_t max_frontier = 8;
+	// Storage of the underlying filter.
+	StorageOptions storage;
+};
+
+// Range filter over 64-bit integer keys: answers "may any key lie in [lo, hi]?" with no false negatives. It stores
+// the dyadic prefixes of every key, key >> l for l in [0, max_level], in one point filter (any of the blocked filters
+// on 64-bit hashes), each prefix hashed together with its level. A range is split into its dyadic cover, the at most
+// two aligned intervals per level that tile it, and each interval is one point probe of its prefix.
+//
+// With the cover alone every interval is a chance for a false positive, so the false-positive rate grows with the
+// number of levels the range spans. With descend, an interval that passes at level l > 0 is only believed if one of
+// its two halves passes at level l - 1, recursively down to the keys themselves: a false positive at level l now
+// needs l more of them below it, so the false-positive rate of a range is about that of its level-0 intervals,
+// whatever its width (the idea of Rosetta, Luo et al., SIGMOD 2020).
+//
+// Lookup probes a batch of ranges round by round: every round hashes the open intervals of all ranges in the batch
+// together (HashVector) and probes them with one Lookup of the point filter, so the SIMD kernels of the filter see
+// full batches whatever the level or the range. A range drops out of the rounds as soon as it has an answer.
+template <typename Filter>
+class RangeFilter {
+public:
+	static constexpr uint32_t MAX_LEVEL = 63;
+	// Ranges resolved together by Lookup, and keys inserted per batch.
+	static constexpr uint32_t BATCH_SIZE = 1024;
+
+public:
+	// n_bits_per_key is spent on every level, so the filter takes (max_level + 1) * n_bits_per_key bits per key.
+	RangeFilter(size_t n_key, uint32_t n_bits_per_key, const RangeFilterOptions &options = RangeFilterOptions())
+	    : options_(options), filter_(std::max<size_t>(1, n_key) * (std::min(options.max_level, MAX_LEVEL) + 1),
+	                                 n_bits_per_key, options.storage) {
+		options_.max_level = std::min(options_.max_level, MAX_LEVEL);
+		options_.max_cover = std::max(options_.max_cover, 1U);
+		options_.max_frontier = std::max(options_.max_frontier, 1U);
+	}
+
+public:
+	void Insert(size_t num, const uint64_t *key) {
+		uint64_t prefixes[BATCH_SIZE];
+		uint64_t hashes[BATCH_SIZE];
+		for (size_t base = 0; base < num; base += BATCH_SIZE) {
+			uint32_t batch = static_cast<uint32_t>(std::min<size_t>(BATCH_SIZE, num - base));
+			for (uint32_t level = 0; level <= options_.max_level; level++) {
+				const uint64_t seed = LevelSeed(level);
+				for (uint32_t i = 0; i < batch; i++) {
+					prefixes[i] = (key[base + i] >> level) ^ seed;
+				}
+				HashVector(batch, prefixes, hashes);
+				filter_.Insert(batch, hashes);
+			}
+		}
+	}
+
+	// out[i] = 1 if a key may lie in [lo[i], hi[i]] (both inclusive), 0 if none does. An empty range (lo > hi) is 0.
+	void Lookup(size_t num, const uint64_t *lo, const uint64_t *hi, uint32_t *out) {
+		for (size_t base = 0; base < num; base += BATCH_SIZE) {
+			uint32_t batch = static_cast<uint32_t>(std::min<size_t>(BATCH_SIZE, num - base));
+			LookupBatch(batch, lo + base, hi + base, out + base);
+		}
+	}
+
+	inline bool MayContain(uint64_t lo, uint64_t hi) {
+		uint32_t out;
+		Lookup(1, &lo, &hi, &out);
+		return out != 0;
+	}
+
+	inline void Clear() {
+		filter_.Clear();
+	}
+
+	inline Filter &Inner() {
+		return filter_;
+	}
+	inline const RangeFilterOptions &Options() const {
+		return options_;
+	}
+	// Point probes made by Lookup since the last ResetCounters.
+	inline uint64_t NumProbes() const {
+		return num_probes_;
+	}
+	inline void ResetCounters() {
+		num_probes_ = 0;
+	}
+
+	// Number of intervals of the dyadic cover of [lo, hi] with levels up to max_level, at most limit + 1.
+	static uint32_t CoverSize(uint64_t lo, uint64_t hi, uint32_t max_level, uint32_t limit) {
+		uint32_t count = 0;
+		ForEachCoverInterval(lo, hi, max_level, [&count, limit](uint64_t, uint32_t) { return ++count <= limit; });
+		return count;
+	}
+
+private:
+	// Mixed into every prefix of a level before hashing, so that the same prefix on two levels hashes differently.
+	static inline uint64_t LevelSeed(uint32_t level) {
+		return (level + 1ULL) * MULTIPLY_SHIFT_CONSTANT;
+	}
+
+	// Calls fn(prefix, level) for the intervals of the dyadic cover of [lo, hi], left to right, each the largest
+	// aligned interval that starts at the end of the previous one and ends by hi; stops early when fn returns false.
+	template <typename Fn>
+	static inline void ForEachCoverInterval(uint64_t lo, uint64_t hi, uint32_t max_level, Fn &&fn) {
+		uint64_t x = lo;
+		while (true) {
+			uint32_t level = x == 0 ? max_level : std::min<uint32_t>(max_level, __builtin_ctzll(x));
+			while (level > 0 && hi - x < (1ULL << level) - 1) {
+				level--;
+			}
+			uint64_t last = x + ((1ULL << level) - 1);
+			if (!fn(x >> level, level) || last >= hi) {
+				return;
+			}
+			x = last + 1;
+		}
+	}
+
+	void LookupBatch(uint32_t num, const uint64_t *lo, const uint64_t *hi, uint32_t *out) {
+		// open intervals: range, level and prefix
+		range_.clear();
+		level_.clear();
+		prefix_.clear();
+		for (uint32_t r = 0; r < num; r++) {
+			out[r] = 0;
+			if (lo[r] > hi[r]) {
+				continue;
+			}
+			size_t first = range_.size();
+			bool too_wide = false;
+			ForEachCoverInterval(lo[r], hi[r], options_.max_level, [&](uint64_t prefix, uint32_t level) {
+				if (range_.size() - first == options_.max_cover) {
+					too_wide = true;
+					return false;
+				}
+				range_.push_back(r);
+				level_.push_back(level);
+				prefix_.push_back(prefix);
+				return true;
+			});
+			if (too_wide) {
+				out[r] = 1;
+				range_.resize(first);
+				level_.resize(first);
+				prefix_.resize(first);
+			}
+		}
+
+		while (!range_.empty()) {
+			size_t n = range_.size();
+			mixed_.resize(n);
+			hashes_.resize(n);
+			pass_.resize(n);
+			for (size_t i = 0; i < n; i++) {
+				mixed_[i] = prefix_[i] ^ LevelSeed(level_[i]);
+			}
+			HashVector(n, mixed_.data(), hashes_.data());
+			for (size_t base = 0; base < n; base += BATCH_SIZE) {
+				uint32_t batch = static_cast<uint32_t>(std::min<size_t>(BATCH_SIZE, n - base));
+				filter_.Lookup(batch, hashes_.data() + base, pass_.data() + base);
+			}
+			num_probes_ += n;
+
+			// the intervals that passed either answer their range or open their two halves for the next round
+			next_range_.clear();
+			next_level_.clear();
+			next_prefix_.clear();
+			for (size_t i = 0; i < n; i++) {
+				uint32_t r = range_[i];
+				if (!pass_[i] || out[r]) {
+					continue;
+				}
+				if (level_[i] == 0 || !options_.descend) {
+					out[r] = 1;
+					continue;
+				}
+				for (uint64_t half = 0; half < 2; half++) {
+					next_range_.push_back(r);
+					next_level_.push_back(level_[i] - 1);
+					next_prefix_.push_back((prefix_[i] << 1) | half);
+				}
+			}
+			range_.swap(next_range_);
+			level_.swap(next_level_);
+			prefix_.swap(next_prefix_);
+			DropCrowdedRanges(out);
+		}
+	}
+
+	// Answers the ranges with more than max_frontier passing intervals (twice as many open halves), and removes the
+	// intervals of answered ranges. The intervals of a range are adjacent: they are opened in the order of the ranges.
+	void DropCrowdedRanges(uint32_t *out) {
+		size_t n = range_.size();
+		size_t i = 0;
+		while (i < n) {
+			size_t end = i;
+			while (end < n && range_[end] == range_[i]) {
+				end++;
+			}
+			if (end - i > 2 * options_.max_frontier) {
+				out[range_[i]] = 1;
+			}
+			i = end;
+		}
+		size_t kept = 0;
+		for (i = 0; i < n; i++) {
+			if (!out[range_[i]]) {
+				range_[kept] = range_[i];
+				level_[kept] = level_[i];
+				prefix_[kept] = prefix_[i];
+				kept++;
+			}
+		}
+		range_.resize(kept);
+		level_.resize(kept);
+		prefix_.resize(kept);
+	}
+
+	RangeFilterOptions options_;
+	Filter filter_;
+	std::vector<uint32_t> range_;
+	std::vector<uint32_t> level_;
+	std::vector<uint64_t> prefix_;
+	std::vector<uint32_t> next_range_;
+	std::vector<uint32_t> next_level_;
+	std::vector<uint64_t> next_prefix_;
+	std::vector<uint64_t> mixed_;
+	std::vector<uint64_t> hashes_;
+	std::vector<uint32_t> pass_;
+	uint64_t num_probes_ = 0;
+};
+} // namespace bloom_filters
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
 
 #include <cmath>
 #include <cstddef>
@@ -14,16 +16,21 @@ class RegisterBlockedBF2x32Bit {
 public:
 	const uint64_t MAX_NUM_BLOCKS = (1ULL << 31);
 	static constexpr auto MIN_NUM_BITS = 512;
+	// 5 bits in one 32-bit word
+	static constexpr FilterGeometry GEOMETRY = {32, 1, 1, 5};
 
 public:
-	explicit RegisterBlockedBF2x32Bit(size_t n_key, uint32_t n_bits_per_key) {
+	explicit RegisterBlockedBF2x32Bit(size_t n_key, uint32_t n_bits_per_key,
+	                                  const StorageOptions &storage = StorageOptions()) {
 		uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
 		num_blocks = (min_bits >> 5) + 1;
 		num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
 		num_blocks = std::min(static_cast<uint64_t>(1ULL << num_blocks_log), MAX_NUM_BLOCKS);
 
-		blocks.resize(num_blocks);
-		std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		blocks.Allocate(num_blocks, storage);
+		if (storage.verbose) {
+			std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		}
 	}
 
 public:
@@ -31,10 +38,44 @@ public:
 		InsertInternal(num, key, blocks.data());
 	}
 
+	// Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+	inline void Clear() {
+		blocks.Clear();
+	}
+
+	// The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+	inline BlockArray<uint32_t> &Blocks() {
+		return blocks;
+	}
+	inline const BlockArray<uint32_t> &Blocks() const {
+		return blocks;
+	}
+
+	// Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+	inline FilterStats Stats(uint32_t num_threads = 1) const {
+		return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+	}
+
 	inline uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out) {
 		return LookupInternal(num, key, blocks.data(), out);
 	}
 
+	// Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+	inline bool LookupOne(uint64_t key) const {
+		uint32_t mask = GetMask(static_cast<uint32_t>(key));
+		return (blocks[GetBlock(key >> 32)] & mask) == mask;
+	}
+	inline void InsertOne(uint64_t key) {
+		blocks[GetBlock(key >> 32)] |= GetMask(static_cast<uint32_t>(key));
+	}
+
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint64_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint64_t *batch_key, uint32_t *out) {
+			LookupInternal(n, batch_key, blocks.data(), out);
+		});
+	}
+
 public:
 	uint32_t LookupInternal(uint32_t num, uint64_t *BF_RESTRICT key, uint32_t *BF_RESTRICT bf,
 	                        uint32_t *BF_RESTRICT out) const {
@@ -65,8 +106,17 @@ public:
 	}
 
 private:
+	// key_high |31:block|1:unused| and key_low |7:unused|5:bit5|5:bit4|5:bit3|5:bit2|5:bit1| bit layout (64:total)
+	inline uint32_t GetBlock(uint32_t key_high) const {
+		return (key_high >> 1) & (num_blocks - 1);
+	}
+	static inline uint32_t GetMask(uint32_t key_low) {
+		return (1 << (key_low & 31)) | (1 << ((key_low >> 5) & 31)) | (1 << ((key_low >> 10) & 31)) |
+		       (1 << ((key_low >> 15) & 31)) | (1 << ((key_low >> 20) & 31));
+	}
+
 	uint32_t num_blocks;
 	uint32_t num_blocks_log;
-	std::vector<uint32_t> blocks;
+	BlockArray<uint32_t> blocks;
 };
 } // namespace bloom_filters
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
 
 #include <cmath>
 #include <cstring>
@@ -13,16 +15,21 @@ class RegisterBlockedBF32Bit {
 public:
 	const uint32_t MAX_NUM_BLOCKS = (1 << 17);
 	static constexpr auto MIN_NUM_BITS = 512;
+	// 3 bits in one 32-bit word
+	static constexpr FilterGeometry GEOMETRY = {32, 1, 1, 3};
 
 public:
-	explicit RegisterBlockedBF32Bit(size_t n_key, uint32_t n_bits_per_key) {
+	explicit RegisterBlockedBF32Bit(size_t n_key, uint32_t n_bits_per_key,
+	                                const StorageOptions &storage = StorageOptions()) {
 		uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
 		num_blocks = (min_bits >> 5) + 1;
 		num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
 		num_blocks = std::min(1U << num_blocks_log, MAX_NUM_BLOCKS);
 
-		blocks.resize(num_blocks);
-		std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		blocks.Allocate(num_blocks, storage);
+		if (storage.verbose) {
+			std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		}
 	}
 
 public:
@@ -30,16 +37,50 @@ public:
 		InsertInternal(num, key, blocks.data());
 	}
 
+	// Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+	inline void Clear() {
+		blocks.Clear();
+	}
+
+	// The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+	inline BlockArray<uint32_t> &Blocks() {
+		return blocks;
+	}
+	inline const BlockArray<uint32_t> &Blocks() const {
+		return blocks;
+	}
+
+	// Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+	inline FilterStats Stats(uint32_t num_threads = 1) const {
+		return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+	}
+
 	inline uint32_t Lookup(uint32_t num, uint32_t *key, uint32_t *out) {
 		return LookupInternal(num, key, blocks.data(), out);
 	}
 
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint32_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint32_t *batch_key, uint32_t *out) {
+			LookupInternal(n, batch_key, blocks.data(), out);
+		});
+	}
+
+	// Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+	inline bool LookupOne(uint32_t key) const {
+		uint32_t mask = GetMask(key);
+		return (blocks[GetBlock(key)] & mask) == mask;
+	}
+	inline void InsertOne(uint32_t key) {
+		blocks[GetBlock(key)] |= GetMask(key);
+	}
+
 public:
 	uint32_t LookupInternal(uint32_t num, uint32_t *BF_RESTRICT key, uint32_t *BF_RESTRICT bf,
 	                        uint32_t *BF_RESTRICT out) const {
 		for (uint32_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 15) & (num_blocks - 1);
-			uint32_t mask = (1 << (key[i] & 31)) | (1 << ((key[i] >> 5) & 31)) | (1 << ((key[i] >> 10) & 31));
+			uint32_t block = GetBlock(key[i]);
+			uint32_t mask = GetMask(key[i]);
 			out[i] = (bf[block] & mask) == mask;
 		}
 		return num;
@@ -47,15 +88,21 @@ public:
 
 	void InsertInternal(uint32_t num, uint32_t *BF_RESTRICT key, uint32_t *BF_RESTRICT bf) const {
 		for (uint32_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 15) & (num_blocks - 1);
-			uint32_t mask = (1 << (key[i] & 31)) | (1 << ((key[i] >> 5) & 31)) | (1 << ((key[i] >> 10) & 31));
-			bf[block] |= mask;
+			bf[GetBlock(key[i])] |= GetMask(key[i]);
 		}
 	}
 
 private:
+	// key |17:block|5:bit3|5:bit2|5:bit1| bit layout (32:total)
+	inline uint32_t GetBlock(uint32_t key) const {
+		return (key >> 15) & (num_blocks - 1);
+	}
+	static inline uint32_t GetMask(uint32_t key) {
+		return (1 << (key & 31)) | (1 << ((key >> 5) & 31)) | (1 << ((key >> 10) & 31));
+	}
+
 	uint32_t num_blocks;
 	uint32_t num_blocks_log;
-	std::vector<uint32_t> blocks;
+	BlockArray<uint32_t> blocks;
 };
 } // namespace bloom_filters
\ No newline at end of file
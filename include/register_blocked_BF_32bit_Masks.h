@@ -1,118 +1,41 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "bloom_filter_masks.h"
+#include "filter_stats.h"
 
 #include <cmath>
 #include <cstring>
 #include <cstdint>
 #include <iostream>
 #include <vector>
-#include <random>
 
 namespace bloom_filters {
-struct BloomFilterMasks32 {
-	BloomFilterMasks32() {
-		std::seed_seq seed {0, 0, 0, 0, 0, 0, 0, 0};
-		std::mt19937 re(seed);
-		std::uniform_int_distribution<uint32_t> rd;
-
-		auto random = [&re, &rd](uint32_t min_value, uint32_t max_value) {
-			return min_value + rd(re) % (max_value - min_value + 1);
-		};
-
-		std::memset(masks_, 0, kTotalBytes);
-
-		uint32_t num_bits_set = random(kMinBitsSet, kMaxBitsSet);
-		for (uint32_t i = 0; i < num_bits_set; i++) {
-			while (true) {
-				uint32_t bit_pos = random(0, kBitsPerMask - 1);
-				if (!GetBit(masks_, bit_pos)) {
-					SetBit(masks_, bit_pos);
-					break;
-				}
-			}
-		}
-
-		uint32_t num_bits_total = kNumMasks + kBitsPerMask - 1;
-		for (uint32_t i = kBitsPerMask; i < num_bits_total; i++) {
-			int bit_leaving = GetBit(masks_, i - kBitsPerMask) ? 1 : 0;
-			if (bit_leaving == 1 && num_bits_set == kMinBitsSet) {
-				SetBit(masks_, i);
-				continue;
-			}
-			if (bit_leaving == 0 && num_bits_set == kMaxBitsSet) {
-				continue;
-			}
-			if (random(0, kBitsPerMask * 2 - 1) < kMinBitsSet + kMaxBitsSet) {
-				SetBit(masks_, i);
-				if (bit_leaving == 0) {
-					++num_bits_set;
-				}
-			} else {
-				if (bit_leaving == 1) {
-					--num_bits_set;
-				}
-			}
-		}
-	}
-
-	uint32_t Mask(uint32_t hash) const {
-		int mask_id = static_cast<int>(hash & (kNumMasks - 1));
-		uint32_t result = GetMask(mask_id);
-
-		int rotation = static_cast<int>((hash >> kLogNumMasks) & 31);
-		result = ROTL32(result, rotation);
-		return result;
-	}
-
-	static constexpr int kBitsPerMask = 25;
-	static constexpr uint32_t kFullMask = (1U << kBitsPerMask) - 1;
-
-	static constexpr int kMinBitsSet = 4;
-	static constexpr int kMaxBitsSet = 5;
-
-	static constexpr int kLogNumMasks = 10;
-	static constexpr int kNumMasks = 1 << kLogNumMasks;
-
-	static constexpr int kTotalBytes = (kNumMasks + 32) / 8;
-	uint8_t masks_[kTotalBytes];
-
-private:
-	bool GetBit(const uint8_t *data, uint32_t bit_pos) const {
-		return (data[bit_pos / 8] >> (bit_pos % 8)) & 1;
-	}
-
-	void SetBit(uint8_t *data, uint32_t bit_pos) {
-		data[bit_pos / 8] |= (1 << (bit_pos % 8));
-	}
-
-	uint32_t ROTL32(uint32_t x, int r) const {
-		return (x << r) | (x >> ((32 - r) & 31));
-	}
-
-	uint32_t GetMask(int bit_offset) const {
-		uint32_t value;
-		std::memcpy(&value, masks_ + bit_offset / 8, sizeof(uint32_t));
-		return (value >> (bit_offset % 8)) & kFullMask;
-	}
-};
-
-const static BloomFilterMasks32 masks32_;
+// 4 or 5 bits per mask, 2^10 masks: the hash bits above the mask id and rotation pick the block.
+using BloomFilterMasks32 = BloomFilterMaskTable<uint32_t, 4, 5, 10>;
+inline constexpr const BloomFilterMasks32 &masks32_ = BLOOM_FILTER_MASKS<uint32_t, 4, 5, 10>;
 
 class RegisterBlockedBF32BitMasks {
 public:
 	const uint32_t MAX_NUM_BLOCKS = (1 << 17);
 	static constexpr auto MIN_NUM_BITS = 512;
+	// a mask of 4 or 5 distinct bits (4.5 on average) in one 32-bit word, which sets as many bits as 4.75 bits drawn
+	// with replacement
+	static constexpr FilterGeometry GEOMETRY = {32, 1, 1, 4.75};
 
 public:
-	explicit RegisterBlockedBF32BitMasks(size_t n_key, uint32_t n_bits_per_key) {
+	explicit RegisterBlockedBF32BitMasks(size_t n_key, uint32_t n_bits_per_key,
+	                                     const StorageOptions &storage = StorageOptions()) {
 		uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
 		num_blocks = (min_bits >> 5) + 1;
 		num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
 		num_blocks = std::min(1U << num_blocks_log, MAX_NUM_BLOCKS);
 
-		blocks.resize(num_blocks);
-		std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		blocks.Allocate(num_blocks, storage);
+		if (storage.verbose) {
+			std::cout << "BF Size: " << num_blocks * 4 / 1024 << " KiB\n";
+		}
 	}
 
 public:
@@ -120,15 +43,49 @@ public:
 		InsertInternal(num, key, blocks.data());
 	}
 
+	// Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+	inline void Clear() {
+		blocks.Clear();
+	}
+
+	// The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+	inline BlockArray<uint32_t> &Blocks() {
+		return blocks;
+	}
+	inline const BlockArray<uint32_t> &Blocks() const {
+		return blocks;
+	}
+
+	// Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+	inline FilterStats Stats(uint32_t num_threads = 1) const {
+		return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+	}
+
 	inline uint32_t Lookup(uint32_t num, uint32_t *key, uint32_t *out) {
 		return LookupInternal(num, key, blocks.data(), out);
 	}
 
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint32_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint32_t *batch_key, uint32_t *out) {
+			LookupInternal(n, batch_key, blocks.data(), out);
+		});
+	}
+
+	// Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+	inline bool LookupOne(uint32_t key) const {
+		uint32_t mask = masks32_.Mask(key);
+		return (blocks[GetBlock(key)] & mask) == mask;
+	}
+	inline void InsertOne(uint32_t key) {
+		blocks[GetBlock(key)] |= masks32_.Mask(key);
+	}
+
 public:
 	uint32_t LookupInternal(uint32_t num, uint32_t *BF_RESTRICT key, uint32_t *BF_RESTRICT bf,
 	                        uint32_t *BF_RESTRICT out) const {
 		for (uint32_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 15) & (num_blocks - 1);
+			uint32_t block = GetBlock(key[i]);
 			uint32_t mask = masks32_.Mask(key[i]);
 			out[i] = (bf[block] & mask) == mask;
 		}
@@ -137,15 +94,19 @@ public:
 
 	void InsertInternal(uint32_t num, uint32_t *BF_RESTRICT key, uint32_t *BF_RESTRICT bf) const {
 		for (uint32_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 15) & (num_blocks - 1);
+			uint32_t block = GetBlock(key[i]);
 			uint32_t mask = masks32_.Mask(key[i]);
 			bf[block] |= mask;
 		}
 	}
 
 private:
+	inline uint32_t GetBlock(uint32_t key) const {
+		return (key >> 15) & (num_blocks - 1);
+	}
+
 	uint32_t num_blocks;
 	uint32_t num_blocks_log;
-	std::vector<uint32_t> blocks;
+	BlockArray<uint32_t> blocks;
 };
 } // namespace bloom_filters
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "base.h"
+#include "block_array.h"
+#include "filter_stats.h"
+#include "bulk_insert.h"
 
 #include <cmath>
 #include <cstddef>
@@ -14,52 +17,109 @@ class RegisterBlockedBF64Bit {
 public:
 	const uint64_t MAX_NUM_BLOCKS = (1ULL << 40);
 	static constexpr auto MIN_NUM_BITS = 512;
+	// 6 bits in one 64-bit word
+	static constexpr FilterGeometry GEOMETRY = {64, 1, 1, 6};
 
 public:
-	explicit RegisterBlockedBF64Bit(size_t n_key, uint32_t n_bits_per_key) {
+	explicit RegisterBlockedBF64Bit(size_t n_key, uint32_t n_bits_per_key,
+	                                const StorageOptions &storage = StorageOptions()) {
 		uint32_t min_bits = std::max<uint32_t>(MIN_NUM_BITS, n_key * n_bits_per_key);
 		num_blocks = (min_bits >> 6) + 1;
 		num_blocks_log = static_cast<uint32_t>(std::log2(num_blocks)) + 1;
 		num_blocks = std::min(static_cast<uint64_t>(1ULL << num_blocks_log), MAX_NUM_BLOCKS);
 
-		blocks.resize(num_blocks);
-		std::cout << "BF Size: " << num_blocks * 8 / 1024 << " KiB\n";
+		blocks.Allocate(num_blocks, storage);
+		if (storage.verbose) {
+			std::cout << "BF Size: " << num_blocks * 8 / 1024 << " KiB\n";
+		}
 	}
 
 public:
+	// Large filters are built bucket by bucket (see BucketedInsert).
 	inline void Insert(size_t num, uint64_t *key) {
-		InsertInternal(num, key, blocks.data());
+		uint32_t fanout_log = BulkInsertFanoutLog(num_blocks * sizeof(uint64_t), num, bulk_insert_mode);
+		if (fanout_log == 0) {
+			InsertInternal(num, key, blocks.data());
+			return;
+		}
+		uint32_t shift = __builtin_ctzll(num_blocks) - fanout_log;
+		BucketedInsert(
+		    num, key, fanout_log,
+		    [this, shift](uint64_t k) { return static_cast<uint32_t>(GetBlock(k) >> shift); },
+		    [this](size_t n, uint64_t *bucket_key) { InsertInternal(n, bucket_key, blocks.data()); });
+	}
+
+	// Removes all keys; a lazily mapped filter gives its pages back to the kernel (see BlockArray::Clear).
+	inline void Clear() {
+		blocks.Clear();
+	}
+
+	// The filter's blocks, e.g. to ship the filter to another node (see filter_codec.h).
+	inline BlockArray<uint64_t> &Blocks() {
+		return blocks;
+	}
+	inline const BlockArray<uint64_t> &Blocks() const {
+		return blocks;
+	}
+
+	// Fill ratio, sector occupancy, estimated false-positive rate and number of keys (see ComputeFilterStats).
+	inline FilterStats Stats(uint32_t num_threads = 1) const {
+		return ComputeFilterStats(blocks, GEOMETRY, num_threads);
+	}
+
+	inline void SetBulkInsertMode(BulkInsertMode mode) {
+		bulk_insert_mode = mode;
 	}
 
 	inline size_t Lookup(size_t num, uint64_t *key, uint32_t *out) {
 		return LookupInternal(num, key, blocks.data(), out);
 	}
 
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint64_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out, [this](uint32_t n, uint64_t *batch_key, uint32_t *out) {
+			LookupInternal(n, batch_key, blocks.data(), out);
+		});
+	}
+
+	// Point probe and insert of one key, without the batch loop (see small_batch_lookup.h).
+	inline bool LookupOne(uint64_t key) const {
+		uint64_t mask = GetMask(key);
+		return (blocks[GetBlock(key)] & mask) == mask;
+	}
+	inline void InsertOne(uint64_t key) {
+		blocks[GetBlock(key)] |= GetMask(key);
+	}
+
 public:
 	void InsertInternal(size_t num, uint64_t *BF_RESTRICT key, uint64_t *BF_RESTRICT bf) const {
 		for (size_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 40) & (num_blocks - 1);
-			uint64_t mask = (1ULL << (key[i] & 63)) | (1ULL << ((key[i] >> 6) & 63)) | (1ULL << ((key[i] >> 12) & 63)) |
-			                (1ULL << ((key[i] >> 18) & 63)) | (1ULL << ((key[i] >> 24) & 63)) |
-			                (1ULL << ((key[i] >> 32) & 63));
-			bf[block] |= mask;
+			bf[GetBlock(key[i])] |= GetMask(key[i]);
 		}
 	}
 	size_t LookupInternal(size_t num, uint64_t *BF_RESTRICT key, uint64_t *BF_RESTRICT bf,
 	                      uint32_t *BF_RESTRICT out) const {
 		for (size_t i = 0; i < num; i++) {
-			uint32_t block = (key[i] >> 40) & (num_blocks - 1);
-			uint64_t mask = (1ULL << (key[i] & 63)) | (1ULL << ((key[i] >> 6) & 63)) | (1ULL << ((key[i] >> 12) & 63)) |
-			                (1ULL << ((key[i] >> 18) & 63)) | (1ULL << ((key[i] >> 24) & 63)) |
-			                (1ULL << ((key[i] >> 32) & 63));
+			uint32_t block = GetBlock(key[i]);
+			uint64_t mask = GetMask(key[i]);
 			out[i] = (bf[block] & mask) == mask;
 		}
 		return num;
 	}
 
 private:
+	// key |24:block|2:unused|6:bit6|2:unused|6:bit5|6:bit4|6:bit3|6:bit2|6:bit1| bit layout (64:total)
+	inline uint32_t GetBlock(uint64_t key) const {
+		return (key >> 40) & (num_blocks - 1);
+	}
+	static inline uint64_t GetMask(uint64_t key) {
+		return (1ULL << (key & 63)) | (1ULL << ((key >> 6) & 63)) | (1ULL << ((key >> 12) & 63)) |
+		       (1ULL << ((key >> 18) & 63)) | (1ULL << ((key >> 24) & 63)) | (1ULL << ((key >> 32) & 63));
+	}
+
 	uint64_t num_blocks;
 	uint64_t num_blocks_log;
-	std::vector<uint64_t> blocks;
+	BlockArray<uint64_t> blocks;
+	BulkInsertMode bulk_insert_mode = BulkInsertMode::AUTO;
 };
 } // namespace bloom_filters
\ No newline at end of file
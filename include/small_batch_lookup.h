@@ -0,0 +1,45 @@
+#pragma once
+
+#include "base.h"
+
+#include <cstdint>
+#include <utility>
+
+namespace bloom_filters {
+// Largest batch that LookupSmall probes with code of its own; larger batches go to the filter's Lookup.
+static constexpr uint32_t MAX_SMALL_BATCH = 8;
+
+template <typename Filter, typename HashType, uint32_t... I>
+inline void LookupUnrolled(const Filter &bf, const HashType *key, uint32_t *out,
+                           std::integer_sequence<uint32_t, I...>) {
+	((out[I] = bf.LookupOne(key[I])), ...);
+}
+
+// Probes exactly N keys (1 <= N <= MAX_SMALL_BATCH) with the filter's LookupOne, unrolled at compile time: the N probes
+// are independent loads that the CPU overlaps, and none of the setup of the batch Lookup runs (SIMD batches of 16 or
+// 32 keys with a scalar tail, the alignment prologue of NewCacheSectorizedBF32Bit, the probe kernel switch), which a
+// handful of keys never amortizes.
+template <uint32_t N, typename Filter, typename HashType>
+inline void LookupFixed(const Filter &bf, const HashType *key, uint32_t *out) {
+	static_assert(N >= 1 && N <= MAX_SMALL_BATCH, "LookupFixed probes 1 to MAX_SMALL_BATCH keys");
+	LookupUnrolled(bf, key, out, std::make_integer_sequence<uint32_t, N>());
+}
+
+// Probes num keys for callers with few keys per call (point lookups, OLTP-style probes): 1 to MAX_SMALL_BATCH keys
+// with the LookupFixed of that size, more with the filter's batch Lookup. Returns num.
+template <typename Filter, typename HashType>
+inline uint32_t LookupSmall(Filter &bf, uint32_t num, HashType *key, uint32_t *out) {
+	switch (num) {
+	case 0: return 0;
+	case 1: LookupFixed<1>(bf, key, out); return 1;
+	case 2: LookupFixed<2>(bf, key, out); return 2;
+	case 3: LookupFixed<3>(bf, key, out); return 3;
+	case 4: LookupFixed<4>(bf, key, out); return 4;
+	case 5: LookupFixed<5>(bf, key, out); return 5;
+	case 6: LookupFixed<6>(bf, key, out); return 6;
+	case 7: LookupFixed<7>(bf, key, out); return 7;
+	case 8: LookupFixed<8>(bf, key, out); return 8;
+	default: bf.Lookup(num, key, out); return num;
+	}
+}
+} // namespace bloom_filters
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "base.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace bloom_filters {
+// Number of strings hashed per chunk by the string Insert / Lookup helpers. The hashes of a chunk stay on the stack
+// (and in L1), no hash array is materialized for the whole batch.
+static constexpr size_t STRING_BATCH_SIZE = 1024;
+
+// Arrow-style variable-length binary column: string i is data[offsets[i], offsets[i + 1]).
+struct StringColumn {
+	const int32_t *offsets;
+	const uint8_t *data;
+};
+
+static constexpr uint64_t STRING_SEED_0 = 0xa0761d6478bd642fULL;
+static constexpr uint64_t STRING_SEED_1 = 0xe7037ed1a0b428dbULL;
+static constexpr uint64_t STRING_SEED_2 = 0x8ebc6af09c88c6e3ULL;
+
+inline uint64_t Load64(const uint8_t *p) {
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Loads len < 8 bytes, zero-extended.
+inline uint64_t LoadPartial64(const uint8_t *p, uint32_t len) {
+	uint64_t v = 0;
+	std::memcpy(&v, p, len);
+	return v;
+}
+
+// 64x64 -> 128 bit multiply folded into 64 bits (as in wyhash).
+inline uint64_t MultiplyFold(uint64_t a, uint64_t b) {
+	__uint128_t product = static_cast<__uint128_t>(a) * b;
+	return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+// Reduces a string to a 128-bit digest (lo, hi). For strings of up to 16 bytes, lo holds the first and hi the last
+// min(len, 8) bytes, zero-extended; longer strings are folded 16 bytes at a time. This version never reads outside the
+// string.
+inline void StringDigest(const uint8_t *s, uint32_t len, uint64_t &lo, uint64_t &hi) {
+	if (len <= 16) {
+		if (len >= 8) {
+			lo = Load64(s);
+			hi = Load64(s + len - 8);
+		} else {
+			lo = LoadPartial64(s, len);
+			hi = lo;
+		}
+		return;
+	}
+	uint64_t seed = STRING_SEED_0;
+	for (uint32_t i = 0; i + 16 < len; i += 16) {
+		seed = MultiplyFold(Load64(s + i) ^ STRING_SEED_1, Load64(s + i + 8) ^ seed);
+	}
+	lo = Load64(s + len - 16) ^ seed;
+	hi = Load64(s + len - 8);
+}
+
+// Same digest as StringDigest, for a string that lies inside the readable range [begin, end). Short strings are read
+// with two full 8-byte loads that may cover bytes of the neighbouring strings, which are then masked or shifted out.
+// This avoids a branch per length class, only strings at the very edges of the range take the safe path.
+inline void StringDigestInRange(const uint8_t *s, uint32_t len, const uint8_t *begin, const uint8_t *end,
+                                uint64_t &lo, uint64_t &hi) {
+	// an empty string has no last byte to align the second load to (the shift below would be by 64)
+	if (len == 0 || len > 16 || s + 8 > end || s + len < begin + 8) {
+		StringDigest(s, len, lo, hi);
+		return;
+	}
+	uint32_t short_len = len < 8 ? len : 8;
+	uint64_t keep = short_len == 8 ? ~0ULL : (1ULL << (short_len * 8)) - 1;
+	lo = Load64(s) & keep;
+	// The last short_len bytes of the string are the high bytes of the word that ends with the string.
+	hi = (Load64(s + len - 8) >> ((8 - short_len) * 8)) & keep;
+}
+
+// Finalizes the digests of a chunk into 64-bit hashes. This is the SIMD part: a multiply-shift folds hi and the length
+// into lo, then the vectorized Murmur kernel runs over the whole chunk. h = murmur(lo ^ ms(hi + len * seed)).
+inline void FinalizeStringHashes(size_t num, uint64_t *BF_RESTRICT lo, const uint64_t *BF_RESTRICT hi,
+                                 const uint32_t *BF_RESTRICT len, uint64_t *BF_RESTRICT hashes) {
+	for (size_t i = 0; i < num; i++) {
+		lo[i] ^= MultiplyShiftHash64(hi[i] + len[i] * STRING_SEED_2);
+	}
+	HashVector<HashFamily::MURMUR>(num, lo, hashes);
+}
+
+inline uint64_t StringHash64(const uint8_t *s, uint32_t len) {
+	uint64_t lo, hi;
+	StringDigest(s, len, lo, hi);
+	return MurmurHash64(lo ^ MultiplyShiftHash64(hi + len * STRING_SEED_2));
+}
+
+inline uint32_t StringHash32(const uint8_t *s, uint32_t len) {
+	uint64_t hash = StringHash64(s, len);
+	return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+// Hashes num strings of the column, starting at string `start`. Produces the same values as StringHash64.
+inline void HashStringVector(size_t num, const StringColumn &column, size_t start, uint64_t *hashes) {
+	uint64_t lo[STRING_BATCH_SIZE], hi[STRING_BATCH_SIZE];
+	uint32_t len[STRING_BATCH_SIZE];
+	for (size_t base = 0; base < num; base += STRING_BATCH_SIZE) {
+		size_t batch = std::min(STRING_BATCH_SIZE, num - base);
+		const int32_t *BF_RESTRICT offsets = column.offsets + start + base;
+		const uint8_t *BF_RESTRICT data = column.data;
+		const uint8_t *begin = data + offsets[0];
+		const uint8_t *end = data + offsets[batch];
+		for (size_t i = 0; i < batch; i++) {
+			uint64_t digest_lo, digest_hi;
+			uint32_t length = static_cast<uint32_t>(offsets[i + 1] - offsets[i]);
+			StringDigestInRange(data + offsets[i], length, begin, end, digest_lo, digest_hi);
+			lo[i] = digest_lo;
+			hi[i] = digest_hi;
+			len[i] = length;
+		}
+		FinalizeStringHashes(batch, lo, hi, len, hashes + base);
+	}
+}
+
+// 32-bit variant for the filters that consume 32-bit hashes. Produces the same values as StringHash32.
+inline void HashStringVector(size_t num, const StringColumn &column, size_t start, uint32_t *hashes) {
+	uint64_t hashes64[STRING_BATCH_SIZE];
+	for (size_t base = 0; base < num; base += STRING_BATCH_SIZE) {
+		size_t batch = std::min(STRING_BATCH_SIZE, num - base);
+		HashStringVector(batch, column, start + base, hashes64);
+		for (size_t i = 0; i < batch; i++) {
+			hashes[base + i] = static_cast<uint32_t>(hashes64[i] ^ (hashes64[i] >> 32));
+		}
+	}
+}
+
+// Inserts num strings of the column into any filter. The strings are hashed chunk by chunk into a stack buffer that
+// is handed to the filter directly.
+template <typename BloomFilterType, typename HashType>
+void InsertStrings(BloomFilterType &bf, size_t num, const StringColumn &column) {
+	alignas(64) HashType hashes[STRING_BATCH_SIZE];
+	for (size_t base = 0; base < num; base += STRING_BATCH_SIZE) {
+		size_t batch = std::min(STRING_BATCH_SIZE, num - base);
+		HashStringVector(batch, column, base, hashes);
+		bf.Insert(batch, hashes);
+	}
+}
+
+// Looks up num strings of the column in any filter, out[i] is non-zero if string i may be in the filter.
+template <typename BloomFilterType, typename HashType>
+size_t LookupStrings(BloomFilterType &bf, size_t num, const StringColumn &column, uint32_t *out) {
+	alignas(64) HashType hashes[STRING_BATCH_SIZE];
+	for (size_t base = 0; base < num; base += STRING_BATCH_SIZE) {
+		size_t batch = std::min(STRING_BATCH_SIZE, num - base);
+		HashStringVector(batch, column, base, hashes);
+		bf.Lookup(batch, hashes, out + base);
+	}
+	return num;
+}
+} // namespace bloom_filters
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+#include "hash_functions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+
+namespace bloom_filters {
+struct TwoLevelFilterOptions {
+	// Fraction of probes expected to be build keys. They pass the pre-filter and always reach the large filter, so
+	// the higher it is, the less a pre-filter saves.
+	double expected_hit_rate = 0.1;
+	// Cycles per key of probing the large filter when it is DRAM-resident.
+	double large_probe_cycles = 30;
+	// Largest pre-filter the model may choose, about the L2 cache.
+	size_t max_prefilter_bytes = 1 << 20;
+	// Fixed pre-filter size in bytes (a power of two) and bits per key, 0 to choose them with the model;
+	// SIZE_MAX disables the pre-filter.
+	size_t prefilter_bytes = 0;
+	uint32_t prefilter_bits_per_key = 0;
+	// Storage of the large filter. The pre-filter is small and always allocated eagerly.
+	StorageOptions storage;
+};
+
+// Register-blocked pre-filter: one 64-bit block per key, selected by the top bits of the remixed hash, with k bits
+// set from consecutive 6-bit groups of its low bits. Unlike the filters in this repository, k is a parameter: a
+// pre-filter that has to stay in L2 often gets only one or two bits of memory per key, where k = 1 or 2 is optimal
+// and the k = 6 of RegisterBlockedBF64Bit would pass nearly everything.
+//
+// Insert and Lookup take the same hashes as the large filter and remix them (multiply and xor-shift), so the
+// pre-filter's false positives are independent of those of the large filter.
+class RegisterBlockedPreFilter {
+public:
+	static constexpr uint32_t MAX_K = 8;
+	static constexpr uint64_t MIX = 0x9E3779B97F4A7C15ULL;
+
+public:
+	// bytes is rounded down to a power of two, at least one block.
+	RegisterBlockedPreFilter(size_t bytes, uint32_t k) : k_(std::min(std::max(k, 1U), MAX_K)) {
+		num_blocks_log_ = 0;
+		while ((16ULL << num_blocks_log_) <= bytes) {
+			num_blocks_log_++;
+		}
+		StorageOptions eager;
+		eager.init = BlockInit::EAGER;
+		blocks_.Allocate(1ULL << num_blocks_log_, eager);
+	}
+
+	inline void Insert(uint32_t num, const uint64_t *key) {
+		Dispatch([&](auto k) { InsertKernel<decltype(k)::value>(num, key); });
+	}
+	inline uint32_t Lookup(uint32_t num, const uint64_t *key, uint32_t *out) const {
+		Dispatch([&](auto k) { LookupKernel<decltype(k)::value>(num, key, out); });
+		return num;
+	}
+	inline void Clear() {
+		blocks_.Clear();
+	}
+	inline size_t Bytes() const {
+		return blocks_.size() * sizeof(uint64_t);
+	}
+	inline uint32_t K() const {
+		return k_;
+	}
+
+private:
+	template <typename Fn>
+	inline void Dispatch(Fn &&fn) const {
+		switch (k_) {
+		case 1: return fn(std::integral_constant<uint32_t, 1>());
+		case 2: return fn(std::integral_constant<uint32_t, 2>());
+		case 3: return fn(std::integral_constant<uint32_t, 3>());
+		case 4: return fn(std::integral_constant<uint32_t, 4>());
+		case 5: return fn(std::integral_constant<uint32_t, 5>());
+		case 6: return fn(std::integral_constant<uint32_t, 6>());
+		case 7: return fn(std::integral_constant<uint32_t, 7>());
+		default: return fn(std::integral_constant<uint32_t, 8>());
+		}
+	}
+
+	static inline uint64_t Remix(uint64_t key) {
+		uint64_t h = key * MIX;
+		return h ^ (h >> 29);
+	}
+	template <uint32_t K>
+	static inline uint64_t Mask(uint64_t h) {
+		uint64_t mask = 0;
+		for (uint32_t i = 0; i < K; i++) {
+			mask |= 1ULL << ((h >> (6 * i)) & 63);
+		}
+		return mask;
+	}
+	inline uint64_t Block(uint64_t h) const {
+		return num_blocks_log_ == 0 ? 0 : h >> (64 - num_blocks_log_);
+	}
+
+	template <uint32_t K>
+	void InsertKernel(uint32_t num, const uint64_t *BF_RESTRICT key) {
+		uint64_t *BF_RESTRICT bf = blocks_.data();
+		for (uint32_t i = 0; i < num; i++) {
+			uint64_t h = Remix(key[i]);
+			bf[Block(h)] |= Mask<K>(h);
+		}
+	}
+
+	template <uint32_t K>
+	void LookupKernel(uint32_t num, const uint64_t *BF_RESTRICT key, uint32_t *BF_RESTRICT out) const {
+		const uint64_t *BF_RESTRICT bf = blocks_.data();
+		uint32_t i = 0;
+#if defined(__AVX512DQ__)
+		// a shift by 64 yields 0, so a single-block filter needs no special case
+		const __m128i block_shift = _mm_cvtsi32_si128(static_cast<int>(64 - num_blocks_log_));
+		const __m512i mix = _mm512_set1_epi64(static_cast<int64_t>(MIX));
+		const __m512i low6 = _mm512_set1_epi64(63);
+		const __m512i one = _mm512_set1_epi64(1);
+		for (; i + 8 <= num; i += 8) {
+			__m512i h = _mm512_mullo_epi64(_mm512_loadu_si512(key + i), mix);
+			h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 29));
+			__m512i words = _mm512_i64gather_epi64(_mm512_srl_epi64(h, block_shift), bf, 8);
+			__m512i mask = _mm512_setzero_si512();
+			for (uint32_t j = 0; j < K; j++) {
+				__m512i pos = _mm512_and_si512(_mm512_srli_epi64(h, 6 * j), low6);
+				mask = _mm512_or_si512(mask, _mm512_sllv_epi64(one, pos));
+			}
+			__mmask8 hit = _mm512_cmpeq_epi64_mask(_mm512_and_si512(words, mask), mask);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+			                    _mm512_cvtepi64_epi32(_mm512_maskz_mov_epi64(hit, one)));
+		}
+#elif defined(__AVX2__)
+		const __m128i block_shift = _mm_cvtsi32_si128(static_cast<int>(64 - num_blocks_log_));
+		const __m256i mix_lo = _mm256_set1_epi64x(static_cast<int64_t>(MIX & 0xffffffffULL));
+		const __m256i mix_hi = _mm256_set1_epi64x(static_cast<int64_t>(MIX >> 32));
+		const __m256i low6 = _mm256_set1_epi64x(63);
+		const __m256i one = _mm256_set1_epi64x(1);
+		// the low 32 bits of the four 64-bit results
+		const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+		for (; i + 4 <= num; i += 4) {
+			__m256i h = Mullo64AVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(key + i)), mix_lo, mix_hi);
+			h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 29));
+			__m256i words =
+			    _mm256_i64gather_epi64(reinterpret_cast<const long long *>(bf), _mm256_srl_epi64(h, block_shift), 8);
+			__m256i mask = _mm256_setzero_si256();
+			for (uint32_t j = 0; j < K; j++) {
+				__m256i pos = _mm256_and_si256(_mm256_srli_epi64(h, 6 * j), low6);
+				mask = _mm256_or_si256(mask, _mm256_sllv_epi64(one, pos));
+			}
+			__m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(words, mask), mask);
+			__m256i flags = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(hit, 63), pack);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(flags));
+		}
+#endif
+		for (; i < num; i++) {
+			uint64_t h = Remix(key[i]);
+			uint64_t mask = Mask<K>(h);
+			out[i] = (bf[Block(h)] & mask) == mask;
+		}
+	}
+
+	uint32_t k_;
+	uint32_t num_blocks_log_;
+	BlockArray<uint64_t> blocks_;
+};
+
+// Cost model of the pre-filter in front of a large filter.
+struct PreFilterModel {
+	// Smallest pre-filter the model considers.
+	static constexpr size_t MIN_BYTES = 4 << 10;
+	// Cycles per key of probing a pre-filter that fits in L1, in L2, and of compacting the survivors.
+	static constexpr double L1_PROBE_CYCLES = 1.5;
+	static constexpr double L2_PROBE_CYCLES = 3.0;
+	static constexpr double COMPACT_CYCLES = 1.0;
+	static constexpr size_t L1_BYTES = 32 << 10;
+
+	// False-positive rate of a RegisterBlockedPreFilter of the given size with k bits per key holding num_keys keys:
+	// the number of keys per block is Poisson(lambda), and a block holding j keys has each bit set with probability
+	// 1 - (1 - 1/64)^(k j). The Poisson terms are summed in log space over lambda +- 12 standard deviations.
+	static double FalsePositiveRate(size_t num_keys, size_t bytes, uint32_t k) {
+		if (bytes == 0) {
+			return 1.0;
+		}
+		double lambda = static_cast<double>(num_keys) / static_cast<double>(bytes / 8);
+		double spread = 12 * std::sqrt(lambda) + 12;
+		uint64_t first = static_cast<uint64_t>(std::max(0.0, lambda - spread));
+		uint64_t last = static_cast<uint64_t>(lambda + spread);
+		double fpr = 0;
+		for (uint64_t j = first; j <= last; j++) {
+			double log_poisson = -lambda + static_cast<double>(j) * std::log(lambda) - std::lgamma(j + 1.0);
+			double bit_set = 1 - std::pow(1 - 1.0 / 64, static_cast<double>(k * j));
+			fpr += std::exp(log_poisson) * std::pow(bit_set, k);
+		}
+		return std::min(fpr, 1.0);
+	}
+
+	// Expected cycles per probe with a pre-filter of the given size and k (bytes = 0 for none): the pre-filter probe
+	// and compaction for every key, plus the large filter probe for the hits and the pre-filter's false positives.
+	static double ProbeCycles(size_t num_keys, size_t bytes, uint32_t k, const TwoLevelFilterOptions &options) {
+		if (bytes == 0) {
+			return options.large_probe_cycles;
+		}
+		double hit = options.expected_hit_rate;
+		double pass_rate = hit + (1 - hit) * FalsePositiveRate(num_keys, bytes, k);
+		double prefilter_cycles = (bytes <= L1_BYTES ? L1_PROBE_CYCLES : L2_PROBE_CYCLES) + COMPACT_CYCLES;
+		return prefilter_cycles + pass_rate * options.large_probe_cycles;
+	}
+
+	// Pre-filter size and k with the lowest expected cycles per probe; bytes = 0 if no pre-filter pays off.
+	static void Optimize(size_t num_keys, const TwoLevelFilterOptions &options, size_t &best_bytes, uint32_t &best_k) {
+		best_bytes = 0;
+		best_k = 0;
+		double best_cycles = ProbeCycles(num_keys, 0, 0, options);
+		for (size_t bytes = MIN_BYTES; bytes <= options.max_prefilter_bytes; bytes *= 2) {
+			for (uint32_t k = 1; k <= RegisterBlockedPreFilter::MAX_K; k++) {
+				double cycles = ProbeCycles(num_keys, bytes, k, options);
+				if (cycles < best_cycles) {
+					best_bytes = bytes;
+					best_k = k;
+					best_cycles = cycles;
+				}
+			}
+		}
+	}
+};
+
+// A small, cache-resident RegisterBlockedPreFilter in front of a large (DRAM-resident) filter. Lookup probes the
+// pre-filter for a chunk of keys, compacts the survivors into a selection vector and probes only those in the large
+// filter, so negative keys the pre-filter rejects never touch DRAM. The pre-filter's size and k are chosen with
+// PreFilterModel from the expected hit rate and the cost of a large filter probe; it is left out when it does not pay
+// off.
+template <typename LargeFilter>
+class TwoLevelFilter {
+public:
+	static constexpr uint32_t CHUNK_SIZE = 1024;
+
+public:
+	TwoLevelFilter(size_t n_key, uint32_t n_bits_per_key,
+	               const TwoLevelFilterOptions &options = TwoLevelFilterOptions())
+	    : large_(n_key, n_bits_per_key, options.storage) {
+		size_t bytes = options.prefilter_bytes;
+		uint32_t k = options.prefilter_bits_per_key;
+		if (bytes == 0) {
+			size_t best_bytes;
+			uint32_t best_k;
+			PreFilterModel::Optimize(n_key, options, best_bytes, best_k);
+			bytes = best_bytes;
+			k = k == 0 ? best_k : k;
+		} else if (bytes == SIZE_MAX) {
+			bytes = 0;
+		} else if (k == 0) {
+			// best k for the given size
+			for (uint32_t candidate = 1; candidate <= RegisterBlockedPreFilter::MAX_K; candidate++) {
+				if (k == 0 || PreFilterModel::FalsePositiveRate(n_key, bytes, candidate) <
+				                  PreFilterModel::FalsePositiveRate(n_key, bytes, k)) {
+					k = candidate;
+				}
+			}
+		}
+		if (bytes > 0) {
+			prefilter_.reset(new RegisterBlockedPreFilter(bytes, k));
+		}
+		std::iota(identity_, identity_ + CHUNK_SIZE, 0);
+	}
+
+public:
+	void Insert(uint32_t num, uint64_t *key) {
+		large_.Insert(num, key);
+		if (prefilter_ != nullptr) {
+			prefilter_->Insert(num, key);
+		}
+	}
+
+	uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out) {
+		if (prefilter_ == nullptr) {
+			large_.Lookup(num, key, out);
+			return num;
+		}
+		alignas(64) uint32_t sel[CHUNK_SIZE];
+		for (uint32_t base = 0; base < num; base += CHUNK_SIZE) {
+			uint32_t batch = std::min(CHUNK_SIZE, num - base);
+			uint32_t *chunk_out = out + base;
+			prefilter_->Lookup(batch, key + base, chunk_out);
+			uint32_t survivors = CompactSelection(batch, identity_, chunk_out, sel);
+			num_probed_ += batch;
+			num_survivors_ += survivors;
+			std::fill(chunk_out, chunk_out + batch, 0U);
+			uint32_t passed = large_.Lookup(survivors, key + base, sel, sel);
+			for (uint32_t i = 0; i < passed; i++) {
+				chunk_out[sel[i]] = 1;
+			}
+		}
+		return num;
+	}
+
+	// Probes only the rows in sel[0, num) and writes the rows that pass to sel_out (which may be sel itself).
+	inline uint32_t Lookup(uint32_t num, uint64_t *key, const uint32_t *sel, uint32_t *sel_out) {
+		return SelectionLookup(num, key, sel, sel_out,
+		                       [this](uint32_t n, uint64_t *batch_key, uint32_t *out) { Lookup(n, batch_key, out); });
+	}
+
+	void Clear() {
+		large_.Clear();
+		if (prefilter_ != nullptr) {
+			prefilter_->Clear();
+		}
+	}
+
+	LargeFilter &Large() {
+		return large_;
+	}
+	// Size of the pre-filter in bytes, 0 without one.
+	size_t PreFilterBytes() const {
+		return prefilter_ != nullptr ? prefilter_->Bytes() : 0;
+	}
+	// Bits set per key in the pre-filter, 0 without one.
+	uint32_t PreFilterK() const {
+		return prefilter_ != nullptr ? prefilter_->K() : 0;
+	}
+	// Fraction of the probed keys that passed the pre-filter.
+	double PreFilterPassRate() const {
+		return num_probed_ > 0 ? static_cast<double>(num_survivors_) / static_cast<double>(num_probed_) : 1.0;
+	}
+	void ResetCounters() {
+		num_probed_ = num_survivors_ = 0;
+	}
+
+private:
+	LargeFilter large_;
+	std::unique_ptr<RegisterBlockedPreFilter> prefilter_;
+	uint32_t identity_[CHUNK_SIZE];
+	uint64_t num_probed_ = 0;
+	uint64_t num_survivors_ = 0;
+};
+} // namespace bloom_filters
@@ -1,56 +1,99 @@
 #!/usr/bin/env python3
 
-import subprocess
-import os
 import argparse
-from typing import List
-
-def run_benchmark(executable: str, key_power: int, bits_per_key: int, lookup_power: int, output_dir: str) -> None:
-    """Run a single benchmark with the given parameters and save the output."""
-    output_file = f"{output_dir}/keys_{key_power}_bits_{bits_per_key}_lookups_{lookup_power}.txt"
-    
-    print(f"Running benchmark with: keys=2^{key_power}, bits={bits_per_key}, lookups=2^{lookup_power}")
-    
-    # Run the benchmark
-    cmd = [executable, str(key_power), str(bits_per_key), str(lookup_power)]
-    
+import csv
+import io
+import json
+import os
+import subprocess
+from typing import Dict, List
+
+def run_driver(executable: str, key_power: int, args: argparse.Namespace) -> List[Dict[str, str]]:
+    """Run the benchmark driver for one key count and return its CSV rows."""
+    cmd = [
+        executable,
+        f"--variants={args.variants}",
+        f"--keys={key_power}",
+        f"--bits={args.bits}",
+        f"--lookups={args.lookups}",
+        f"--hit-rates={args.hit_rates}",
+        f"--distributions={args.distributions}",
+        f"--hash={args.hash}",
+        f"--repetitions={args.repetitions}",
+        "--format=csv",
+        f"--perf={args.perf}",
+    ]
+    print(f"Running benchmark with: keys=2^{key_power}, bits={args.bits}, lookups=2^{args.lookups}, "
+          f"hit rates={args.hit_rates}, distributions={args.distributions}")
+
     try:
         result = subprocess.run(cmd, capture_output=True, text=True, check=True)
-        
-        # Write output to file
-        with open(output_file, 'w') as f:
-            f.write(result.stdout)
-        
-        print(f"Results saved to {output_file}")
     except subprocess.CalledProcessError as e:
         print(f"Error running benchmark: {e}")
         print(f"Command output: {e.stdout}")
         print(f"Error output: {e.stderr}")
+        return []
+    return list(csv.DictReader(io.StringIO(result.stdout)))
+
+def format_event(row: Dict[str, str], column: str) -> str:
+    """A per-tuple event count, or '-' where the driver could not count it."""
+    value = float(row.get(column, "-1"))
+    return f"{value:.3f}" if value >= 0 else "-"
+
+def print_summary(rows: List[Dict[str, str]]) -> None:
+    """Print the median lookup cost of every variant per workload."""
+    print(f"\n{'variant':<26} {'keys':>10} {'bits':>5} {'hits':>6} {'distribution':<10} "
+          f"{'lookup cycles':>13} {'M tuples/s':>11} {'FPR':>10} {'instr':>8} {'LLC miss':>9} {'dTLB miss':>9}")
+    for row in rows:
+        if row["phase"] != "lookup":
+            continue
+        print(f"{row['variant']:<26} {row['num_keys']:>10} {row['bits_per_key']:>5} "
+              f"{float(row['hit_rate']) * 100:>5.0f}% {row['distribution']:<10} "
+              f"{float(row['cycles_p50']):>13.2f} {float(row['tuples_per_s_p50']) / 1e6:>11.1f} "
+              f"{float(row['false_positive_rate']):>10.2e} {format_event(row, 'instructions_per_tuple'):>8} "
+              f"{format_event(row, 'llc_misses_per_tuple'):>9} {format_event(row, 'dtlb_misses_per_tuple'):>9}")
 
 def main():
     # Parse command line arguments
     parser = argparse.ArgumentParser(description="Run Bloom Filter benchmarks with various parameters")
-    parser.add_argument("--executable", default="./build/main_benchmark", help="Path to the benchmark executable")
+    parser.add_argument("--executable", default="./build/benchmark_driver", help="Path to the benchmark driver")
     parser.add_argument("--output-dir", default="benchmark_results", help="Directory to save results")
+    parser.add_argument("--variants", default="all", help="Comma-separated filter variants, or all")
+    parser.add_argument("--keys", default="12,14,16,18,20,22", help="Comma-separated powers of 2 of the key count")
+    parser.add_argument("--bits", default="16,32", help="Comma-separated bits per key")
+    parser.add_argument("--lookups", type=int, default=24, help="Power of 2 of the number of lookups")
+    parser.add_argument("--hit-rates", default="0,0.1,0.5,1", help="Comma-separated fractions of probes that hit")
+    parser.add_argument("--distributions", default="uniform,zipf,clustered",
+                        help="Comma-separated key distributions (uniform, zipf, clustered)")
+    parser.add_argument("--hash", default="murmur", help="Hash family (murmur, crc32, multiply-shift)")
+    parser.add_argument("--repetitions", type=int, default=5, help="Repetitions per run")
+    parser.add_argument("--perf", default="on", choices=["on", "off"],
+                        help="Count hardware events with perf_event_open")
     args = parser.parse_args()
-    
+
     # Create output directory if it doesn't exist
     os.makedirs(args.output_dir, exist_ok=True)
-    
-    # Define parameter ranges
-    num_keys_powers = [12, 14, 16, 18]   
-    bits_per_key = [32]         
-    lookup_powers = [24]
-    
+
     print("Starting benchmarks...")
-    
-    # Run benchmarks with all parameter combinations
-    for key_power in num_keys_powers:
-        for bits in bits_per_key:
-            for lookup_power in lookup_powers:
-                run_benchmark(args.executable, key_power, bits, lookup_power, args.output_dir)
-    
+
+    # One driver run per key count, so a crash or an out-of-memory kill loses only that size
+    rows: List[Dict[str, str]] = []
+    for key_power in [int(k) for k in args.keys.split(",")]:
+        rows.extend(run_driver(args.executable, key_power, args))
+
+    csv_file = os.path.join(args.output_dir, "results.csv")
+    json_file = os.path.join(args.output_dir, "results.json")
+    if rows:
+        with open(csv_file, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(rows[0].keys()))
+            writer.writeheader()
+            writer.writerows(rows)
+        with open(json_file, "w") as f:
+            json.dump(rows, f, indent=2)
+        print_summary(rows)
+        print(f"\nResults saved to {csv_file} and {json_file}")
+
     print("All benchmarks completed!")
 
 if __name__ == "__main__":
-    main()
\ No newline at end of file
+    main()
@@ -0,0 +1,181 @@
+#include "base.h"
+#include "adaptive_filter.h"
+#include "register_blocked_BF_32bit.h"
+#include "cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// Linear-probing hash table standing in for the join the filter is pushed into.
+class JoinHashTable {
+public:
+	static constexpr uint64_t EMPTY = ~0ULL;
+
+	explicit JoinHashTable(const std::vector<uint64_t> &keys) {
+		size_t capacity = 1;
+		while (capacity < keys.size() * 2) {
+			capacity <<= 1;
+		}
+		mask = capacity - 1;
+		slots.assign(capacity, EMPTY);
+		for (uint64_t key : keys) {
+			size_t slot = bloom_filters::MurmurHash64(key) & mask;
+			while (slots[slot] != EMPTY) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = key;
+		}
+	}
+
+	// Number of rows of sel[0, num) whose key is in the table.
+	uint32_t Probe(uint32_t num, const uint64_t *key, const uint32_t *sel) const {
+		uint32_t matches = 0;
+		for (uint32_t i = 0; i < num; i++) {
+			uint64_t k = key[sel[i]];
+			size_t slot = bloom_filters::MurmurHash64(k) & mask;
+			while (slots[slot] != EMPTY && slots[slot] != k) {
+				slot = (slot + 1) & mask;
+			}
+			matches += slots[slot] == k;
+		}
+		return matches;
+	}
+
+private:
+	size_t mask;
+	std::vector<uint64_t> slots;
+};
+
+// Probe keys whose hit rate changes every phase_rows rows, cycling through hit_rates.
+std::vector<uint64_t> GenerateProbe(size_t num_rows, size_t num_keys, const std::vector<double> &hit_rates,
+                                    size_t phase_rows, uint32_t seed) {
+	std::mt19937_64 re(seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	std::uniform_int_distribution<uint64_t> key_dist(0, num_keys - 1);
+	std::vector<uint64_t> probe(num_rows);
+	for (size_t i = 0; i < num_rows; i++) {
+		double hit_rate = hit_rates[(i / phase_rows) % hit_rates.size()];
+		// misses come from [num_keys, 2 * num_keys)
+		probe[i] = key_dist(re) + (coin(re) < hit_rate ? 0 : num_keys);
+	}
+	return probe;
+}
+
+enum class Strategy { NO_FILTER, ALWAYS_FILTER, ADAPTIVE };
+
+template <typename BloomFilterType, typename HashType>
+double RunJoin(Strategy strategy, BloomFilterType &bf, const JoinHashTable &table, const std::vector<uint64_t> &probe,
+               const bloom_filters::AdaptiveFilterOptions &options, uint32_t &matches,
+               bloom_filters::AdaptiveFilterCounters &counters) {
+	const uint32_t batch_size = 2048;
+	bloom_filters::AdaptiveFilter<BloomFilterType, HashType> adaptive(bf, options);
+	std::vector<HashType> hashes(batch_size);
+	std::vector<uint32_t> sel(batch_size);
+	std::vector<uint32_t> out(batch_size);
+
+	matches = 0;
+	uint64_t start = GetCycleCount();
+	for (size_t base = 0; base < probe.size(); base += batch_size) {
+		uint32_t batch = static_cast<uint32_t>(std::min<size_t>(batch_size, probe.size() - base));
+		const uint64_t *key = probe.data() + base;
+		uint32_t num_sel = batch;
+		std::iota(sel.begin(), sel.begin() + batch, 0);
+		if (strategy != Strategy::NO_FILTER) {
+			bloom_filters::HashVector(batch, key, hashes.data());
+			if (strategy == Strategy::ALWAYS_FILTER) {
+				bf.Lookup(batch, hashes.data(), out.data());
+			} else {
+				adaptive.Lookup(batch, hashes.data(), out.data());
+			}
+			num_sel = bloom_filters::CompactSelection(batch, sel.data(), out.data(), sel.data());
+		}
+		matches += table.Probe(num_sel, key, sel.data());
+	}
+	uint64_t end = GetCycleCount();
+	counters = adaptive.Counters();
+	return static_cast<double>(end - start) / static_cast<double>(probe.size());
+}
+
+template <typename BloomFilterType, typename HashType>
+void RunAdaptiveBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_keys, size_t num_rows) {
+	BloomFilterType bf(num_keys, num_bits_per_key);
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<HashType> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	bf.Insert(num_keys, hashes.data());
+	JoinHashTable table(keys);
+
+	// Cost of one downstream probe, measured on a sample, feeds the wrapper's cost model.
+	bloom_filters::AdaptiveFilterOptions options;
+	{
+		auto sample = GenerateProbe(1 << 16, num_keys, {0.5}, 1 << 16, 7);
+		std::vector<uint32_t> sel(sample.size());
+		std::iota(sel.begin(), sel.end(), 0);
+		uint64_t start = GetCycleCount();
+		uint32_t matches = table.Probe(static_cast<uint32_t>(sample.size()), sample.data(), sel.data());
+		uint64_t end = GetCycleCount();
+		options.downstream_cycles_per_row = static_cast<double>(end - start) / static_cast<double>(sample.size());
+		if (matches == 0) {
+			std::cout << "ERROR: Calibration sample has no match!\n";
+		}
+	}
+
+	std::cout << "[" << title << ", downstream probe ~ " << options.downstream_cycles_per_row << " cycles per row]\n";
+	struct Workload {
+		std::string name;
+		std::vector<double> hit_rates;
+	};
+	for (const auto &workload : {Workload {"hit rate 5%", {0.05}}, Workload {"hit rate 50%", {0.5}},
+	                             Workload {"hit rate 95%", {0.95}}, Workload {"hit rate 100%", {1.0}},
+	                             Workload {"shifting 5% / 100%", {0.05, 1.0}}}) {
+		auto probe = GenerateProbe(num_rows, num_keys, workload.hit_rates, num_rows / 8, 42);
+		uint32_t matches[3];
+		bloom_filters::AdaptiveFilterCounters counters;
+		double no_filter = RunJoin<BloomFilterType, HashType>(Strategy::NO_FILTER, bf, table, probe, options,
+		                                                      matches[0], counters);
+		double always = RunJoin<BloomFilterType, HashType>(Strategy::ALWAYS_FILTER, bf, table, probe, options,
+		                                                   matches[1], counters);
+		double adaptive = RunJoin<BloomFilterType, HashType>(Strategy::ADAPTIVE, bf, table, probe, options,
+		                                                     matches[2], counters);
+		if (matches[0] != matches[1] || matches[1] != matches[2]) {
+			std::cout << "ERROR: Join results differ: " << matches[0] << ", " << matches[1] << ", " << matches[2]
+			          << "\n";
+		}
+		std::cout << workload.name << ": no filter " << no_filter << ", always filter " << always << ", adaptive "
+		          << adaptive << " cycles per row\n"
+		          << "  adaptive probed " << counters.morsels_probed << " / skipped " << counters.morsels_skipped
+		          << " morsels, " << counters.num_decisions << " decisions, " << counters.num_disables
+		          << " disables, " << counters.num_enables << " enables\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = (1 << 20);
+	size_t num_bits_per_key = 16;
+	size_t num_rows = (1 << 24);
+	if (argc == 4) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_rows = 1 << std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key> <num_probe_rows>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Number of probe rows: " << num_rows << "\n\n";
+
+	RunAdaptiveBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t>("32-bit Vectorized Cache-sectorized BF",
+	                                                                      num_bits_per_key, num_keys, num_rows);
+	RunAdaptiveBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t>("32-bit Vectorized Register-Blocked BF",
+	                                                                      num_bits_per_key, num_keys, num_rows);
+	return 0;
+}
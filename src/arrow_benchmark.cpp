@@ -0,0 +1,142 @@
+#include "base.h"
+#include "arrow_probe.h"
+#include "register_blocked_BF_32bit.h"
+#include "cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Arrow-layout column with a few leading slots, so the array offset is not byte aligned.
+template <typename T>
+struct OwnedArrowColumn {
+	static constexpr int64_t OFFSET = 3;
+	std::vector<T> values;
+	std::vector<uint8_t> validity;
+
+	bloom_filters::ArrowFixedWidthColumn<T> View(int64_t length, bool has_nulls) const {
+		return {values.data(), has_nulls ? validity.data() : nullptr, length, OFFSET};
+	}
+};
+
+template <typename T>
+OwnedArrowColumn<T> GenerateColumn(size_t num, T first_key, double null_fraction, uint32_t seed) {
+	std::mt19937 re(seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	OwnedArrowColumn<T> column;
+	size_t slots = num + OwnedArrowColumn<T>::OFFSET;
+	column.values.resize(slots);
+	column.validity.assign((slots + 7) / 8, 0);
+	for (size_t i = 0; i < slots; i++) {
+		column.values[i] = static_cast<T>(first_key + static_cast<T>(i));
+		if (coin(re) >= null_fraction) {
+			column.validity[i >> 3] |= static_cast<uint8_t>(1U << (i & 7));
+		}
+	}
+	return column;
+}
+
+// The path the request describes: copy the valid slots into a dense uint64_t array, hash, probe and clear the null
+// rows of the result afterwards.
+template <typename BloomFilterType, typename HashType, typename T>
+int64_t LookupByCopy(BloomFilterType &bf, const bloom_filters::ArrowFixedWidthColumn<T> &column,
+                     std::vector<uint64_t> &dense, std::vector<HashType> &hashes, std::vector<uint32_t> &out,
+                     uint8_t *out_bitmap) {
+	for (int64_t i = 0; i < column.length; i++) {
+		dense[i] = static_cast<uint64_t>(column.values[column.offset + i]);
+	}
+	bloom_filters::HashVector(column.length, dense.data(), hashes.data());
+	bf.Lookup(column.length, hashes.data(), out.data());
+	int64_t num_set = 0;
+	std::fill(out_bitmap, out_bitmap + (column.length + 7) / 8, 0);
+	for (int64_t i = 0; i < column.length; i++) {
+		int64_t bit = column.offset + i;
+		bool valid = !column.validity || ((column.validity[bit >> 3] >> (bit & 7)) & 1);
+		if (valid && out[i]) {
+			out_bitmap[i >> 3] |= static_cast<uint8_t>(1U << (i & 7));
+			num_set++;
+		}
+	}
+	return num_set;
+}
+
+template <typename BloomFilterType, typename HashType, typename T>
+void RunArrowBenchmark(const std::string &title, double null_fraction, size_t num_bits_per_key, size_t num_keys,
+                       size_t num_lookup_times) {
+	BloomFilterType bf(num_keys, num_bits_per_key);
+	bool has_nulls = null_fraction > 0;
+	auto build = GenerateColumn<T>(num_keys, 0, null_fraction, 42);
+	// Half of the probe rows hit the build side.
+	auto probe = GenerateColumn<T>(num_keys, static_cast<T>(num_keys / 2), null_fraction, 4242);
+	auto build_view = build.View(static_cast<int64_t>(num_keys), has_nulls);
+	auto probe_view = probe.View(static_cast<int64_t>(num_keys), has_nulls);
+
+	uint64_t start = GetCycleCount();
+	bloom_filters::InsertArrowColumn<BloomFilterType, HashType>(bf, build_view);
+	uint64_t end = GetCycleCount();
+	double insert_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	const size_t lookupRepeat = std::max(num_lookup_times / num_keys, 1UL);
+	std::vector<uint8_t> bitmap((num_keys + 7) / 8);
+	std::vector<uint8_t> reference((num_keys + 7) / 8);
+	std::vector<uint64_t> dense(num_keys);
+	std::vector<HashType> hashes(num_keys);
+	std::vector<uint32_t> out(num_keys);
+
+	int64_t copy_set = 0;
+	start = GetCycleCount();
+	for (size_t r = 0; r < lookupRepeat; r++) {
+		copy_set = LookupByCopy<BloomFilterType, HashType>(bf, probe_view, dense, hashes, out, reference.data());
+	}
+	end = GetCycleCount();
+	double copy_cpt = static_cast<double>(end - start) / static_cast<double>(lookupRepeat * num_keys);
+
+	int64_t in_place_set = 0;
+	start = GetCycleCount();
+	for (size_t r = 0; r < lookupRepeat; r++) {
+		in_place_set = bloom_filters::LookupArrowColumn<BloomFilterType, HashType>(bf, probe_view, bitmap.data());
+	}
+	end = GetCycleCount();
+	double in_place_cpt = static_cast<double>(end - start) / static_cast<double>(lookupRepeat * num_keys);
+
+	if (bitmap != reference || copy_set != in_place_set) {
+		std::cout << "ERROR: In-place result differs from the copying probe!\n";
+	}
+
+	std::cout << "[" << title << ", " << sizeof(T) * 8 << "-bit keys, " << null_fraction * 100 << "% nulls]\n"
+	          << "Insert took " << insert_cpt << " cycles per row\n"
+	          << "Lookup (copy + post-process nulls) took " << copy_cpt << " cycles per row\n"
+	          << "Lookup (in place, bitmap output) took " << in_place_cpt << " cycles per row\n"
+	          << "Rows passed: " << in_place_set << "/" << num_keys << "\n\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = (1 << 17);
+	size_t num_bits_per_key = 16;
+	size_t num_lookup_times = (1 << 24);
+	if (argc == 4) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_lookup_times = 1 << std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key> <num_lookup_times>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Number of lookup times: " << num_lookup_times << "\n\n";
+
+	for (double null_fraction : {0.0, 0.1, 0.5, 0.9}) {
+		RunArrowBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t, int64_t>(
+		    "32-bit Vectorized Cache-sectorized BF", null_fraction, num_bits_per_key, num_keys, num_lookup_times);
+		RunArrowBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t, int32_t>(
+		    "32-bit Vectorized Cache-sectorized BF", null_fraction, num_bits_per_key, num_keys, num_lookup_times);
+		RunArrowBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t, int64_t>(
+		    "32-bit Vectorized Register-Blocked BF", null_fraction, num_bits_per_key, num_keys, num_lookup_times);
+	}
+	return 0;
+}
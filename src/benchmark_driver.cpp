@@ -0,0 +1,422 @@
+#include "base.h"
+#include "register_blocked_BF_32bit.h"
+#include "register_blocked_BF_64bit.h"
+#include "register_blocked_BF_32bit_Masks.h"
+#include "register_blocked_BF_64bit_Masks.h"
+#include "register_blocked_BF_2x32bit.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "new_cache_sectorized_BF_32bit.h"
+#if defined(__AVX2__)
+#include "impala_blocked_BF_64bit.h"
+#endif
+#if defined(__AVX512F__)
+#include "impala_blocked_BF_64bit_avx512.h"
+#endif
+
+#include "perf_counters.h"
+
+#include "benchmark_utils.h"
+#include "workload_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Parameters of one run of one variant.
+struct RunConfig {
+	size_t num_keys;
+	size_t num_bits_per_key;
+	size_t num_lookups;
+	double hit_rate;
+	KeyDistribution distribution;
+	bloom_filters::HashFamily hash;
+	uint32_t repetitions;
+};
+
+// Spread of a per-tuple cost over the repetitions of a run.
+struct Spread {
+	double p10 = 0;
+	double p50 = 0;
+	double p90 = 0;
+};
+
+Spread Percentiles(std::vector<double> values) {
+	std::sort(values.begin(), values.end());
+	auto at = [&](double q) {
+		return values[static_cast<size_t>(q * static_cast<double>(values.size() - 1) + 0.5)];
+	};
+	return {at(0.1), at(0.5), at(0.9)};
+}
+
+// One output row: a phase (insert or lookup) of one run.
+struct Row {
+	std::string variant;
+	RunConfig config;
+	std::string phase;
+	size_t num_tuples;
+	Spread cycles;
+	Spread ns;
+	// Observed over all probes that are not build keys; -1 for insert rows.
+	double false_positive_rate = -1;
+	size_t errors = 0;
+	// Median count per tuple of every PerfEvent, -1 where the event is not available.
+	double events[bloom_filters::NUM_PERF_EVENTS] = {};
+};
+
+// Per-tuple event counts of the repetitions of a phase, one vector per event.
+struct EventSamples {
+	std::vector<double> per_tuple[bloom_filters::NUM_PERF_EVENTS];
+
+	void Add(const bloom_filters::PerfSample &sample, size_t num_tuples) {
+		for (uint32_t e = 0; e < bloom_filters::NUM_PERF_EVENTS; e++) {
+			if (sample.valid[e]) {
+				per_tuple[e].push_back(sample.value[e] / static_cast<double>(num_tuples));
+			}
+		}
+	}
+	void Median(double *events) const {
+		for (uint32_t e = 0; e < bloom_filters::NUM_PERF_EVENTS; e++) {
+			events[e] = per_tuple[e].empty() ? -1 : Percentiles(per_tuple[e]).p50;
+		}
+	}
+};
+
+// Times insert and lookup of one filter, config.repetitions times each, and counts their hardware events. Every
+// repetition inserts into a fresh filter, so insert includes faulting in lazily mapped pages, as building a filter per
+// query does. Keys are hashed before the clock starts.
+template <typename BloomFilterType, typename HashType, bloom_filters::HashFamily FAMILY>
+void RunVariant(const std::string &name, const RunConfig &config, const Workload &workload,
+                bloom_filters::PerfCounters &counters, std::vector<Row> &rows) {
+	std::vector<HashType> build(workload.build.size()), probe(workload.probe.size());
+	bloom_filters::HashVector<FAMILY>(build.size(), workload.build.data(), build.data());
+	bloom_filters::HashVector<FAMILY>(probe.size(), workload.probe.data(), probe.data());
+	std::vector<uint32_t> out(probe.size());
+
+	std::vector<double> insert_cycles, insert_ns, lookup_cycles, lookup_ns;
+	EventSamples insert_events, lookup_events;
+	size_t errors = 0, false_positives = 0;
+	for (uint32_t r = 0; r < config.repetitions; r++) {
+		BloomFilterType bf(config.num_keys, config.num_bits_per_key, QuietStorage());
+		counters.Start();
+		auto wall_start = std::chrono::steady_clock::now();
+		uint64_t start = GetCycleCount();
+		bf.Insert(build.size(), build.data());
+		uint64_t end = GetCycleCount();
+		auto wall_end = std::chrono::steady_clock::now();
+		insert_events.Add(counters.Stop(), build.size());
+		insert_cycles.push_back(static_cast<double>(end - start) / static_cast<double>(build.size()));
+		insert_ns.push_back(std::chrono::duration<double, std::nano>(wall_end - wall_start).count() /
+		                    static_cast<double>(build.size()));
+
+		// one untimed pass, so every repetition probes a warm filter
+		bf.Lookup(probe.size(), probe.data(), out.data());
+		counters.Start();
+		wall_start = std::chrono::steady_clock::now();
+		start = GetCycleCount();
+		bf.Lookup(probe.size(), probe.data(), out.data());
+		end = GetCycleCount();
+		wall_end = std::chrono::steady_clock::now();
+		lookup_events.Add(counters.Stop(), probe.size());
+		lookup_cycles.push_back(static_cast<double>(end - start) / static_cast<double>(probe.size()));
+		lookup_ns.push_back(std::chrono::duration<double, std::nano>(wall_end - wall_start).count() /
+		                    static_cast<double>(probe.size()));
+
+		if (r == 0) {
+			for (size_t i = 0; i < probe.size(); i++) {
+				errors += workload.is_hit[i] && !out[i];
+				false_positives += !workload.is_hit[i] && out[i];
+			}
+		}
+	}
+	size_t num_misses = probe.size() - workload.num_hits;
+	rows.push_back({name, config, "insert", build.size(), Percentiles(insert_cycles), Percentiles(insert_ns)});
+	insert_events.Median(rows.back().events);
+	rows.push_back({name, config, "lookup", probe.size(), Percentiles(lookup_cycles), Percentiles(lookup_ns),
+	                num_misses > 0 ? static_cast<double>(false_positives) / static_cast<double>(num_misses) : 0,
+	                errors});
+	lookup_events.Median(rows.back().events);
+}
+
+using RunFn = void (*)(const std::string &, const RunConfig &, const Workload &, bloom_filters::PerfCounters &,
+                       std::vector<Row> &);
+
+struct Variant {
+	const char *name;
+	RunFn run[3]; // per HashFamily
+};
+
+template <typename BloomFilterType, typename HashType>
+Variant MakeVariant(const char *name) {
+	return {name,
+	        {RunVariant<BloomFilterType, HashType, bloom_filters::HashFamily::MURMUR>,
+	         RunVariant<BloomFilterType, HashType, bloom_filters::HashFamily::CRC32>,
+	         RunVariant<BloomFilterType, HashType, bloom_filters::HashFamily::MULTIPLY_SHIFT>}};
+}
+
+std::vector<Variant> AllVariants() {
+	std::vector<Variant> variants = {
+	    MakeVariant<bloom_filters::RegisterBlockedBF32Bit, uint32_t>("register_blocked_32"),
+	    MakeVariant<bloom_filters::RegisterBlockedBF32BitMasks, uint32_t>("register_blocked_32_masks"),
+	    MakeVariant<bloom_filters::RegisterBlockedBF64Bit, uint64_t>("register_blocked_64"),
+	    MakeVariant<bloom_filters::RegisterBlockedBF64BitMasks, uint64_t>("register_blocked_64_masks"),
+	    MakeVariant<bloom_filters::RegisterBlockedBF2x32Bit, uint64_t>("register_blocked_2x32"),
+	    MakeVariant<bloom_filters::CacheSectorizedBF32Bit, uint64_t>("cache_sectorized_32"),
+	    MakeVariant<bloom_filters::NewCacheSectorizedBF32Bit, uint64_t>("new_cache_sectorized_32"),
+#if defined(__AVX2__)
+	    MakeVariant<bloom_filters::ImpalaBlockedBF64Bit, uint64_t>("impala_blocked_64"),
+#endif
+#if defined(__AVX512F__)
+	    MakeVariant<bloom_filters::ImpalaBlockedBF64BitAVX512, uint64_t>("impala_blocked_64_avx512"),
+#endif
+	};
+	return variants;
+}
+
+std::vector<std::string> Split(const std::string &list) {
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+bloom_filters::HashFamily ParseHashFamily(const std::string &name) {
+	for (auto family : {bloom_filters::HashFamily::MURMUR, bloom_filters::HashFamily::CRC32,
+	                    bloom_filters::HashFamily::MULTIPLY_SHIFT}) {
+		if (name == bloom_filters::HashFamilyName(family)) {
+			return family;
+		}
+	}
+	throw std::invalid_argument("unknown hash family: " + name);
+}
+
+void WriteCsv(std::ostream &out, const std::vector<Row> &rows) {
+	out << "variant,hash,num_keys,bits_per_key,num_lookups,hit_rate,distribution,phase,num_tuples,repetitions,"
+	       "cycles_p10,cycles_p50,cycles_p90,ns_p10,ns_p50,ns_p90,tuples_per_s_p50,false_positive_rate,errors";
+	for (uint32_t e = 0; e < bloom_filters::NUM_PERF_EVENTS; e++) {
+		out << "," << bloom_filters::PerfEventName(static_cast<bloom_filters::PerfEvent>(e)) << "_per_tuple";
+	}
+	out << "\n";
+	for (const auto &row : rows) {
+		const RunConfig &c = row.config;
+		out << row.variant << "," << bloom_filters::HashFamilyName(c.hash) << "," << c.num_keys << ","
+		    << c.num_bits_per_key << "," << c.num_lookups << "," << c.hit_rate << ","
+		    << KeyDistributionName(c.distribution) << "," << row.phase << "," << row.num_tuples << ","
+		    << c.repetitions << "," << row.cycles.p10 << "," << row.cycles.p50 << "," << row.cycles.p90 << ","
+		    << row.ns.p10 << "," << row.ns.p50 << "," << row.ns.p90 << "," << 1e9 / row.ns.p50 << ","
+		    << row.false_positive_rate << "," << row.errors;
+		for (double events : row.events) {
+			out << "," << events;
+		}
+		out << "\n";
+	}
+}
+
+void WriteJson(std::ostream &out, const std::vector<Row> &rows) {
+	out << "[\n";
+	for (size_t i = 0; i < rows.size(); i++) {
+		const Row &row = rows[i];
+		const RunConfig &c = row.config;
+		out << "  {\"variant\": \"" << row.variant << "\", \"hash\": \"" << bloom_filters::HashFamilyName(c.hash)
+		    << "\", \"num_keys\": " << c.num_keys << ", \"bits_per_key\": " << c.num_bits_per_key
+		    << ", \"num_lookups\": " << c.num_lookups << ", \"hit_rate\": " << c.hit_rate << ", \"distribution\": \""
+		    << KeyDistributionName(c.distribution) << "\", \"phase\": \"" << row.phase
+		    << "\", \"num_tuples\": " << row.num_tuples << ", \"repetitions\": " << c.repetitions
+		    << ", \"cycles\": {\"p10\": " << row.cycles.p10 << ", \"p50\": " << row.cycles.p50
+		    << ", \"p90\": " << row.cycles.p90 << "}, \"ns\": {\"p10\": " << row.ns.p10 << ", \"p50\": " << row.ns.p50
+		    << ", \"p90\": " << row.ns.p90 << "}, \"tuples_per_s_p50\": " << 1e9 / row.ns.p50
+		    << ", \"false_positive_rate\": " << row.false_positive_rate << ", \"errors\": " << row.errors
+		    << ", \"per_tuple\": {";
+		for (uint32_t e = 0; e < bloom_filters::NUM_PERF_EVENTS; e++) {
+			out << (e > 0 ? ", \"" : "\"") << bloom_filters::PerfEventName(static_cast<bloom_filters::PerfEvent>(e))
+			    << "\": " << row.events[e];
+		}
+		out << "}}" << (i + 1 < rows.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
+
+void WriteText(std::ostream &out, const Row &row) {
+	const RunConfig &c = row.config;
+	out << std::left << std::setw(26) << row.variant << std::setw(8) << row.phase << std::right << " keys 2^"
+	    << __builtin_ctzll(c.num_keys) << ", " << c.num_bits_per_key << " bits, " << c.hit_rate * 100 << "% hits, "
+	    << KeyDistributionName(c.distribution) << ": " << row.cycles.p50 << " cycles [" << row.cycles.p10 << ", "
+	    << row.cycles.p90 << "], " << row.ns.p50 << " ns, " << 1e9 / row.ns.p50 / 1e6 << " M tuples/s";
+	if (row.phase == "lookup") {
+		out << ", FPR " << row.false_positive_rate;
+	}
+	out << "\n";
+	// per tuple, only the events that were counted
+	bool any = false;
+	for (uint32_t e = 0; e < bloom_filters::NUM_PERF_EVENTS; e++) {
+		auto event = static_cast<bloom_filters::PerfEvent>(e);
+		if (row.events[e] >= 0 && event != bloom_filters::PerfEvent::CYCLES) {
+			out << (any ? ", " : std::string(34, ' ')) << bloom_filters::PerfEventName(event) << " " << row.events[e];
+			any = true;
+		}
+	}
+	if (any) {
+		out << " per tuple\n";
+	}
+	if (row.errors > 0) {
+		out << "ERROR: " << row.errors << " build keys were rejected!\n";
+	}
+}
+
+void Usage(const char *program) {
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --variants=all|<name>,...        filters to run (default all)\n"
+	          << "  --keys=<log2>,...                build keys, as powers of two (default 20)\n"
+	          << "  --bits=<n>,...                   bits per key (default 16)\n"
+	          << "  --lookups=<log2>                 probes per run, as a power of two (default 24)\n"
+	          << "  --hit-rates=<fraction>,...       fraction of probes that are build keys (default 0)\n"
+	          << "  --distributions=<name>,...       uniform, zipf or clustered (default uniform)\n"
+	          << "  --zipf-theta=<theta>             skew of zipf, in (0, 1) (default 0.99)\n"
+	          << "  --cluster-size=<n>               key window of clustered (default 1024)\n"
+	          << "  --hash=<family>                  murmur, crc32 or multiply-shift (default murmur)\n"
+	          << "  --repetitions=<n>                repetitions per run (default 5)\n"
+	          << "  --format=text|csv|json           output format (default text)\n"
+	          << "  --output=<path>                  write to a file instead of stdout\n"
+	          << "  --perf=on|off                    count hardware events with perf_event_open (default on)\n"
+	          << "Variants:";
+	for (const auto &variant : AllVariants()) {
+		std::cerr << " " << variant.name;
+	}
+	std::cerr << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> variant_names = {"all"};
+	std::vector<std::string> keys_log = {"20"}, bits = {"16"}, hit_rates = {"0"}, distributions = {"uniform"};
+	size_t lookups_log = 24;
+	double zipf_theta = 0.99;
+	size_t cluster_size = 1024;
+	std::string hash = "murmur", format = "text", output;
+	uint32_t repetitions = 5;
+	bool perf = true;
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			size_t eq = arg.find('=');
+			if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+				Usage(argv[0]);
+				return 1;
+			}
+			std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+			if (key == "variants") {
+				variant_names = Split(value);
+			} else if (key == "keys") {
+				keys_log = Split(value);
+			} else if (key == "bits") {
+				bits = Split(value);
+			} else if (key == "lookups") {
+				lookups_log = std::stoul(value);
+			} else if (key == "hit-rates") {
+				hit_rates = Split(value);
+			} else if (key == "distributions") {
+				distributions = Split(value);
+			} else if (key == "zipf-theta") {
+				zipf_theta = std::stod(value);
+			} else if (key == "cluster-size") {
+				cluster_size = std::stoul(value);
+			} else if (key == "hash") {
+				hash = value;
+			} else if (key == "repetitions") {
+				repetitions = std::max(1UL, std::stoul(value));
+			} else if (key == "format") {
+				format = value;
+			} else if (key == "output") {
+				output = value;
+			} else if (key == "perf") {
+				perf = value != "off";
+			} else {
+				Usage(argv[0]);
+				return 1;
+			}
+		}
+		if (format != "text" && format != "csv" && format != "json") {
+			throw std::invalid_argument("unknown format: " + format);
+		}
+
+		std::vector<Variant> variants;
+		for (const auto &variant : AllVariants()) {
+			if (std::find(variant_names.begin(), variant_names.end(), "all") != variant_names.end() ||
+			    std::find(variant_names.begin(), variant_names.end(), variant.name) != variant_names.end()) {
+				variants.push_back(variant);
+			}
+		}
+		for (const auto &name : variant_names) {
+			auto all = AllVariants();
+			auto matches = [&](const Variant &v) { return name == v.name; };
+			if (name != "all" && std::none_of(all.begin(), all.end(), matches)) {
+				throw std::invalid_argument("unknown variant: " + name);
+			}
+		}
+
+		std::ofstream file;
+		if (!output.empty()) {
+			file.open(output);
+			if (!file) {
+				throw std::invalid_argument("cannot write " + output);
+			}
+		}
+		std::ostream &out = output.empty() ? std::cout : file;
+
+		bloom_filters::PerfCounters counters(perf);
+		if (perf && !counters.Error().empty()) {
+			std::cerr << "Some performance counters are unavailable, their columns are -1: " << counters.Error()
+			          << "\n";
+		}
+
+		std::vector<Row> rows;
+		for (const auto &distribution : distributions) {
+			for (const auto &hit_rate : hit_rates) {
+				for (const auto &key_log : keys_log) {
+					WorkloadOptions options;
+					options.num_keys = 1ULL << std::stoul(key_log);
+					options.num_lookups = 1ULL << lookups_log;
+					options.hit_rate = std::stod(hit_rate);
+					options.distribution = ParseKeyDistribution(distribution);
+					options.zipf_theta = zipf_theta;
+					options.cluster_size = cluster_size;
+					Workload workload = GenerateWorkload(options);
+					for (const auto &bits_per_key : bits) {
+						RunConfig config {options.num_keys, std::stoul(bits_per_key), options.num_lookups,
+						                  options.hit_rate,  options.distribution,      ParseHashFamily(hash),
+						                  repetitions};
+						for (const auto &variant : variants) {
+							size_t first = rows.size();
+							auto run = variant.run[static_cast<size_t>(config.hash)];
+							run(variant.name, config, workload, counters, rows);
+							if (format == "text") {
+								for (size_t r = first; r < rows.size(); r++) {
+									WriteText(out, rows[r]);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+		if (format == "csv") {
+			WriteCsv(out, rows);
+		} else if (format == "json") {
+			WriteJson(out, rows);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << "\n";
+		Usage(argv[0]);
+		return 1;
+	}
+	return 0;
+}
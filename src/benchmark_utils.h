@@ -0,0 +1,17 @@
+#pragma once
+
+#include "base.h"
+#include "block_array.h"
+
+#include <cstdint>
+
+// Insert the GetCycleCount helper
+inline uint64_t GetCycleCount() {
+	return bloom_filters::CycleCount();
+}
+
+// Storage options of filters a benchmark builds many of or times: the constructor does not print the filter size.
+inline bloom_filters::StorageOptions QuietStorage(bloom_filters::StorageOptions storage = {}) {
+	storage.verbose = false;
+	return storage;
+}
@@ -0,0 +1,91 @@
+#include "base.h"
+#include "bulk_insert.h"
+#include "register_blocked_BF_64bit.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "new_cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+template <typename BloomFilterType>
+double TimeInsert(BloomFilterType &bf, bloom_filters::BulkInsertMode mode, std::vector<uint64_t> &hashes) {
+	bf.SetBulkInsertMode(mode);
+	uint64_t start = GetCycleCount();
+	bf.Insert(hashes.size(), hashes.data());
+	uint64_t end = GetCycleCount();
+	return static_cast<double>(end - start) / static_cast<double>(hashes.size());
+}
+
+// max_filter_bytes is the largest filter the hash bits of the filter can address.
+template <typename BloomFilterType>
+void RunBulkInsertBenchmark(const std::string &title, size_t max_filter_bytes, size_t num_bits_per_key,
+                            size_t max_bytes_log) {
+	std::cout << "[" << title << "] insert cycles per key\n";
+	for (size_t bytes_log = 20; bytes_log <= max_bytes_log; bytes_log++) {
+		size_t filter_bytes = 1ULL << bytes_log;
+		if (filter_bytes > max_filter_bytes) {
+			std::cout << (filter_bytes >> 20) << " MiB: larger than the filter can address\n";
+			break;
+		}
+		// just below filter_bytes, so the filter does not round up to the next power of two
+		size_t num_keys = (filter_bytes * 8 - 64) / num_bits_per_key;
+		std::vector<uint64_t> keys(num_keys);
+		std::iota(keys.begin(), keys.end(), 0);
+		std::vector<uint64_t> hashes(num_keys);
+		bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+
+		BloomFilterType direct(num_keys, num_bits_per_key);
+		BloomFilterType bucketed(num_keys, num_bits_per_key);
+		double direct_cpk = TimeInsert(direct, bloom_filters::BulkInsertMode::NEVER, hashes);
+		double bucketed_cpk = TimeInsert(bucketed, bloom_filters::BulkInsertMode::ALWAYS, hashes);
+
+		// Both filters must hold the same bits: compare lookups of build keys and of keys that were not inserted.
+		std::vector<uint32_t> out_direct(num_keys), out_bucketed(num_keys);
+		bucketed.Lookup(num_keys, hashes.data(), out_bucketed.data());
+		if (std::accumulate(out_bucketed.begin(), out_bucketed.end(), size_t(0)) != num_keys) {
+			std::cout << "ERROR: Bucketed insert lost keys!\n";
+		}
+		std::iota(keys.begin(), keys.end(), num_keys);
+		bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+		direct.Lookup(num_keys, hashes.data(), out_direct.data());
+		bucketed.Lookup(num_keys, hashes.data(), out_bucketed.data());
+		if (out_direct != out_bucketed) {
+			std::cout << "ERROR: Bucketed insert differs from the direct insert!\n";
+		}
+
+		bool auto_bucketed = bloom_filters::BulkInsertFanoutLog(filter_bytes, num_keys,
+		                                                        bloom_filters::BulkInsertMode::AUTO) > 0;
+		std::cout << (filter_bytes >> 20) << " MiB: direct " << direct_cpk << ", bucketed " << bucketed_cpk
+		          << " (auto: " << (auto_bucketed ? "bucketed" : "direct") << ")\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_bits_per_key = 16;
+	size_t max_bytes_log = 28;
+	if (argc == 3) {
+		num_bits_per_key = std::stoi(argv[1]);
+		max_bytes_log = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_bits_per_key> <log2_max_filter_bytes>\n";
+		return 1;
+	}
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Filter sizes: 1 MiB to " << ((1ULL << max_bytes_log) >> 20) << " MiB\n\n";
+
+	// 24 bits of block index from the hash
+	RunBulkInsertBenchmark<bloom_filters::RegisterBlockedBF64Bit>("64-bit Vectorized Register-Blocked BF",
+	                                                              (1ULL << 24) * 8, num_bits_per_key, max_bytes_log);
+	// MAX_NUM_BLOCKS 32-bit words
+	RunBulkInsertBenchmark<bloom_filters::CacheSectorizedBF32Bit>("32-bit Vectorized Cache-sectorized BF",
+	                                                              (1ULL << 26) * 4, num_bits_per_key, max_bytes_log);
+	RunBulkInsertBenchmark<bloom_filters::NewCacheSectorizedBF32Bit>(
+	    "New 32-bit Vectorized Cache-sectorized BF", (1ULL << 24) * 4, num_bits_per_key, max_bytes_log);
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "filter_codec.h"
+#include "filter_memory_pool.h"
+
+#include "benchmark_utils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using Filter = bloom_filters::CacheSectorizedBF32Bit;
+
+// Repeats fn until it has run for at least 200 ms and returns the filter bytes it processed per second, in MB/s.
+template <typename Fn>
+double MegabytesPerSecond(size_t bytes, Fn &&fn) {
+	size_t runs = 0;
+	auto start = std::chrono::steady_clock::now();
+	double seconds = 0;
+	do {
+		fn();
+		runs++;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (seconds < 0.2);
+	return static_cast<double>(bytes * runs) / seconds / 1e6;
+}
+
+std::string FormatName(bloom_filters::WireFormat format) {
+	switch (format) {
+	case bloom_filters::WireFormat::RAW: return "raw";
+	case bloom_filters::WireFormat::SPARSE: return "sparse";
+	case bloom_filters::WireFormat::RICE: return "rice";
+	default: return "auto";
+	}
+}
+
+// Fills a filter sized for num_keys keys with num_keys * load of them, then encodes it in every format and decodes it
+// into a filter taken from a pool.
+void RunCodecBenchmark(size_t num_keys, size_t num_bits_per_key, double load, const std::vector<uint64_t> &hashes,
+                       bloom_filters::FilterMemoryPool &pool) {
+	Filter bf(num_keys, num_bits_per_key, QuietStorage());
+	bloom_filters::StorageOptions pooled = QuietStorage();
+	pooled.pool = &pool;
+	Filter decoded(num_keys, num_bits_per_key, pooled);
+
+	size_t num_inserted = static_cast<size_t>(static_cast<double>(num_keys) * load);
+	bf.Insert(num_inserted, const_cast<uint64_t *>(hashes.data()));
+	const auto &blocks = bf.Blocks();
+	size_t bytes = blocks.size() * sizeof(blocks[0]);
+	auto sizes = bloom_filters::EstimateWireSizes(reinterpret_cast<const uint64_t *>(blocks.data()), bytes / 8);
+	double fill = static_cast<double>(sizes.num_ones) / static_cast<double>(bytes * 8);
+
+	for (auto format : {bloom_filters::WireFormat::AUTO, bloom_filters::WireFormat::RAW,
+	                    bloom_filters::WireFormat::SPARSE, bloom_filters::WireFormat::RICE}) {
+		std::vector<uint8_t> encoded;
+		double encode_mbs = MegabytesPerSecond(bytes, [&] { encoded = bloom_filters::EncodeFilter(bf, format); });
+		double decode_mbs = MegabytesPerSecond(
+		    bytes, [&] { bloom_filters::DecodeFilter(encoded.data(), encoded.size(), decoded); });
+		bool same = std::memcmp(decoded.Blocks().data(), blocks.data(), bytes) == 0;
+		auto chosen = bloom_filters::ReadWireHeader(encoded.data(), encoded.size()).format;
+		std::cout << load * 100 << "%\t" << fill * 100 << "%\t" << FormatName(format) << "\t"
+		          << FormatName(chosen) << "\t" << encoded.size() / 1024 << " KiB\t"
+		          << static_cast<double>(bytes) / static_cast<double>(encoded.size()) << "x\t" << encode_mbs << "\t"
+		          << decode_mbs << (same ? "" : "\tERROR: decoded filter differs!") << "\n";
+	}
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 22;
+	size_t num_bits_per_key = 24;
+	if (argc == 3) {
+		num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key>\n";
+		return 1;
+	}
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	bloom_filters::FilterMemoryPool pool;
+
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n\n";
+	std::cout << "load\tfill\tformat\tchosen\tsize\tratio\tencode MB/s\tdecode MB/s\n";
+	for (double load : {0.001, 0.01, 0.05, 0.1, 0.25, 0.5, 1.0}) {
+		RunCodecBenchmark(num_keys, num_bits_per_key, load, hashes, pool);
+	}
+	return 0;
+}
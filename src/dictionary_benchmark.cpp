@@ -0,0 +1,136 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "dictionary_probe.h"
+#include "register_blocked_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static constexpr size_t NUM_BUILD_KEYS = 1 << 20;
+static constexpr size_t CHUNK_SIZE = 1024;
+// Average run length of the run-end encoded column.
+static constexpr uint32_t MEAN_RUN_LENGTH = 16;
+
+// Decodes every row and probes it: what a dictionary-encoded column costs without MapCodes.
+template <typename Filter, typename HashType>
+void LookupPerRow(Filter &bf, const std::vector<uint64_t> &dictionary, size_t num_rows, const uint32_t *codes,
+                  uint32_t *out) {
+	alignas(64) uint64_t keys[CHUNK_SIZE];
+	alignas(64) HashType hashes[CHUNK_SIZE];
+	for (size_t base = 0; base < num_rows; base += CHUNK_SIZE) {
+		size_t batch = std::min(CHUNK_SIZE, num_rows - base);
+		for (size_t i = 0; i < batch; i++) {
+			keys[i] = dictionary[codes[base + i]];
+		}
+		bloom_filters::HashVector(batch, keys, hashes);
+		bf.Lookup(batch, hashes, out + base);
+	}
+}
+
+// Best of three runs of fn, in cycles.
+template <typename Fn>
+double BestCycles(Fn &&fn) {
+	double best = 1e30;
+	for (int run = 0; run < 3; run++) {
+		uint64_t start = GetCycleCount();
+		fn();
+		best = std::min(best, static_cast<double>(GetCycleCount() - start));
+	}
+	return best;
+}
+
+// For every dictionary size, the cycles per row of probing every decoded row and of probing the dictionary once and
+// mapping the codes (plain and run-end encoded). The results must agree.
+template <typename Filter, typename HashType>
+void RunDictionaryBenchmark(const std::string &title, size_t num_rows, size_t num_bits_per_key, double selectivity) {
+	std::mt19937_64 re(42);
+	std::vector<uint64_t> build(NUM_BUILD_KEYS);
+	for (auto &key : build) {
+		key = re();
+	}
+	Filter bf(NUM_BUILD_KEYS, num_bits_per_key, QuietStorage());
+	std::vector<HashType> hashes(NUM_BUILD_KEYS);
+	bloom_filters::HashVector(NUM_BUILD_KEYS, build.data(), hashes.data());
+	bf.Insert(NUM_BUILD_KEYS, hashes.data());
+
+	std::cout << "[" << title << "]\ndictionary\tper row\tdictionary + MapCodes\tspeedup\tper row (RLE)\t"
+	          << "dictionary + MapRunEndCodes\tspeedup\t(cycles per row)\n";
+	std::vector<uint32_t> codes(num_rows), out(num_rows), expected(num_rows);
+	for (size_t dictionary_size : {16UL, 256UL, 4096UL, 65536UL, 1UL << 20}) {
+		// a fraction selectivity of the dictionary entries are build keys
+		std::vector<uint64_t> dictionary(dictionary_size);
+		std::uniform_real_distribution<double> coin(0.0, 1.0);
+		for (auto &value : dictionary) {
+			value = coin(re) < selectivity ? build[re() % NUM_BUILD_KEYS] : re();
+		}
+		std::uniform_int_distribution<uint32_t> code_dist(0, static_cast<uint32_t>(dictionary_size - 1));
+		for (auto &code : codes) {
+			code = code_dist(re);
+		}
+
+		double per_row = BestCycles([&] { LookupPerRow<Filter, HashType>(bf, dictionary, num_rows, codes.data(),
+		                                                                 expected.data()); });
+		double mapped = BestCycles([&] {
+			auto result = bloom_filters::ProbeDictionary<Filter, HashType>(bf, dictionary_size, dictionary.data());
+			bloom_filters::MapCodes(result, num_rows, codes.data(), out.data());
+		});
+		if (!std::equal(out.begin(), out.end(), expected.begin())) {
+			std::cout << "ERROR: MapCodes and per-row Lookup disagree!\n";
+		}
+
+		// run-end encoded: runs of 1 to 2 * MEAN_RUN_LENGTH - 1 rows, each with one code
+		std::vector<uint32_t> run_codes, run_ends;
+		std::uniform_int_distribution<uint32_t> run_length(1, 2 * MEAN_RUN_LENGTH - 1);
+		for (uint32_t end = 0; end < num_rows;) {
+			uint32_t code = code_dist(re);
+			uint32_t next = std::min<uint32_t>(static_cast<uint32_t>(num_rows), end + run_length(re));
+			std::fill(codes.begin() + end, codes.begin() + next, code);
+			run_codes.push_back(code);
+			run_ends.push_back(next);
+			end = next;
+		}
+		double per_row_rle = BestCycles([&] { LookupPerRow<Filter, HashType>(bf, dictionary, num_rows, codes.data(),
+		                                                                     expected.data()); });
+		double mapped_rle = BestCycles([&] {
+			auto result = bloom_filters::ProbeDictionary<Filter, HashType>(bf, dictionary_size, dictionary.data());
+			bloom_filters::MapRunEndCodes(result, run_codes.size(), run_codes.data(), run_ends.data(), out.data());
+		});
+		if (!std::equal(out.begin(), out.end(), expected.begin())) {
+			std::cout << "ERROR: MapRunEndCodes and per-row Lookup disagree!\n";
+		}
+
+		const double rows = static_cast<double>(num_rows);
+		std::cout << dictionary_size << "\t\t" << per_row / rows << "\t" << mapped / rows << "\t\t\t"
+		          << per_row / mapped << "\t" << per_row_rle / rows << "\t\t" << mapped_rle / rows << "\t\t\t\t"
+		          << per_row_rle / mapped_rle << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_rows = 1 << 24;
+	size_t num_bits_per_key = 16;
+	double selectivity = 0.1;
+	if (argc == 4) {
+		num_rows = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		selectivity = std::stod(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_rows> <num_bits_per_key> <selectivity>\n";
+		return 1;
+	}
+	std::cout << "Rows: " << num_rows << ", build keys: " << NUM_BUILD_KEYS << ", bits per key: " << num_bits_per_key
+	          << ", dictionary entries in the filter: " << selectivity << "\n\n";
+
+	RunDictionaryBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t>("32-bit Vectorized Cache-sectorized BF",
+	                                                                        num_rows, num_bits_per_key, selectivity);
+	RunDictionaryBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t>("32-bit Register-blocked BF", num_rows,
+	                                                                        num_bits_per_key, selectivity);
+	return 0;
+}
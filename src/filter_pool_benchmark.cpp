@@ -0,0 +1,162 @@
+#include "base.h"
+#include "block_array.h"
+#include "filter_memory_pool.h"
+#include "cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+struct ChurnResult {
+	double lifecycle_cycles = 0;
+	double storage_cycles = 0;
+	size_t errors = 0;
+};
+
+// Builds, probes and destroys num_filters short-lived filters whose key counts are drawn from key_counts; each filter
+// is sized for n keys and gets n / build_divisor of them. Each filter probes as many keys that were not inserted; a
+// filter built on memory that was not zeroed would pass more of them than the same filter on fresh memory
+// (expected_positives).
+ChurnResult RunChurn(const std::vector<size_t> &key_counts, size_t build_divisor, size_t num_filters,
+                     size_t num_bits_per_key, const bloom_filters::StorageOptions &storage,
+                     const std::vector<uint64_t> &build_hashes, const std::vector<uint64_t> &probe_hashes,
+                     const std::vector<size_t> &expected_positives) {
+	std::mt19937 re(7);
+	std::uniform_int_distribution<size_t> pick(0, key_counts.size() - 1);
+	std::vector<uint32_t> out(build_hashes.size());
+	ChurnResult result;
+	uint64_t storage_cycles = 0;
+	uint64_t start = GetCycleCount();
+	for (size_t f = 0; f < num_filters; f++) {
+		size_t which = pick(re);
+		size_t n = key_counts[which];
+		uint64_t construct_start = GetCycleCount();
+		auto bf = std::make_unique<bloom_filters::CacheSectorizedBF32Bit>(n, num_bits_per_key, storage);
+		storage_cycles += GetCycleCount() - construct_start;
+
+		size_t num_built = n / build_divisor;
+		bf->Insert(num_built, const_cast<uint64_t *>(build_hashes.data()));
+		bf->Lookup(num_built, const_cast<uint64_t *>(probe_hashes.data()), out.data());
+		if (std::accumulate(out.begin(), out.begin() + num_built, size_t(0)) != expected_positives[which]) {
+			result.errors++;
+		}
+
+		uint64_t destroy_start = GetCycleCount();
+		bf.reset();
+		storage_cycles += GetCycleCount() - destroy_start;
+	}
+	uint64_t end = GetCycleCount();
+	result.lifecycle_cycles = static_cast<double>(end - start) / static_cast<double>(num_filters);
+	result.storage_cycles = static_cast<double>(storage_cycles) / static_cast<double>(num_filters);
+	return result;
+}
+
+void RunChurnBenchmark(const std::string &title, const std::vector<size_t> &key_counts, size_t build_divisor,
+                       size_t num_filters, size_t num_bits_per_key) {
+	size_t max_keys = *std::max_element(key_counts.begin(), key_counts.end());
+	std::vector<uint64_t> keys(2 * max_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(2 * max_keys);
+	bloom_filters::HashVector(2 * max_keys, keys.data(), hashes.data());
+	std::vector<uint64_t> build_hashes(hashes.begin(), hashes.begin() + max_keys);
+	std::vector<uint64_t> probe_hashes(hashes.begin() + max_keys, hashes.end());
+
+	// false positives of each filter size on freshly zeroed memory
+	std::vector<size_t> expected_positives;
+	std::vector<uint32_t> out(max_keys);
+	for (size_t n : key_counts) {
+		bloom_filters::StorageOptions eager = QuietStorage();
+		eager.init = bloom_filters::BlockInit::EAGER;
+		bloom_filters::CacheSectorizedBF32Bit bf(n, num_bits_per_key, eager);
+		size_t num_built = n / build_divisor;
+		bf.Insert(num_built, build_hashes.data());
+		bf.Lookup(num_built, probe_hashes.data(), out.data());
+		expected_positives.push_back(std::accumulate(out.begin(), out.begin() + num_built, size_t(0)));
+	}
+
+	// the filter rounds its number of words up to the next power of two
+	size_t max_filter_bytes = 4;
+	while (max_filter_bytes * 8 <= max_keys * num_bits_per_key + 32) {
+		max_filter_bytes *= 2;
+	}
+
+	std::cout << "[" << title << "] " << num_filters << " filters sized for " << key_counts.front() << " to "
+	          << max_keys << " keys, 1/" << build_divisor << " of them inserted\n";
+	auto report = [&](const std::string &name, const bloom_filters::StorageOptions &storage) {
+		ChurnResult result =
+		    RunChurn(key_counts, build_divisor, num_filters, num_bits_per_key, storage, build_hashes, probe_hashes,
+		             expected_positives);
+		std::cout << name << ": " << result.lifecycle_cycles << " cycles per filter, of which construct and destroy "
+		          << result.storage_cycles << "\n";
+		if (result.errors > 0) {
+			std::cout << "ERROR: " << result.errors << " filters were built on memory that was not zeroed!\n";
+		}
+	};
+
+	bloom_filters::StorageOptions storage = QuietStorage();
+	storage.init = bloom_filters::BlockInit::EAGER;
+	report("heap, eager zero-fill", storage);
+	storage.init = bloom_filters::BlockInit::AUTO;
+	report("default storage (auto)", storage);
+
+	bloom_filters::PoolOptions pool_options;
+	{
+		bloom_filters::FilterMemoryPool pool(pool_options);
+		storage.pool = &pool;
+		report("pool, zero on acquire", storage);
+		auto counters = pool.Counters();
+		std::cout << "  hits " << counters.num_hits << " of " << counters.num_acquires << ", cached "
+		          << (counters.bytes_cached >> 10) << " KiB\n";
+	}
+	pool_options.zeroing = bloom_filters::PoolZeroing::BACKGROUND;
+	{
+		bloom_filters::FilterMemoryPool pool(pool_options);
+		storage.pool = &pool;
+		report("pool, background zeroing", storage);
+		auto counters = pool.Counters();
+		std::cout << "  hits " << counters.num_hits << " of " << counters.num_acquires << ", already zeroed "
+		          << counters.num_clean_hits << ", zeroed in background " << (counters.bytes_zeroed_in_background >> 20)
+		          << " MiB, on acquire " << (counters.bytes_zeroed_on_acquire >> 20) << " MiB\n";
+	}
+	// room for the largest filter only, so the pool has to evict to switch size classes
+	pool_options.zeroing = bloom_filters::PoolZeroing::ON_ACQUIRE;
+	pool_options.max_bytes = max_filter_bytes;
+	{
+		bloom_filters::FilterMemoryPool pool(pool_options);
+		storage.pool = &pool;
+		report("pool capped at " + std::to_string(pool_options.max_bytes >> 10) + " KiB", storage);
+		auto counters = pool.Counters();
+		std::cout << "  hits " << counters.num_hits << " of " << counters.num_acquires << ", evictions "
+		          << counters.num_evictions << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_filters = 1 << 14;
+	size_t num_bits_per_key = 16;
+	if (argc == 3) {
+		num_filters = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_filters> <num_bits_per_key>\n";
+		return 1;
+	}
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n\n";
+
+	// Fully built filters, where building and probing dominate, and filters that end up nearly empty (the build side
+	// turned out far smaller than estimated), where obtaining and zeroing the memory dominates.
+	size_t num_large_filters = std::max<size_t>(num_filters >> 6, 16);
+	RunChurnBenchmark("small filters", {1 << 8, 1 << 10, 1 << 12, 1 << 14}, 1, num_filters, num_bits_per_key);
+	RunChurnBenchmark("small filters", {1 << 8, 1 << 10, 1 << 12, 1 << 14}, 64, num_filters, num_bits_per_key);
+	RunChurnBenchmark("large filters", {1 << 16, 1 << 18, 1 << 20}, 1, num_large_filters, num_bits_per_key);
+	RunChurnBenchmark("large filters", {1 << 16, 1 << 18, 1 << 20}, 64, num_large_filters, num_bits_per_key);
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include "base.h"
+#include "block_array.h"
+#include "register_blocked_BF_64bit.h"
+#include "cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct InitMode {
+	std::string name;
+	bloom_filters::StorageOptions storage;
+};
+
+// Construction, first build, Clear() and a second build of one filter, in cycles. Faulting in lazily mapped pages
+// shows up in the first build.
+template <typename BloomFilterType>
+void RunInitBenchmark(const InitMode &mode, size_t num_bits_per_key, size_t filter_bytes) {
+	size_t num_keys = (filter_bytes * 8 - 64) / num_bits_per_key;
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+
+	uint64_t start = GetCycleCount();
+	BloomFilterType bf(num_keys, num_bits_per_key, mode.storage);
+	uint64_t end = GetCycleCount();
+	double construct_mcycles = static_cast<double>(end - start) / 1e6;
+
+	start = GetCycleCount();
+	bf.Insert(num_keys, hashes.data());
+	end = GetCycleCount();
+	double first_insert_cpk = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	start = GetCycleCount();
+	bf.Clear();
+	end = GetCycleCount();
+	double clear_mcycles = static_cast<double>(end - start) / 1e6;
+
+	// a cleared filter must be empty
+	std::vector<uint32_t> out(num_keys);
+	bf.Lookup(num_keys, hashes.data(), out.data());
+	if (std::accumulate(out.begin(), out.end(), size_t(0)) != 0) {
+		std::cout << "ERROR: Clear() left keys in the filter!\n";
+	}
+
+	start = GetCycleCount();
+	bf.Insert(num_keys, hashes.data());
+	end = GetCycleCount();
+	double second_insert_cpk = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	std::cout << (filter_bytes >> 20) << " MiB, " << mode.name << ": construct " << construct_mcycles
+	          << " Mcycles, first insert " << first_insert_cpk << " cycles per key, clear " << clear_mcycles
+	          << " Mcycles, insert after clear " << second_insert_cpk << " cycles per key\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_bits_per_key = 16;
+	size_t max_bytes_log = 28;
+	if (argc == 3) {
+		num_bits_per_key = std::stoi(argv[1]);
+		max_bytes_log = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_bits_per_key> <log2_max_filter_bytes>\n";
+		return 1;
+	}
+	uint32_t num_threads = std::max(1U, std::thread::hardware_concurrency());
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "First-touch threads: " << num_threads << "\n\n";
+
+	std::vector<InitMode> modes(4);
+	modes[0].name = "eager zero-fill";
+	modes[0].storage.init = bloom_filters::BlockInit::EAGER;
+	modes[1].name = "lazy mmap, 4 KiB pages";
+	modes[1].storage.init = bloom_filters::BlockInit::LAZY;
+	modes[1].storage.huge_pages = false;
+	modes[2].name = "lazy mmap, huge pages";
+	modes[2].storage.init = bloom_filters::BlockInit::LAZY;
+	modes[3].name = "parallel first touch";
+	modes[3].storage.init = bloom_filters::BlockInit::FIRST_TOUCH;
+	modes[3].storage.num_threads = num_threads;
+
+	std::cout << "[32-bit Vectorized Cache-sectorized BF]\n";
+	for (size_t bytes_log = 24; bytes_log <= std::min<size_t>(max_bytes_log, 28); bytes_log += 2) {
+		for (const auto &mode : modes) {
+			RunInitBenchmark<bloom_filters::CacheSectorizedBF32Bit>(mode, num_bits_per_key, 1ULL << bytes_log);
+		}
+	}
+	std::cout << "\n[64-bit Vectorized Register-Blocked BF]\n";
+	for (size_t bytes_log = 24; bytes_log <= std::min<size_t>(max_bytes_log, 27); bytes_log++) {
+		for (const auto &mode : modes) {
+			RunInitBenchmark<bloom_filters::RegisterBlockedBF64Bit>(mode, num_bits_per_key, 1ULL << bytes_log);
+		}
+	}
+	return 0;
+}
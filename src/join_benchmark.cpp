@@ -0,0 +1,339 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#if defined(__AVX2__)
+#include "impala_blocked_BF_64bit.h"
+#endif
+#include "new_cache_sectorized_BF_32bit.h"
+#include "register_blocked_BF_2x32bit.h"
+#include "register_blocked_BF_32bit.h"
+#include "register_blocked_BF_32bit_Masks.h"
+#include "register_blocked_BF_64bit.h"
+#include "register_blocked_BF_64bit_Masks.h"
+#if defined(__AVX512F__)
+#include "impala_blocked_BF_64bit_avx512.h"
+#endif
+
+#include "benchmark_utils.h"
+#include "workload_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Rows probed together: hashed, filtered, probed and materialized one vector at a time.
+static constexpr uint32_t VECTOR_SIZE = 2048;
+
+// Both sides of the join: a 64-bit key column and a fixed-width payload per row.
+struct JoinInput {
+	size_t payload_bytes;
+	std::vector<uint64_t> build_keys;
+	std::vector<uint8_t> build_payload;
+	std::vector<uint64_t> probe_keys;
+	std::vector<uint8_t> probe_payload;
+	size_t num_matches;
+};
+
+// Linear-probing hash table from a build key to its row, on the 64-bit hash of the key. Twice as many slots as rows.
+class JoinHashTable {
+public:
+	static constexpr uint64_t EMPTY = ~0ULL;
+
+	explicit JoinHashTable(size_t num_rows) {
+		size_t capacity = 1;
+		while (capacity < num_rows * 2) {
+			capacity <<= 1;
+		}
+		mask_ = capacity - 1;
+		slots_.assign(capacity, Slot {EMPTY, 0});
+	}
+
+	void Insert(uint32_t num, const uint64_t *key, const uint64_t *hash, uint64_t first_row) {
+		for (uint32_t i = 0; i < num; i++) {
+			size_t slot = hash[i] & mask_;
+			while (slots_[slot].key != EMPTY) {
+				slot = (slot + 1) & mask_;
+			}
+			slots_[slot] = Slot {key[i], first_row + i};
+		}
+	}
+
+	// Probes the rows sel[0, num) and writes the probe and build row of every match; build keys are unique, so there
+	// is at most one match per probe row.
+	uint32_t Probe(uint32_t num, const uint64_t *key, const uint64_t *hash, const uint32_t *sel, uint32_t *probe_rows,
+	               uint64_t *build_rows) const {
+		uint32_t matches = 0;
+		for (uint32_t i = 0; i < num; i++) {
+			uint32_t row = sel[i];
+			size_t slot = hash[row] & mask_;
+			while (slots_[slot].key != EMPTY && slots_[slot].key != key[row]) {
+				slot = (slot + 1) & mask_;
+			}
+			probe_rows[matches] = row;
+			build_rows[matches] = slots_[slot].row;
+			matches += slots_[slot].key == key[row];
+		}
+		return matches;
+	}
+
+private:
+	struct Slot {
+		uint64_t key;
+		uint64_t row;
+	};
+	size_t mask_;
+	std::vector<Slot> slots_;
+};
+
+// Cost of one join, in cycles of the whole join and of its probe phase.
+struct JoinResult {
+	double total_cycles;
+	double probe_cycles;
+	double seconds;
+	size_t num_matches;
+	// Probe rows that passed the filter (all of them without one).
+	size_t num_passed;
+	// Of the materialized rows, so that the copies are not optimized away.
+	uint64_t checksum;
+};
+
+// Marker for the join without a filter.
+struct NoFilter {};
+
+// Builds the hash table (and the filter on the build keys), then probes it one vector at a time: hash the keys, probe
+// the filter and compact the rows that pass into a selection vector, probe the hash table with those rows and copy the
+// key and both payloads of every match into an output vector. Filter = NoFilter skips the filter.
+template <typename Filter, typename HashType>
+JoinResult RunJoin(const JoinInput &input, size_t num_bits_per_key) {
+	const size_t num_build = input.build_keys.size();
+	const size_t num_probe = input.probe_keys.size();
+	const size_t payload = input.payload_bytes;
+	constexpr bool FILTERED = !std::is_same<Filter, NoFilter>::value;
+	constexpr bool SEPARATE_HASH = FILTERED && sizeof(HashType) != sizeof(uint64_t);
+
+	uint64_t hashes[VECTOR_SIZE];
+	HashType filter_hashes[VECTOR_SIZE];
+	uint32_t pass[VECTOR_SIZE];
+	uint32_t sel[VECTOR_SIZE];
+	uint32_t identity[VECTOR_SIZE];
+	uint32_t probe_rows[VECTOR_SIZE];
+	uint64_t build_rows[VECTOR_SIZE];
+	std::iota(identity, identity + VECTOR_SIZE, 0);
+	const size_t output_row_bytes = sizeof(uint64_t) + 2 * payload;
+	std::vector<uint8_t> output(VECTOR_SIZE * output_row_bytes);
+
+	auto start_time = std::chrono::steady_clock::now();
+	uint64_t start = GetCycleCount();
+	JoinHashTable table(num_build);
+	std::unique_ptr<Filter> bf;
+	if constexpr (FILTERED) {
+		bf.reset(new Filter(num_build, num_bits_per_key, QuietStorage()));
+	}
+	for (size_t base = 0; base < num_build; base += VECTOR_SIZE) {
+		uint32_t n = static_cast<uint32_t>(std::min<size_t>(VECTOR_SIZE, num_build - base));
+		const uint64_t *key = input.build_keys.data() + base;
+		bloom_filters::HashVector(n, key, hashes);
+		table.Insert(n, key, hashes, base);
+		if constexpr (FILTERED) {
+			if constexpr (SEPARATE_HASH) {
+				bloom_filters::HashVector(n, key, filter_hashes);
+				bf->Insert(n, filter_hashes);
+			} else {
+				bf->Insert(n, hashes);
+			}
+		}
+	}
+
+	uint64_t probe_start = GetCycleCount();
+	size_t num_matches = 0, num_passed = 0;
+	uint64_t checksum = 0;
+	for (size_t base = 0; base < num_probe; base += VECTOR_SIZE) {
+		uint32_t n = static_cast<uint32_t>(std::min<size_t>(VECTOR_SIZE, num_probe - base));
+		const uint64_t *key = input.probe_keys.data() + base;
+		bloom_filters::HashVector(n, key, hashes);
+		const uint32_t *rows = identity;
+		uint32_t num_sel = n;
+		if constexpr (FILTERED) {
+			if constexpr (SEPARATE_HASH) {
+				bloom_filters::HashVector(n, key, filter_hashes);
+				bf->Lookup(n, filter_hashes, pass);
+			} else {
+				bf->Lookup(n, hashes, pass);
+			}
+			num_sel = bloom_filters::CompactSelection(n, identity, pass, sel);
+			rows = sel;
+		}
+		num_passed += num_sel;
+		uint32_t matches = table.Probe(num_sel, key, hashes, rows, probe_rows, build_rows);
+		uint8_t *out = output.data();
+		for (uint32_t m = 0; m < matches; m++, out += output_row_bytes) {
+			size_t probe_row = base + probe_rows[m];
+			std::memcpy(out, &input.probe_keys[probe_row], sizeof(uint64_t));
+			std::memcpy(out + sizeof(uint64_t), input.build_payload.data() + build_rows[m] * payload, payload);
+			std::memcpy(out + sizeof(uint64_t) + payload, input.probe_payload.data() + probe_row * payload, payload);
+		}
+		checksum += matches > 0 ? output[(matches - 1) * output_row_bytes + output_row_bytes - 1] : 0;
+		num_matches += matches;
+	}
+	uint64_t end = GetCycleCount();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	return {static_cast<double>(end - start), static_cast<double>(end - probe_start), seconds, num_matches, num_passed,
+	        checksum};
+}
+
+// Both sides of a join of num_build rows with num_probe rows of which a fraction selectivity has a match, keys and
+// payloads random.
+JoinInput GenerateJoinInput(size_t num_build, size_t num_probe, size_t payload_bytes, double selectivity) {
+	WorkloadOptions options;
+	options.num_keys = num_build;
+	options.num_lookups = num_probe;
+	options.hit_rate = selectivity;
+	Workload workload = GenerateWorkload(options);
+	JoinInput input;
+	input.payload_bytes = payload_bytes;
+	input.build_keys = std::move(workload.build);
+	input.probe_keys = std::move(workload.probe);
+	input.num_matches = workload.num_hits;
+	std::mt19937_64 re(42);
+	input.build_payload.resize(num_build * payload_bytes);
+	input.probe_payload.resize(num_probe * payload_bytes);
+	for (auto &byte : input.build_payload) {
+		byte = static_cast<uint8_t>(re());
+	}
+	for (auto &byte : input.probe_payload) {
+		byte = static_cast<uint8_t>(re());
+	}
+	return input;
+}
+
+struct JoinVariant {
+	std::string name;
+	JoinResult (*run)(const JoinInput &, size_t);
+};
+
+std::vector<JoinVariant> JoinVariants() {
+	using namespace bloom_filters;
+	return {
+	    {"no_filter", RunJoin<NoFilter, uint64_t>},
+	    {"register_blocked_32", RunJoin<RegisterBlockedBF32Bit, uint32_t>},
+	    {"register_blocked_32_masks", RunJoin<RegisterBlockedBF32BitMasks, uint32_t>},
+	    {"register_blocked_64", RunJoin<RegisterBlockedBF64Bit, uint64_t>},
+	    {"register_blocked_64_masks", RunJoin<RegisterBlockedBF64BitMasks, uint64_t>},
+	    {"register_blocked_2x32", RunJoin<RegisterBlockedBF2x32Bit, uint64_t>},
+	    {"cache_sectorized_32", RunJoin<CacheSectorizedBF32Bit, uint64_t>},
+	    {"new_cache_sectorized_32", RunJoin<NewCacheSectorizedBF32Bit, uint64_t>},
+#if defined(__AVX2__)
+	    {"impala_blocked_64", RunJoin<ImpalaBlockedBF64Bit, uint64_t>},
+#endif
+#if defined(__AVX512F__)
+	    {"impala_blocked_64_avx512", RunJoin<ImpalaBlockedBF64BitAVX512, uint64_t>},
+#endif
+	};
+}
+
+// Selectivity at which the filter stops paying off: where the join with the filter becomes slower than the join
+// without, linearly interpolated between the measured selectivities. Returns -1 if the filter never pays off and 2 if
+// it pays off at every measured selectivity.
+double BreakEven(const std::vector<double> &selectivities, const std::vector<double> &filtered,
+                 const std::vector<double> &unfiltered) {
+	for (size_t i = 0; i < selectivities.size(); i++) {
+		double gain = unfiltered[i] - filtered[i];
+		if (gain <= 0) {
+			if (i == 0) {
+				return -1;
+			}
+			double previous = unfiltered[i - 1] - filtered[i - 1];
+			double t = previous / (previous - gain);
+			return selectivities[i - 1] + t * (selectivities[i] - selectivities[i - 1]);
+		}
+	}
+	return 2;
+}
+
+std::vector<double> ParseList(const std::string &text) {
+	std::vector<double> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		values.push_back(std::stod(item));
+	}
+	return values;
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_build = 1 << 20;
+	size_t num_probe = 1 << 22;
+	size_t payload_bytes = 16;
+	size_t num_bits_per_key = 16;
+	std::vector<double> selectivities = {0.001, 0.01, 0.05, 0.1, 0.2, 0.3, 0.5, 0.7, 1.0};
+	if (argc == 5 || argc == 6) {
+		num_build = 1ULL << std::stoi(argv[1]);
+		num_probe = 1ULL << std::stoi(argv[2]);
+		payload_bytes = std::stoi(argv[3]);
+		num_bits_per_key = std::stoi(argv[4]);
+		if (argc == 6) {
+			selectivities = ParseList(argv[5]);
+			std::sort(selectivities.begin(), selectivities.end());
+		}
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0]
+		          << " <log2_build_rows> <log2_probe_rows> <payload_bytes> <num_bits_per_key> [selectivity,...]\n";
+		return 1;
+	}
+	std::cout << "Build rows: " << num_build << ", probe rows: " << num_probe << ", payload: " << payload_bytes
+	          << " bytes per side, bits per key: " << num_bits_per_key << "\n\n";
+
+	auto variants = JoinVariants();
+	// cycles per probe row of the whole join, per variant and selectivity
+	std::vector<std::vector<double>> cycles(variants.size(), std::vector<double>(selectivities.size()));
+	std::cout << std::left << std::setw(28) << "variant" << std::right << std::setw(12) << "selectivity"
+	          << std::setw(14) << "join cycles" << std::setw(14) << "probe cycles" << std::setw(14) << "M rows/s"
+	          << std::setw(12) << "pass rate" << std::setw(10) << "speedup" << "   (cycles per probe row)\n";
+	for (size_t s = 0; s < selectivities.size(); s++) {
+		JoinInput input = GenerateJoinInput(num_build, num_probe, payload_bytes, selectivities[s]);
+		for (size_t v = 0; v < variants.size(); v++) {
+			JoinResult best {1e30, 1e30, 1e30, 0, 0, 0};
+			for (int run = 0; run < 3; run++) {
+				JoinResult result = variants[v].run(input, num_bits_per_key);
+				if (result.total_cycles < best.total_cycles) {
+					best = result;
+				}
+			}
+			if (best.num_matches != input.num_matches) {
+				std::cout << "ERROR: " << variants[v].name << " found " << best.num_matches << " matches instead of "
+				          << input.num_matches << "!\n";
+			}
+			cycles[v][s] = best.total_cycles / static_cast<double>(num_probe);
+			std::cout << std::left << std::setw(28) << variants[v].name << std::right << std::setw(12)
+			          << selectivities[s] << std::setw(14) << cycles[v][s] << std::setw(14)
+			          << best.probe_cycles / static_cast<double>(num_probe) << std::setw(14)
+			          << static_cast<double>(num_build + num_probe) / best.seconds / 1e6 << std::setw(12)
+			          << static_cast<double>(best.num_passed) / static_cast<double>(num_probe) << std::setw(10)
+			          << cycles[0][s] / cycles[v][s] << "\n";
+		}
+		std::cout << "\n";
+	}
+
+	std::cout << "Break-even selectivity (the filter pays off below it):\n";
+	for (size_t v = 1; v < variants.size(); v++) {
+		double break_even = BreakEven(selectivities, cycles[v], cycles[0]);
+		std::cout << std::left << std::setw(28) << variants[v].name << std::right;
+		if (break_even < 0) {
+			std::cout << "never (slower at " << selectivities.front() << ")\n";
+		} else if (break_even > 1) {
+			std::cout << "above " << selectivities.back() << "\n";
+		} else {
+			std::cout << break_even << "\n";
+		}
+	}
+	return 0;
+}
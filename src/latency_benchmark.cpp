@@ -0,0 +1,192 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#ifdef __AVX2__
+#include "impala_blocked_BF_64bit.h"
+#endif
+#include "new_cache_sectorized_BF_32bit.h"
+#include "register_blocked_BF_2x32bit.h"
+#include "register_blocked_BF_32bit.h"
+#include "register_blocked_BF_32bit_Masks.h"
+#include "register_blocked_BF_64bit.h"
+#include "register_blocked_BF_64bit_Masks.h"
+#include "small_batch_lookup.h"
+#ifdef __AVX512F__
+#include "impala_blocked_BF_64bit_avx512.h"
+#endif
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Calls timed per batch size and API.
+static constexpr size_t NUM_CALLS = 1 << 18;
+
+// Timestamp of the start or the end of a timed region: the fences keep the region's loads from moving across it.
+inline uint64_t FencedCycleCount() {
+	_mm_lfence();
+	uint64_t now = GetCycleCount();
+	_mm_lfence();
+	return now;
+}
+
+// Timestamp counter ticks per nanosecond, measured against the steady clock.
+double TicksPerNanosecond() {
+	auto start = std::chrono::steady_clock::now();
+	uint64_t start_ticks = GetCycleCount();
+	while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100)) {
+	}
+	uint64_t ticks = GetCycleCount() - start_ticks;
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	return static_cast<double>(ticks) / ns;
+}
+
+struct Percentiles {
+	double p50, p99, p999;
+};
+
+// Percentiles of ticks, minus the cost of an empty timed region, in nanoseconds.
+Percentiles ToNanoseconds(std::vector<uint64_t> &ticks, double overhead, double ticks_per_ns) {
+	auto at = [&](double q) {
+		size_t k = std::min(ticks.size() - 1, static_cast<size_t>(q * static_cast<double>(ticks.size())));
+		std::nth_element(ticks.begin(), ticks.begin() + k, ticks.end());
+		return std::max(0.0, static_cast<double>(ticks[k]) - overhead) / ticks_per_ns;
+	};
+	return {at(0.5), at(0.99), at(0.999)};
+}
+
+// Median ticks of an empty timed region.
+double TimerOverhead() {
+	std::vector<uint64_t> ticks(NUM_CALLS);
+	for (auto &t : ticks) {
+		uint64_t start = FencedCycleCount();
+		t = FencedCycleCount() - start;
+	}
+	std::nth_element(ticks.begin(), ticks.begin() + ticks.size() / 2, ticks.end());
+	return static_cast<double>(ticks[ticks.size() / 2]);
+}
+
+// Times every call of batch Lookup and of LookupSmall for batches of 1 to MAX_SMALL_BATCH keys, half of them build
+// keys, and prints the latency percentiles per call.
+template <typename Filter, typename HashType>
+void RunLatency(const std::string &title, size_t num_keys, size_t num_bits_per_key, double overhead,
+                double ticks_per_ns) {
+	Filter bf(num_keys, num_bits_per_key, QuietStorage());
+	std::mt19937_64 re(42);
+	std::vector<HashType> build(num_keys);
+	for (auto &hash : build) {
+		hash = static_cast<HashType>(re());
+	}
+	bf.Insert(num_keys, build.data());
+
+	// NUM_CALLS * MAX_SMALL_BATCH probe hashes, every other one a build key, read sequentially by the calls
+	std::vector<HashType> probe(NUM_CALLS * bloom_filters::MAX_SMALL_BATCH);
+	for (size_t i = 0; i < probe.size(); i++) {
+		probe[i] = i % 2 == 0 ? build[re() % num_keys] : static_cast<HashType>(re());
+	}
+
+	// the same hashes again, copied to a 64-byte boundary and probed from every key offset up to the next one: tiny
+	// batches that start misaligned and end before the boundary exercise the alignment prologues of batch Lookup
+	constexpr size_t KEYS_PER_LINE = 64 / sizeof(HashType);
+	std::vector<HashType, bloom_filters::AlignedAllocator<HashType, 64>> aligned_probe(
+	    probe.begin(), probe.begin() + KEYS_PER_LINE + bloom_filters::MAX_SMALL_BATCH);
+
+	std::cout << "[" << title << "]\n"
+	          << "keys\tbatch Lookup p50 / p99 / p999 ns\tLookupSmall p50 / p99 / p999 ns\tspeedup p50\n"
+	          << std::fixed << std::setprecision(1);
+	std::vector<uint64_t> ticks(NUM_CALLS);
+	uint32_t out[bloom_filters::MAX_SMALL_BATCH];
+	uint64_t passed = 0;
+	for (uint32_t n = 1; n <= bloom_filters::MAX_SMALL_BATCH; n++) {
+		uint32_t expected[bloom_filters::MAX_SMALL_BATCH];
+		auto agree = [&](HashType *key) {
+			bf.Lookup(n, key, expected);
+			bloom_filters::LookupSmall(bf, n, key, out);
+			return std::equal(out, out + n, expected);
+		};
+		for (size_t c = 0; c < NUM_CALLS / 16; c++) {
+			if (!agree(probe.data() + c * n)) {
+				std::cout << "ERROR: LookupSmall and Lookup disagree on a batch of " << n << " keys!\n";
+				break;
+			}
+		}
+		for (size_t offset = 0; offset < KEYS_PER_LINE; offset++) {
+			if (!agree(aligned_probe.data() + offset)) {
+				std::cout << "ERROR: LookupSmall and Lookup disagree on a batch of " << n << " keys " << offset
+				          << " keys past a 64-byte boundary!\n";
+				break;
+			}
+		}
+
+		Percentiles result[2];
+		for (int api = 0; api < 2; api++) {
+			for (size_t c = 0; c < NUM_CALLS; c++) {
+				HashType *key = probe.data() + c * n;
+				uint64_t start = FencedCycleCount();
+				if (api == 0) {
+					bf.Lookup(n, key, out);
+				} else {
+					bloom_filters::LookupSmall(bf, n, key, out);
+				}
+				ticks[c] = FencedCycleCount() - start;
+				passed += out[0];
+			}
+			result[api] = ToNanoseconds(ticks, overhead, ticks_per_ns);
+		}
+		std::cout << n << "\t" << result[0].p50 << " / " << result[0].p99 << " / " << result[0].p999 << "\t\t\t"
+		          << result[1].p50 << " / " << result[1].p99 << " / " << result[1].p999 << "\t\t\t"
+		          << std::setprecision(2) << result[0].p50 / std::max(result[1].p50, 0.1) << std::setprecision(1)
+		          << "\n";
+	}
+	if (passed == 0) {
+		std::cout << "ERROR: no probe passed!\n";
+	}
+	std::cout << std::defaultfloat << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 16;
+	size_t num_bits_per_key = 16;
+	if (argc == 3) {
+		num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key>\n";
+		return 1;
+	}
+	double ticks_per_ns = TicksPerNanosecond();
+	double overhead = TimerOverhead();
+	std::cout << "Number of keys: " << num_keys << ", bits per key: " << num_bits_per_key << ", timer overhead "
+	          << overhead / ticks_per_ns << " ns (subtracted)\n\n";
+
+	using namespace bloom_filters;
+	RunLatency<RegisterBlockedBF32Bit, uint32_t>("32-bit Register-blocked BF", num_keys, num_bits_per_key, overhead,
+	                                             ticks_per_ns);
+	RunLatency<RegisterBlockedBF32BitMasks, uint32_t>("32-bit Register-blocked BF with Masks", num_keys,
+	                                                  num_bits_per_key, overhead, ticks_per_ns);
+	RunLatency<RegisterBlockedBF64Bit, uint64_t>("64-bit Register-blocked BF", num_keys, num_bits_per_key, overhead,
+	                                             ticks_per_ns);
+	RunLatency<RegisterBlockedBF64BitMasks, uint64_t>("64-bit Register-blocked BF with Masks", num_keys,
+	                                                  num_bits_per_key, overhead, ticks_per_ns);
+	RunLatency<RegisterBlockedBF2x32Bit, uint64_t>("2x32-bit Register-blocked BF", num_keys, num_bits_per_key,
+	                                               overhead, ticks_per_ns);
+	RunLatency<CacheSectorizedBF32Bit, uint64_t>("32-bit Vectorized Cache-sectorized BF", num_keys, num_bits_per_key,
+	                                             overhead, ticks_per_ns);
+	RunLatency<NewCacheSectorizedBF32Bit, uint64_t>("New 32-bit Vectorized Cache-sectorized BF", num_keys,
+	                                                num_bits_per_key, overhead, ticks_per_ns);
+#ifdef __AVX2__
+	RunLatency<ImpalaBlockedBF64Bit, uint64_t>("Impala Blocked BF", num_keys, num_bits_per_key, overhead,
+	                                           ticks_per_ns);
+#endif
+#ifdef __AVX512F__
+	RunLatency<ImpalaBlockedBF64BitAVX512, uint64_t>("Impala Blocked BF (AVX-512)", num_keys, num_bits_per_key,
+	                                                 overhead, ticks_per_ns);
+#endif
+	return 0;
+}
@@ -6,32 +6,25 @@
 #include "register_blocked_BF_2x32bit.h"
 #include "cache_sectorized_BF_32bit.h"
 #include "new_cache_sectorized_BF_32bit.h"
+#if defined(__AVX2__)
 #include "impala_blocked_BF_64bit.h"
+#endif
+#if defined(__AVX512F__)
 #include "impala_blocked_BF_64bit_avx512.h"
+#endif
+
+#include "benchmark_utils.h"
 
 #include <cstdint>
 #include <iostream>
 
-#ifdef __x86_64__
-#include <x86intrin.h>
-#else
-#include <chrono> // added for cross-platform timing
-#endif
-
-// Insert the GetCycleCount helper
-uint64_t GetCycleCount() {
-#ifdef __x86_64__
-	return __rdtsc();
-#else
-	auto now = std::chrono::high_resolution_clock::now();
-	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
-#endif
-}
-
-template <typename BloomFilterType, typename HashType>
+template <typename BloomFilterType, typename HashType,
+          bloom_filters::HashFamily FAMILY = bloom_filters::HashFamily::MURMUR>
 void RunBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_keys, size_t num_lookup_times) {
-	// Create a Bloom filter
+	// Create a Bloom filter, allocating and zeroing the blocks is timed as well
+	uint64_t construct_start = GetCycleCount();
 	BloomFilterType bf(num_keys, num_bits_per_key);
+	uint64_t construct_cycles = GetCycleCount() - construct_start;
 
 	// Prepare keys
 	std::vector<uint64_t> keys(num_keys);
@@ -47,15 +40,17 @@ void RunBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_
 
 	// Insert
 	uint64_t start = GetCycleCount(); // replaced __rdtsc() with GetCycleCount()
-	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	bloom_filters::HashVector<FAMILY>(num_keys, keys.data(), hashes.data());
+	uint64_t mid = GetCycleCount();
 	bf.Insert(num_keys, hashes.data());
 	uint64_t end = GetCycleCount(); // replaced __rdtsc() with GetCycleCount()
 	double insert_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+	double insert_hash_cpt = static_cast<double>(mid - start) / static_cast<double>(num_keys);
 
 	// Correctness Check
 	{
 		std::vector<uint32_t> out(num_keys, 0);
-		bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+		bloom_filters::HashVector<FAMILY>(num_keys, keys.data(), hashes.data());
 		bf.Lookup(num_keys, hashes.data(), out.data());
 		size_t positives = 0;
 		for (size_t i = 0; i < num_keys; i++) {
@@ -70,16 +65,23 @@ void RunBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_
 		}
 	}
 
-	// Lookup
+	// Lookup, hashing and probing are timed separately
 	const size_t lookupRepeat = std::max(num_lookup_times / num_keys, 1UL);
 	std::vector<uint32_t> out(num_keys, 0);
-	start = GetCycleCount(); // replaced __rdtsc() with GetCycleCount()
+	uint64_t hash_cycles = 0;
+	uint64_t probe_cycles = 0;
 	for (size_t r = 0; r < lookupRepeat; r++) {
-		bloom_filters::HashVector(num_keys, lookup_keys.data(), hashes.data());
+		start = GetCycleCount();
+		bloom_filters::HashVector<FAMILY>(num_keys, lookup_keys.data(), hashes.data());
+		mid = GetCycleCount();
 		bf.Lookup(num_keys, hashes.data(), out.data());
+		end = GetCycleCount();
+		hash_cycles += mid - start;
+		probe_cycles += end - mid;
 	}
-	end = GetCycleCount(); // replaced __rdtsc() with GetCycleCount()
-	double lookup_cpt = static_cast<double>(end - start) / static_cast<double>(num_lookup_times);
+	double lookup_hash_cpt = static_cast<double>(hash_cycles) / static_cast<double>(num_lookup_times);
+	double lookup_probe_cpt = static_cast<double>(probe_cycles) / static_cast<double>(num_lookup_times);
+	double lookup_cpt = lookup_hash_cpt + lookup_probe_cpt;
 
 	// False-positive rate
 	size_t false_positives = 0;
@@ -90,9 +92,12 @@ void RunBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_
 	}
 	double fp_rate = static_cast<double>(false_positives) / static_cast<double>(num_keys);
 
-	std::cout << "[" << title << "]\n"
-	          << "Insert took " << insert_cpt << " cycles per tuple\n"
-	          << "Lookup took " << lookup_cpt << " cycles per tuple\n"
+	std::cout << "[" << title << ", " << bloom_filters::HashFamilyName(FAMILY) << " hash]\n"
+	          << "Construction took " << construct_cycles << " cycles\n"
+	          << "Insert took " << insert_cpt << " cycles per tuple (hash " << insert_hash_cpt << ", insert "
+	          << insert_cpt - insert_hash_cpt << ")\n"
+	          << "Lookup took " << lookup_cpt << " cycles per tuple (hash " << lookup_hash_cpt << ", probe "
+	          << lookup_probe_cpt << ")\n"
 	          << "False-positive rate ~ " << fp_rate << "\n\n";
 }
 
@@ -147,11 +152,29 @@ int main(int argc, char *argv[]) {
 	    "New 32-bit Vectorized Cache-sectorized BF (based on Peter's version)", num_bits_per_key, num_keys,
 	    num_lookup_times);
 
-	// RunBenchmark<bloom_filters::ImpalaBlockedBF64Bit, uint64_t>("Impala Blocked BF", num_bits_per_key, num_keys,
-	// 	num_lookup_times);
+	// The same filters with the cheaper hash families.
+	RunBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t, bloom_filters::HashFamily::MULTIPLY_SHIFT>(
+	    "32-bit Vectorized Register-Blocked BF", num_bits_per_key, num_keys, num_lookup_times);
+
+	RunBenchmark<bloom_filters::RegisterBlockedBF64Bit, uint64_t, bloom_filters::HashFamily::CRC32>(
+	    "64-bit Vectorized Register-Blocked BF", num_bits_per_key, num_keys, num_lookup_times);
+
+	RunBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t, bloom_filters::HashFamily::CRC32>(
+	    "32-bit Vectorized Cache-sectorized BF", num_bits_per_key, num_keys, num_lookup_times);
+
+	RunBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t, bloom_filters::HashFamily::MULTIPLY_SHIFT>(
+	    "32-bit Vectorized Cache-sectorized BF", num_bits_per_key, num_keys, num_lookup_times);
 
-	// RunBenchmark<bloom_filters::ImpalaBlockedBF64BitAVX512, uint64_t>("Impala Blocked BF", num_bits_per_key, num_keys,
-	// 	num_lookup_times);
+#if defined(__AVX2__)
+	RunBenchmark<bloom_filters::ImpalaBlockedBF64Bit, uint64_t>("Impala Blocked BF", num_bits_per_key, num_keys,
+	                                                            num_lookup_times);
+#endif
+
+	// Built with -DUSE_AVX512=ON
+#if defined(__AVX512F__)
+	RunBenchmark<bloom_filters::ImpalaBlockedBF64BitAVX512, uint64_t>("Impala Blocked BF (AVX-512)", num_bits_per_key,
+	                                                                  num_keys, num_lookup_times);
+#endif
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "hash_functions.h"
+#include "negative_cache.h"
+#include "register_blocked_BF_64bit.h"
+
+#include "benchmark_utils.h"
+#include "workload_generator.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static constexpr uint32_t BATCH_SIZE = 2048;
+static constexpr size_t NUM_LOOKUPS = 1 << 22;
+// Build and probe keys are hashed with it; NegativeCachedFilter needs a bijective family.
+static constexpr bloom_filters::HashFamily HASH_FAMILY = bloom_filters::HashFamily::MURMUR;
+
+// Exact membership test that stands in for the downstream work behind the filter (a hash-table probe, a disk read):
+// a linear-probing set of the build keys, twice as large as it needs to be and far larger than the caches.
+class ExactSet {
+public:
+	static constexpr uint64_t EMPTY = ~0ULL;
+
+	explicit ExactSet(const std::vector<uint64_t> &keys) {
+		size_t capacity = 1;
+		while (capacity < keys.size() * 2) {
+			capacity <<= 1;
+		}
+		mask = capacity - 1;
+		slots.assign(capacity, EMPTY);
+		for (uint64_t key : keys) {
+			size_t slot = bloom_filters::MurmurHash64(key) & mask;
+			while (slots[slot] != EMPTY) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = key;
+		}
+	}
+
+	// Splits key[sel[0, num)] into members (kept in sel, their number is returned) and non-members (in negatives).
+	uint32_t Verify(uint32_t num, const uint64_t *key, uint32_t *sel, uint32_t *negatives,
+	                uint32_t &num_negatives) const {
+		uint32_t members = 0;
+		num_negatives = 0;
+		for (uint32_t i = 0; i < num; i++) {
+			uint64_t k = key[sel[i]];
+			size_t slot = bloom_filters::MurmurHash64(k) & mask;
+			while (slots[slot] != EMPTY && slots[slot] != k) {
+				slot = (slot + 1) & mask;
+			}
+			if (slots[slot] == k) {
+				sel[members++] = sel[i];
+			} else {
+				negatives[num_negatives++] = sel[i];
+			}
+		}
+		return members;
+	}
+
+private:
+	size_t mask;
+	std::vector<uint64_t> slots;
+};
+
+struct RunResult {
+	uint64_t downstream_lookups = 0;
+	uint64_t false_positives = 0;
+	uint64_t members_found = 0;
+	double probe_cycles = 0;
+	double seconds = 0;
+};
+
+// Probes the workload batch by batch: filter (and cache), then the exact set for every row that passed, feeding the
+// false positives back into the cache. cache_entries == 0 runs the filter alone.
+template <typename Filter>
+RunResult RunBatches(Filter &bf, const ExactSet &exact, const Workload &workload,
+                     uint32_t cache_entries) {
+	std::unique_ptr<bloom_filters::NegativeCachedFilter<Filter, HASH_FAMILY>> cached;
+	if (cache_entries > 0) {
+		cached = std::make_unique<bloom_filters::NegativeCachedFilter<Filter, HASH_FAMILY>>(bf, cache_entries);
+	}
+	std::vector<uint64_t> hashes(BATCH_SIZE);
+	std::vector<uint32_t> sel(BATCH_SIZE), sel_out(BATCH_SIZE), negatives(BATCH_SIZE);
+	for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+		sel[i] = i;
+	}
+
+	RunResult result;
+	uint64_t probe_cycles = 0;
+	auto start_time = std::chrono::steady_clock::now();
+	for (size_t base = 0; base < workload.probe.size(); base += BATCH_SIZE) {
+		uint32_t batch = static_cast<uint32_t>(std::min<size_t>(BATCH_SIZE, workload.probe.size() - base));
+		bloom_filters::HashVector<HASH_FAMILY>(batch, workload.probe.data() + base, hashes.data());
+		uint64_t start = GetCycleCount();
+		uint32_t passed = cached ? cached->Lookup(batch, hashes.data(), sel.data(), sel_out.data())
+		                         : bf.Lookup(batch, hashes.data(), sel.data(), sel_out.data());
+		probe_cycles += GetCycleCount() - start;
+
+		uint32_t num_negatives;
+		result.members_found +=
+		    exact.Verify(passed, workload.probe.data() + base, sel_out.data(), negatives.data(), num_negatives);
+		result.downstream_lookups += passed;
+		result.false_positives += num_negatives;
+		if (cached) {
+			cached->AddNegatives(num_negatives, hashes.data(), negatives.data());
+		}
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	result.probe_cycles = static_cast<double>(probe_cycles) / static_cast<double>(workload.probe.size());
+	return result;
+}
+
+// Effective false-positive rate, downstream lookups and time per probe for the filter alone and for a sweep of cache
+// sizes.
+template <typename Filter>
+void RunNegativeCache(const std::string &title, const Workload &workload, const ExactSet &exact,
+                      size_t num_bits_per_key) {
+	Filter bf(workload.build.size(), num_bits_per_key, QuietStorage());
+	std::vector<uint64_t> hashes(workload.build.size());
+	bloom_filters::HashVector<HASH_FAMILY>(workload.build.size(), workload.build.data(), hashes.data());
+	bf.Insert(workload.build.size(), hashes.data());
+
+	const double num_negatives = static_cast<double>(workload.probe.size() - workload.num_hits);
+	std::cout << "[" << title << "]\ncache entries\teffective FPR\tdownstream lookups\tsaved\tprobe cycles/row\t"
+	          << "ns/row with downstream\n";
+	RunResult baseline;
+	for (uint32_t entries : {0U, 256U, 1024U, 4096U, 16384U}) {
+		RunResult result = RunBatches(bf, exact, workload, entries);
+		if (entries == 0) {
+			baseline = result;
+		}
+		if (result.members_found != workload.num_hits) {
+			std::cout << "ERROR: " << workload.num_hits - result.members_found << " members were rejected!\n";
+		}
+		std::cout << (entries == 0 ? std::string("none") : std::to_string(entries)) << "\t\t"
+		          << static_cast<double>(result.false_positives) / num_negatives << "\t"
+		          << result.downstream_lookups << "\t\t\t"
+		          << 1.0 - static_cast<double>(result.downstream_lookups) /
+		                       static_cast<double>(std::max<uint64_t>(1, baseline.downstream_lookups))
+		          << "\t" << result.probe_cycles << "\t\t\t" << result.seconds * 1e9 / workload.probe.size() << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	WorkloadOptions options;
+	options.num_keys = 1 << 20;
+	options.num_lookups = NUM_LOOKUPS;
+	options.distribution = KeyDistribution::ZIPF;
+	options.hit_rate = 0;
+	size_t num_bits_per_key = 8;
+	if (argc == 5) {
+		options.num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		options.zipf_theta = std::stod(argv[3]);
+		options.hit_rate = std::stod(argv[4]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key> <zipf_theta> <hit_rate>\n";
+		return 1;
+	}
+	Workload workload = GenerateWorkload(options);
+	ExactSet exact(workload.build);
+	std::cout << "Number of keys: " << options.num_keys << ", bits per key: " << num_bits_per_key << ", " << NUM_LOOKUPS
+	          << " zipf probes (theta " << options.zipf_theta << "), hit rate " << options.hit_rate << "\n\n";
+
+	RunNegativeCache<bloom_filters::CacheSectorizedBF32Bit>("32-bit Vectorized Cache-sectorized BF", workload, exact,
+	                                                        num_bits_per_key);
+	RunNegativeCache<bloom_filters::RegisterBlockedBF64Bit>("64-bit Register-blocked BF", workload, exact,
+	                                                        num_bits_per_key);
+	return 0;
+}
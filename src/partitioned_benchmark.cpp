@@ -0,0 +1,137 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "partitioned_filter.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Partitioned = bloom_filters::PartitionedFilter<bloom_filters::CacheSectorizedBF32Bit>;
+
+double CyclesPerKey(uint64_t start, uint64_t end, size_t num) {
+	return static_cast<double>(end - start) / static_cast<double>(num);
+}
+
+double PassRate(const std::vector<uint32_t> &out) {
+	return static_cast<double>(std::accumulate(out.begin(), out.end(), size_t(0))) / static_cast<double>(out.size());
+}
+
+// Keys grouped by partition the way a radix-partitioned join hands them over: partition p in [offsets[p],
+// offsets[p + 1]).
+void PartitionLikeJoin(const Partitioned &bf, const std::vector<uint64_t> &hashes, std::vector<uint64_t> &partitioned,
+                       std::vector<uint32_t> &offsets) {
+	offsets.assign(bf.NumPartitions() + 1, 0);
+	for (uint64_t hash : hashes) {
+		offsets[bf.PartitionOf(hash) + 1]++;
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+	std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+	partitioned.resize(hashes.size());
+	for (uint64_t hash : hashes) {
+		partitioned[cursors[bf.PartitionOf(hash)]++] = hash;
+	}
+}
+
+void RunPartitionedBenchmark(size_t num_bits_per_key, size_t filter_bytes, uint32_t num_threads) {
+	size_t num_keys = filter_bytes * 8 / num_bits_per_key;
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> build(num_keys), probe(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), build.data());
+	// keys that were not inserted, the pass rate is the false-positive rate
+	std::iota(keys.begin(), keys.end(), num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), probe.data());
+	std::vector<uint32_t> out(num_keys);
+
+	std::cout << "[" << (filter_bytes >> 20) << " MiB, " << num_keys << " keys] cycles per key\n";
+
+	{
+		bloom_filters::CacheSectorizedBF32Bit bf(num_keys, num_bits_per_key);
+		uint64_t start = GetCycleCount();
+		bf.Insert(num_keys, build.data());
+		uint64_t mid = GetCycleCount();
+		// warm-up, the partitioned filter faults in its scratch memory on the first Lookup
+		bf.Lookup(num_keys, probe.data(), out.data());
+		uint64_t lookup_start = GetCycleCount();
+		bf.Lookup(num_keys, probe.data(), out.data());
+		uint64_t end = GetCycleCount();
+		std::cout << "global filter:           insert " << CyclesPerKey(start, mid, num_keys) << ", lookup "
+		          << CyclesPerKey(lookup_start, end, num_keys) << ", FPR " << PassRate(out) << "\n";
+	}
+
+	bloom_filters::PartitionedFilterOptions options;
+	options.num_threads = num_threads;
+	{
+		Partitioned bf(num_keys, num_bits_per_key, options);
+		uint64_t start = GetCycleCount();
+		bf.Insert(num_keys, build.data());
+		uint64_t mid = GetCycleCount();
+		// warm-up, the partitioned filter faults in its scratch memory on the first Lookup
+		bf.Lookup(num_keys, probe.data(), out.data());
+		uint64_t lookup_start = GetCycleCount();
+		bf.Lookup(num_keys, probe.data(), out.data());
+		uint64_t end = GetCycleCount();
+		std::cout << "partitioned, mixed:      insert " << CyclesPerKey(start, mid, num_keys) << ", lookup "
+		          << CyclesPerKey(lookup_start, end, num_keys) << ", FPR " << PassRate(out) << " ("
+		          << bf.NumPartitions() << " partitions)\n";
+		bf.Lookup(num_keys, build.data(), out.data());
+		if (PassRate(out) != 1.0) {
+			std::cout << "ERROR: Partitioned filter lost keys!\n";
+		}
+	}
+	{
+		Partitioned bf(num_keys, num_bits_per_key, options);
+		std::vector<uint64_t> build_partitioned, probe_partitioned;
+		std::vector<uint32_t> build_offsets, probe_offsets;
+		PartitionLikeJoin(bf, build, build_partitioned, build_offsets);
+		PartitionLikeJoin(bf, probe, probe_partitioned, probe_offsets);
+
+		uint64_t start = GetCycleCount();
+		std::vector<std::thread> threads;
+		for (uint32_t t = 0; t < num_threads; t++) {
+			threads.emplace_back([&, t] {
+				for (uint32_t p = t; p < bf.NumPartitions(); p += num_threads) {
+					bf.InsertPartition(p, build_offsets[p + 1] - build_offsets[p],
+					                   build_partitioned.data() + build_offsets[p]);
+				}
+			});
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		uint64_t mid = GetCycleCount();
+		for (uint32_t p = 0; p < bf.NumPartitions(); p++) {
+			bf.LookupPartition(p, probe_offsets[p + 1] - probe_offsets[p], probe_partitioned.data() + probe_offsets[p],
+			                   out.data() + probe_offsets[p]);
+		}
+		uint64_t end = GetCycleCount();
+		std::cout << "partitioned, by the join: insert " << CyclesPerKey(start, mid, num_keys) << ", lookup "
+		          << CyclesPerKey(mid, end, num_keys) << ", FPR " << PassRate(out) << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_bits_per_key = 16;
+	size_t max_bytes_log = 26;
+	if (argc == 3) {
+		num_bits_per_key = std::stoi(argv[1]);
+		max_bytes_log = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_bits_per_key> <log2_max_filter_bytes>\n";
+		return 1;
+	}
+	uint32_t num_threads = std::max(1U, std::thread::hardware_concurrency());
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Build threads: " << num_threads << "\n\n";
+
+	for (size_t bytes_log = 20; bytes_log <= max_bytes_log; bytes_log += 2) {
+		RunPartitionedBenchmark(num_bits_per_key, 1ULL << bytes_log, num_threads);
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "range_filter.h"
+#include "register_blocked_BF_64bit.h"
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Keys are drawn from [0, 2^KEY_DOMAIN_LOG), sparse enough that most ranges up to 2^20 wide are empty.
+static constexpr uint32_t KEY_DOMAIN_LOG = 44;
+static constexpr size_t NUM_RANGES = 1 << 18;
+
+// For every range width, the false-positive rate on empty ranges, the point probes per range and the cost per range of
+// a batched Lookup. Ranges that hold a key must all pass.
+template <typename Filter>
+void RunRangeBenchmark(const std::string &title, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &sorted,
+                       size_t num_bits_per_key, const bloom_filters::RangeFilterOptions &options) {
+	bloom_filters::RangeFilterOptions quiet = options;
+	quiet.storage = QuietStorage(options.storage);
+	bloom_filters::RangeFilter<Filter> bf(keys.size(), num_bits_per_key, quiet);
+	uint64_t start = GetCycleCount();
+	bf.Insert(keys.size(), keys.data());
+	uint64_t build_cycles = GetCycleCount() - start;
+	std::cout << "[" << title << "] " << options.max_level + 1 << " levels, " << num_bits_per_key
+	          << " bits per key and level, build " << static_cast<double>(build_cycles) / keys.size()
+	          << " cycles per key\nwidth\t\tempty\tFPR\t\tprobes per range\tcycles per range\tM ranges/s\n";
+
+	std::mt19937_64 re(42);
+	std::vector<uint64_t> lo(NUM_RANGES), hi(NUM_RANGES);
+	std::vector<uint32_t> out(NUM_RANGES);
+	for (uint32_t width_log = 0; width_log <= 20; width_log += 2) {
+		uint64_t width = 1ULL << width_log;
+		size_t num_empty = 0;
+		std::vector<uint8_t> empty(NUM_RANGES);
+		for (size_t i = 0; i < NUM_RANGES; i++) {
+			lo[i] = re() & ((1ULL << KEY_DOMAIN_LOG) - 1);
+			hi[i] = lo[i] + width - 1;
+			auto next = std::lower_bound(sorted.begin(), sorted.end(), lo[i]);
+			empty[i] = next == sorted.end() || *next > hi[i];
+			num_empty += empty[i];
+		}
+
+		bf.ResetCounters();
+		double best_cycles = 1e30;
+		double best_seconds = 1e30;
+		for (int run = 0; run < 3; run++) {
+			auto begin_time = std::chrono::steady_clock::now();
+			uint64_t begin = GetCycleCount();
+			bf.Lookup(NUM_RANGES, lo.data(), hi.data(), out.data());
+			best_cycles = std::min(best_cycles, static_cast<double>(GetCycleCount() - begin));
+			best_seconds = std::min(
+			    best_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count());
+		}
+		size_t false_positives = 0, false_negatives = 0;
+		for (size_t i = 0; i < NUM_RANGES; i++) {
+			false_positives += empty[i] && out[i];
+			false_negatives += !empty[i] && !out[i];
+		}
+		if (false_negatives > 0) {
+			std::cout << "ERROR: " << false_negatives << " ranges holding a key were rejected!\n";
+		}
+		double cycles_per_range = best_cycles / NUM_RANGES;
+		std::cout << "2^" << width_log << "\t\t" << num_empty << "\t"
+		          << static_cast<double>(false_positives) / static_cast<double>(std::max<size_t>(1, num_empty))
+		          << "\t\t" << static_cast<double>(bf.NumProbes()) / (3.0 * NUM_RANGES) << "\t\t\t" << cycles_per_range
+		          << "\t\t\t" << NUM_RANGES / best_seconds / 1e6 << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 20;
+	size_t num_bits_per_key = 16;
+	uint32_t max_level = 20;
+	if (argc == 4) {
+		num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		max_level = std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key> <max_level>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << " in [0, 2^" << KEY_DOMAIN_LOG
+	          << "), ranges per width: " << NUM_RANGES << "\n\n";
+
+	std::mt19937_64 re(7);
+	std::vector<uint64_t> keys(num_keys);
+	for (auto &key : keys) {
+		key = re() & ((1ULL << KEY_DOMAIN_LOG) - 1);
+	}
+	std::vector<uint64_t> sorted(keys);
+	std::sort(sorted.begin(), sorted.end());
+
+	using namespace bloom_filters;
+	RangeFilterOptions options;
+	options.max_level = max_level;
+	RunRangeBenchmark<CacheSectorizedBF32Bit>("Cache-sectorized, descend", keys, sorted, num_bits_per_key, options);
+	RunRangeBenchmark<RegisterBlockedBF64Bit>("64-bit Register-blocked, descend", keys, sorted, num_bits_per_key,
+	                                          options);
+	options.descend = false;
+	RunRangeBenchmark<CacheSectorizedBF32Bit>("Cache-sectorized, cover only", keys, sorted, num_bits_per_key, options);
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "base.h"
+#include "register_blocked_BF_32bit.h"
+#include "register_blocked_BF_64bit.h"
+#include "cache_sectorized_BF_32bit.h"
+#if defined(__AVX2__)
+#include "impala_blocked_BF_64bit.h"
+#endif
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// Sorted selection vector with about `selectivity` of the rows.
+std::vector<uint32_t> MakeSelection(size_t num, double selectivity, uint32_t seed) {
+	std::mt19937 re(seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	std::vector<uint32_t> sel;
+	for (size_t i = 0; i < num; i++) {
+		if (coin(re) < selectivity) {
+			sel.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	return sel;
+}
+
+template <typename BloomFilterType, typename HashType>
+void RunSelectionBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_keys,
+                           size_t num_lookup_times) {
+	BloomFilterType bf(num_keys, num_bits_per_key);
+
+	// Build on [0, num_keys), probe [num_keys / 2, num_keys * 3 / 2): half of the rows hit.
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<HashType> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	bf.Insert(num_keys, hashes.data());
+
+	std::iota(keys.begin(), keys.end(), num_keys / 2);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+
+	std::cout << "[" << title << "]\n";
+	for (double selectivity : {1.0, 0.5, 0.25, 0.1, 0.05, 0.01}) {
+		std::vector<uint32_t> sel = MakeSelection(num_keys, selectivity, 42);
+		uint32_t num_sel = static_cast<uint32_t>(sel.size());
+		const size_t lookupRepeat = std::max(num_lookup_times / num_keys, 1UL);
+
+		// Compact the surviving hashes into a dense array, probe it and map the results back to row ids.
+		std::vector<HashType> dense(num_sel);
+		std::vector<uint32_t> out(num_sel);
+		std::vector<uint32_t> sel_dense(num_sel);
+		uint32_t found_dense = 0;
+		uint64_t start = GetCycleCount();
+		for (size_t r = 0; r < lookupRepeat; r++) {
+			for (uint32_t i = 0; i < num_sel; i++) {
+				dense[i] = hashes[sel[i]];
+			}
+			bf.Lookup(num_sel, dense.data(), out.data());
+			found_dense = bloom_filters::CompactSelection(num_sel, sel.data(), out.data(), sel_dense.data());
+		}
+		uint64_t end = GetCycleCount();
+		double dense_cps = static_cast<double>(end - start) / static_cast<double>(lookupRepeat * num_keys);
+
+		// Probe through the selection vector directly.
+		std::vector<uint32_t> sel_out(num_sel);
+		uint32_t found = 0;
+		start = GetCycleCount();
+		for (size_t r = 0; r < lookupRepeat; r++) {
+			found = bf.Lookup(num_sel, hashes.data(), sel.data(), sel_out.data());
+		}
+		end = GetCycleCount();
+		double sel_cps = static_cast<double>(end - start) / static_cast<double>(lookupRepeat * num_keys);
+
+		if (found != found_dense || !std::equal(sel_out.begin(), sel_out.begin() + found, sel_dense.begin())) {
+			std::cout << "ERROR: Selection lookup differs from the dense lookup!\n";
+		}
+
+		std::cout << "Input selectivity " << selectivity * 100 << "%: dense " << dense_cps
+		          << " cycles per input row, selection vector " << sel_cps << " cycles per input row, passed "
+		          << found << "/" << num_sel << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = (1 << 17);
+	size_t num_bits_per_key = 16;
+	size_t num_lookup_times = (1 << 24);
+	if (argc == 4) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_lookup_times = 1 << std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key> <num_lookup_times>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Number of lookup times: " << num_lookup_times << "\n\n";
+
+	RunSelectionBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t>(
+	    "32-bit Vectorized Register-Blocked BF", num_bits_per_key, num_keys, num_lookup_times);
+	RunSelectionBenchmark<bloom_filters::RegisterBlockedBF64Bit, uint64_t>(
+	    "64-bit Vectorized Register-Blocked BF", num_bits_per_key, num_keys, num_lookup_times);
+	RunSelectionBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t>(
+	    "32-bit Vectorized Cache-sectorized BF", num_bits_per_key, num_keys, num_lookup_times);
+#if defined(__AVX2__)
+	RunSelectionBenchmark<bloom_filters::ImpalaBlockedBF64Bit, uint64_t>("Impala Blocked BF", num_bits_per_key,
+	                                                                     num_keys, num_lookup_times);
+#endif
+	return 0;
+}
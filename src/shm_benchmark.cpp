@@ -0,0 +1,201 @@
+#include "base.h"
+#include "block_array.h"
+#include "cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Filter = bloom_filters::CacheSectorizedBF32Bit;
+
+// What a worker process reports back, in memory shared with the parent.
+struct WorkerResult {
+	double setup_ms = 0;
+	double keys_per_second = 0;
+	double filter_pss_kib = 0;
+	uint64_t errors = 0;
+};
+
+// Proportional set size of the mapping that contains addr, in KiB: pages shared by n processes count 1/n. -1 if
+// /proc/self/smaps is not available.
+double MappingPssKiB(const void *addr) {
+	std::ifstream smaps("/proc/self/smaps");
+	std::string line;
+	bool inside = false;
+	uintptr_t target = reinterpret_cast<uintptr_t>(addr);
+	while (std::getline(smaps, line)) {
+		uintptr_t start, end;
+		char dash;
+		std::istringstream header(line);
+		if (line.find(':') == std::string::npos || line.find('-') < line.find(':')) {
+			if (header >> std::hex >> start >> dash >> end && dash == '-') {
+				inside = start <= target && target < end;
+				continue;
+			}
+		}
+		if (inside && line.compare(0, 4, "Pss:") == 0) {
+			return std::stod(line.substr(4));
+		}
+	}
+	return -1;
+}
+
+// Barriers over the parent and all workers, in shared memory followed by one WorkerResult per worker.
+struct SharedState {
+	pthread_barrier_t done;
+	pthread_barrier_t measured;
+};
+
+// Probes random batches of build keys for duration; every probe must pass.
+void Probe(Filter &bf, std::vector<uint64_t> &hashes, std::chrono::milliseconds duration, uint32_t seed,
+           WorkerResult &result) {
+	constexpr uint32_t BATCH_SIZE = 1024;
+	std::mt19937_64 re(seed);
+	std::uniform_int_distribution<size_t> offset_dist(0, hashes.size() - BATCH_SIZE);
+	std::vector<uint32_t> out(BATCH_SIZE);
+	size_t probed = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + duration;
+	while (std::chrono::steady_clock::now() < end) {
+		for (int i = 0; i < 64; i++) {
+			bf.Lookup(BATCH_SIZE, hashes.data() + offset_dist(re), out.data());
+			result.errors += BATCH_SIZE - std::accumulate(out.begin(), out.end(), size_t(0));
+			probed += BATCH_SIZE;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.keys_per_second = static_cast<double>(probed) / seconds;
+}
+
+// Forks num_workers workers that each construct a filter with make_filter (timed), probe it and report the PSS of its
+// blocks while all workers are still alive. Returns the results, the parent's own filter (if any) reported in
+// parent_pss_kib.
+template <typename MakeFilter>
+std::vector<WorkerResult> RunWorkers(uint32_t num_workers, std::vector<uint64_t> &hashes,
+                                     std::chrono::milliseconds duration, MakeFilter &&make_filter,
+                                     const void *parent_blocks, double &parent_pss_kib) {
+	size_t state_bytes = sizeof(SharedState) + num_workers * sizeof(WorkerResult);
+	void *mem = mmap(nullptr, state_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	auto *state = new (mem) SharedState();
+	auto *shared_results = new (state + 1) WorkerResult[num_workers];
+	pthread_barrierattr_t attr;
+	pthread_barrierattr_init(&attr);
+	pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(&state->done, &attr, num_workers + 1);
+	pthread_barrier_init(&state->measured, &attr, num_workers + 1);
+
+	std::vector<pid_t> pids;
+	for (uint32_t w = 0; w < num_workers; w++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			WorkerResult &result = shared_results[w];
+			auto start = std::chrono::steady_clock::now();
+			auto bf = make_filter();
+			result.setup_ms =
+			    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			Probe(*bf, hashes, duration, w, result);
+			pthread_barrier_wait(&state->done);
+			result.filter_pss_kib = MappingPssKiB(bf->Blocks().data());
+			pthread_barrier_wait(&state->measured);
+			_exit(0);
+		}
+		pids.push_back(pid);
+	}
+	pthread_barrier_wait(&state->done);
+	parent_pss_kib = parent_blocks != nullptr ? MappingPssKiB(parent_blocks) : 0;
+	pthread_barrier_wait(&state->measured);
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	std::vector<WorkerResult> results(shared_results, shared_results + num_workers);
+	pthread_barrier_destroy(&state->done);
+	pthread_barrier_destroy(&state->measured);
+	munmap(mem, state_bytes);
+	return results;
+}
+
+void Report(const std::string &name, const std::vector<WorkerResult> &results, double parent_pss_kib) {
+	double setup_ms = 0, keys_per_second = 0, pss_kib = parent_pss_kib;
+	uint64_t errors = 0;
+	for (const auto &result : results) {
+		setup_ms += result.setup_ms / static_cast<double>(results.size());
+		keys_per_second += result.keys_per_second;
+		pss_kib += result.filter_pss_kib;
+		errors += result.errors;
+	}
+	std::cout << name << ": setup " << setup_ms << " ms per worker, lookup " << keys_per_second / 1e6
+	          << " M keys/s in total, filter memory on the host " << pss_kib / 1024 << " MiB\n";
+	if (errors > 0) {
+		std::cout << "ERROR: " << errors << " build keys were rejected!\n";
+	}
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 24;
+	size_t num_bits_per_key = 16;
+	uint32_t num_workers = std::max(4U, std::thread::hardware_concurrency());
+	int64_t millis = 500;
+	if (argc == 5) {
+		num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_workers = std::stoi(argv[3]);
+		millis = std::stoi(argv[4]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key> <num_workers> <milliseconds>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Worker processes: " << num_workers << ", hardware threads: " << std::thread::hardware_concurrency()
+	          << "\n\n";
+
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	std::chrono::milliseconds duration(millis);
+	double parent_pss_kib = 0;
+
+	// every worker builds its own copy
+	auto private_results = RunWorkers(
+	    num_workers, hashes, duration,
+	    [&] {
+		    auto bf = std::make_unique<Filter>(num_keys, num_bits_per_key, QuietStorage());
+		    bf->Insert(num_keys, hashes.data());
+		    return bf;
+	    },
+	    nullptr, parent_pss_kib);
+	Report("private copies", private_results, 0);
+
+	// the parent builds the filter once in shared memory, the workers attach to it
+	std::string name = "/bf_shm_benchmark_" + std::to_string(getpid());
+	bloom_filters::StorageOptions create;
+	create.shared = bloom_filters::SharedMemory::CREATE;
+	create.shm_name = name.c_str();
+	Filter shared(num_keys, num_bits_per_key, create);
+	shared.Insert(num_keys, hashes.data());
+	bloom_filters::StorageOptions attach = QuietStorage();
+	attach.shared = bloom_filters::SharedMemory::ATTACH;
+	attach.shm_name = name.c_str();
+	auto shared_results = RunWorkers(
+	    num_workers, hashes, duration, [&] { return std::make_unique<Filter>(num_keys, num_bits_per_key, attach); },
+	    shared.Blocks().data(), parent_pss_kib);
+	Report("shared memory", shared_results, parent_pss_kib);
+	return 0;
+}
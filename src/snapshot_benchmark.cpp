@@ -0,0 +1,206 @@
+#include "base.h"
+#include "filter_snapshot.h"
+#include "register_blocked_BF_64bit.h"
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Filter = bloom_filters::RegisterBlockedBF64Bit;
+
+// Every version of the filter holds the same keys, so readers check that every probe passes: a reader that probed a
+// filter after it was destroyed would see garbage.
+std::unique_ptr<Filter> BuildFilter(std::vector<uint64_t> &hashes, size_t num_bits_per_key) {
+	auto bf = std::make_unique<Filter>(hashes.size(), num_bits_per_key, QuietStorage());
+	bf->Insert(hashes.size(), hashes.data());
+	return bf;
+}
+
+// The lock-based baseline: readers hold a shared lock per batch, the writer builds off to the side and swaps under the
+// exclusive lock.
+struct LockedFilter {
+	std::shared_mutex lock;
+	std::unique_ptr<Filter> filter;
+
+	uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out) {
+		std::shared_lock<std::shared_mutex> guard(lock);
+		return filter->Lookup(num, key, out);
+	}
+	void Publish(std::unique_ptr<Filter> next) {
+		std::unique_lock<std::shared_mutex> guard(lock);
+		filter.swap(next);
+	}
+};
+
+// Readers copy a std::shared_ptr per batch (a reference count increment and decrement on a shared line).
+struct SharedPtrFilter {
+	std::shared_ptr<Filter> filter;
+
+	uint32_t Lookup(uint32_t num, uint64_t *key, uint32_t *out) {
+		std::shared_ptr<Filter> current = std::atomic_load(&filter);
+		return current->Lookup(num, key, out);
+	}
+	void Publish(std::unique_ptr<Filter> next) {
+		std::atomic_store(&filter, std::shared_ptr<Filter>(std::move(next)));
+	}
+};
+
+struct RunResult {
+	double keys_per_second = 0;
+	size_t num_publishes = 0;
+	// longest Publish call, including waiting for readers to leave the lock
+	double max_publish_us = 0;
+	size_t errors = 0;
+};
+
+// Pause of the writer between rebuilds, so every strategy spends about the same time building.
+static constexpr std::chrono::milliseconds REBUILD_INTERVAL(50);
+
+// num_readers threads probe batches of batch_size build keys for duration while, if rebuild is set, a writer builds a
+// new version every REBUILD_INTERVAL and publishes it. make_reader(t) returns the probe function of reader t.
+template <typename MakeReader, typename PublishFn>
+RunResult RunReaders(uint32_t num_readers, uint32_t batch_size, std::chrono::milliseconds duration, bool rebuild,
+                     std::vector<uint64_t> &hashes, size_t num_bits_per_key, MakeReader &&make_reader,
+                     PublishFn &&publish) {
+	std::atomic<bool> stop {false};
+	std::vector<size_t> probed(num_readers, 0), errors(num_readers, 0);
+	std::vector<std::thread> readers;
+	for (uint32_t t = 0; t < num_readers; t++) {
+		readers.emplace_back([&, t] {
+			auto lookup = make_reader(t);
+			std::vector<uint32_t> out(batch_size);
+			size_t offset = (t * 7919UL * batch_size) % (hashes.size() - batch_size);
+			size_t local_probed = 0, local_errors = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				lookup(batch_size, hashes.data() + offset, out.data());
+				local_errors += batch_size - std::accumulate(out.begin(), out.end(), size_t(0));
+				local_probed += batch_size;
+				offset += batch_size;
+				if (offset + batch_size > hashes.size()) {
+					offset = 0;
+				}
+			}
+			probed[t] = local_probed;
+			errors[t] = local_errors;
+		});
+	}
+	RunResult result;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + duration;
+	if (rebuild) {
+		while (std::chrono::steady_clock::now() < end) {
+			auto next = BuildFilter(hashes, num_bits_per_key);
+			auto publish_start = std::chrono::steady_clock::now();
+			publish(std::move(next));
+			double publish_us =
+			    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - publish_start).count();
+			result.max_publish_us = std::max(result.max_publish_us, publish_us);
+			result.num_publishes++;
+			std::this_thread::sleep_for(REBUILD_INTERVAL);
+		}
+	} else {
+		std::this_thread::sleep_until(end);
+	}
+	stop.store(true);
+	for (auto &reader : readers) {
+		reader.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.keys_per_second = static_cast<double>(std::accumulate(probed.begin(), probed.end(), size_t(0))) / seconds;
+	result.errors = std::accumulate(errors.begin(), errors.end(), size_t(0));
+	return result;
+}
+
+void Report(const std::string &name, const RunResult &result) {
+	std::cout << name << ": " << result.keys_per_second / 1e6 << " M keys/s";
+	if (result.num_publishes > 0) {
+		std::cout << " (" << result.num_publishes << " rebuilds, longest publish " << result.max_publish_us << " us)";
+	}
+	std::cout << "\n";
+	if (result.errors > 0) {
+		std::cout << "ERROR: " << result.errors << " build keys were rejected!\n";
+	}
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 20;
+	size_t num_bits_per_key = 16;
+	uint32_t num_readers = std::max(2U, std::thread::hardware_concurrency());
+	int64_t millis = 1000;
+	if (argc == 5) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_readers = std::stoi(argv[3]);
+		millis = std::stoi(argv[4]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key> <num_readers> <milliseconds>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Reader threads: " << num_readers << ", hardware threads: " << std::thread::hardware_concurrency()
+	          << "\n\n";
+
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	std::chrono::milliseconds duration(millis);
+
+	for (uint32_t batch_size : {64U, 1024U}) {
+		std::cout << "[batch size " << batch_size << "] reader throughput\n";
+		for (bool rebuild : {false, true}) {
+			std::string phase = rebuild ? ", rebuilding" : ", no writer";
+			{
+				LockedFilter locked;
+				locked.filter = BuildFilter(hashes, num_bits_per_key);
+				auto result = RunReaders(
+				    num_readers, batch_size, duration, rebuild, hashes, num_bits_per_key,
+				    [&](uint32_t) {
+					    return [&](uint32_t n, uint64_t *key, uint32_t *out) { return locked.Lookup(n, key, out); };
+				    },
+				    [&](std::unique_ptr<Filter> next) { locked.Publish(std::move(next)); });
+				Report("shared_mutex" + phase, result);
+			}
+			{
+				SharedPtrFilter shared;
+				shared.filter = BuildFilter(hashes, num_bits_per_key);
+				auto result = RunReaders(
+				    num_readers, batch_size, duration, rebuild, hashes, num_bits_per_key,
+				    [&](uint32_t) {
+					    return [&](uint32_t n, uint64_t *key, uint32_t *out) { return shared.Lookup(n, key, out); };
+				    },
+				    [&](std::unique_ptr<Filter> next) { shared.Publish(std::move(next)); });
+				Report("atomic shared_ptr" + phase, result);
+			}
+			{
+				bloom_filters::FilterSnapshot<Filter> snapshot(BuildFilter(hashes, num_bits_per_key));
+				auto result = RunReaders(
+				    num_readers, batch_size, duration, rebuild, hashes, num_bits_per_key,
+				    [&](uint32_t) {
+					    auto reader = std::make_shared<bloom_filters::FilterSnapshot<Filter>::Reader>(
+					        snapshot.RegisterReader());
+					    return [reader](uint32_t n, uint64_t *key, uint32_t *out) {
+						    return reader->Lookup(n, key, out);
+					    };
+				    },
+				    [&](std::unique_ptr<Filter> next) { snapshot.Publish(std::move(next)); });
+				snapshot.Synchronize();
+				Report("FilterSnapshot" + phase, result);
+			}
+		}
+		std::cout << "\n";
+	}
+	return 0;
+}
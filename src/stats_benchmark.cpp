@@ -0,0 +1,144 @@
+#include "base.h"
+#include "block_array.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "filter_stats.h"
+#ifdef __AVX2__
+#include "impala_blocked_BF_64bit.h"
+#endif
+#include "new_cache_sectorized_BF_32bit.h"
+#include "register_blocked_BF_2x32bit.h"
+#include "register_blocked_BF_32bit.h"
+#include "register_blocked_BF_32bit_Masks.h"
+#include "register_blocked_BF_64bit.h"
+#include "register_blocked_BF_64bit_Masks.h"
+#ifdef __AVX512F__
+#include "impala_blocked_BF_64bit_avx512.h"
+#endif
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Builds a filter sized for num_keys keys with num_keys * load of them and compares its statistics with the truth: the
+// number of keys inserted and the false-positive rate measured on keys that were never inserted.
+template <typename Filter, typename HashType>
+void RunAccuracy(const std::string &title, size_t num_keys, size_t num_bits_per_key) {
+	constexpr size_t NUM_PROBE = 1 << 22;
+	std::cout << "[" << title << "]\nload\tkeys\t\testimated keys\tfill\tmodel FPR\tmeasured FPR\n";
+	for (double load : {0.25, 0.5, 1.0, 2.0, 4.0}) {
+		Filter bf(num_keys, num_bits_per_key, QuietStorage());
+		size_t num_inserted = static_cast<size_t>(static_cast<double>(num_keys) * load);
+		std::vector<uint64_t> keys(num_inserted + NUM_PROBE);
+		std::iota(keys.begin(), keys.end(), 0);
+		std::vector<HashType> hashes(keys.size());
+		bloom_filters::HashVector(keys.size(), keys.data(), hashes.data());
+		bf.Insert(num_inserted, hashes.data());
+
+		std::vector<uint32_t> out(NUM_PROBE);
+		bf.Lookup(NUM_PROBE, hashes.data() + num_inserted, out.data());
+		size_t false_positives = std::accumulate(out.begin(), out.end(), size_t(0));
+
+		auto stats = bf.Stats();
+		std::cout << load << "\t" << num_inserted << "\t\t" << static_cast<size_t>(stats.estimated_keys) << "\t\t"
+		          << stats.fill_ratio << "\t" << stats.estimated_fpr << "\t"
+		          << static_cast<double>(false_positives) / NUM_PROBE << "\n";
+	}
+	std::cout << "\n";
+}
+
+// Best of enough runs of fn to take 200 ms, in seconds and in cycles.
+template <typename Fn>
+std::pair<double, uint64_t> BestRun(Fn &&fn) {
+	double best_seconds = 1e30;
+	uint64_t best_cycles = UINT64_MAX;
+	double total = 0;
+	do {
+		auto start = std::chrono::steady_clock::now();
+		uint64_t start_cycles = GetCycleCount();
+		fn();
+		uint64_t cycles = GetCycleCount() - start_cycles;
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best_seconds = std::min(best_seconds, seconds);
+		best_cycles = std::min(best_cycles, cycles);
+		total += seconds;
+	} while (total < 0.2);
+	return {best_seconds, best_cycles};
+}
+
+// Cost of Stats() over filter arrays of growing size, half of their bits set, with one thread and with all of them.
+void RunCost(const std::string &title, const bloom_filters::FilterGeometry &geometry, size_t min_bytes_log,
+             size_t max_bytes_log) {
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	std::cout << "[" << title << "]\nsize\t\tthreads\tms\tGB/s\tcycles per 64 bytes\n";
+	for (size_t bytes_log = min_bytes_log; bytes_log <= max_bytes_log; bytes_log += 2) {
+		size_t bytes = 1ULL << bytes_log;
+		bloom_filters::BlockArray<uint64_t> blocks;
+		blocks.Allocate(bytes / 8);
+		std::mt19937_64 re(42);
+		for (size_t i = 0; i < blocks.size(); i++) {
+			blocks[i] = re() & re();
+			blocks[i] |= re() & ~blocks[i];
+		}
+		for (uint32_t threads : {1U, max_threads}) {
+			auto best = BestRun([&] { bloom_filters::ComputeFilterStats(blocks, geometry, threads); });
+			std::cout << (bytes >> 20) << " MiB\t\t" << threads << "\t" << best.first * 1e3 << "\t"
+			          << static_cast<double>(bytes) / best.first / 1e9 << "\t"
+			          << static_cast<double>(best.second) / static_cast<double>(bytes / 64) << "\n";
+			if (max_threads == 1) {
+				break;
+			}
+		}
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = 1 << 20;
+	size_t num_bits_per_key = 16;
+	size_t max_bytes_log = 30;
+	if (argc == 4) {
+		num_keys = 1ULL << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		max_bytes_log = std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <log2_num_keys> <num_bits_per_key> <log2_max_filter_bytes>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << ", bits per key: " << num_bits_per_key << "\n\n";
+
+	using namespace bloom_filters;
+	// the 32-bit register-blocked filters are capped at 2^17 words, so they are shown at the size they reach
+	RunAccuracy<RegisterBlockedBF32Bit, uint32_t>("32-bit Register-blocked BF", num_keys, num_bits_per_key);
+	RunAccuracy<RegisterBlockedBF32BitMasks, uint32_t>("32-bit Register-blocked BF with Masks", num_keys,
+	                                                   num_bits_per_key);
+	RunAccuracy<RegisterBlockedBF64Bit, uint64_t>("64-bit Register-blocked BF", num_keys, num_bits_per_key);
+	RunAccuracy<RegisterBlockedBF64BitMasks, uint64_t>("64-bit Register-blocked BF with Masks", num_keys,
+	                                                   num_bits_per_key);
+	RunAccuracy<RegisterBlockedBF2x32Bit, uint64_t>("2x32-bit Register-blocked BF", num_keys, num_bits_per_key);
+	RunAccuracy<CacheSectorizedBF32Bit, uint64_t>("32-bit Vectorized Cache-sectorized BF", num_keys, num_bits_per_key);
+	RunAccuracy<NewCacheSectorizedBF32Bit, uint64_t>("New 32-bit Vectorized Cache-sectorized BF", num_keys,
+	                                                 num_bits_per_key);
+#ifdef __AVX2__
+	RunAccuracy<ImpalaBlockedBF64Bit, uint64_t>("Impala Blocked BF", num_keys, num_bits_per_key);
+#endif
+#ifdef __AVX512F__
+	RunAccuracy<ImpalaBlockedBF64BitAVX512, uint64_t>("Impala Blocked BF (AVX-512)", num_keys, num_bits_per_key);
+#endif
+
+	// the cost depends only on the sector layout: 32-bit sectors with the per-block model, and 64-bit words
+	RunCost("Stats() cost, Cache-sectorized layout", CacheSectorizedBF32Bit::GEOMETRY, 20, max_bytes_log);
+#ifdef __AVX2__
+	RunCost("Stats() cost, Impala layout", ImpalaBlockedBF64Bit::GEOMETRY, 20, max_bytes_log);
+#endif
+	RunCost("Stats() cost, 64-bit Register-blocked layout", RegisterBlockedBF64Bit::GEOMETRY, 20, max_bytes_log);
+	return 0;
+}
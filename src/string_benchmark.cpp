@@ -0,0 +1,167 @@
+#include "base.h"
+#include "string_hash.h"
+#include "register_blocked_BF_32bit.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "new_cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// An Arrow-style string column that owns its buffers.
+struct OwnedStringColumn {
+	std::vector<int32_t> offsets;
+	std::vector<uint8_t> data;
+
+	bloom_filters::StringColumn View() const {
+		return {offsets.data(), data.data()};
+	}
+};
+
+// String length distributions seen in join keys.
+enum class LengthDistribution { FIXED_8, UNIFORM_1_16, MIXED, LONG };
+
+const char *LengthDistributionName(LengthDistribution dist) {
+	switch (dist) {
+	case LengthDistribution::FIXED_8:
+		return "fixed 8 bytes (codes)";
+	case LengthDistribution::UNIFORM_1_16:
+		return "uniform 1-16 bytes (short names)";
+	case LengthDistribution::MIXED:
+		return "80% 4-16, 20% 17-64 bytes (names, e-mails)";
+	case LengthDistribution::LONG:
+		return "uniform 32-128 bytes (URLs)";
+	}
+	return "unknown";
+}
+
+// Build strings start with a lowercase letter and probe strings with an uppercase one, so the two sets never overlap.
+OwnedStringColumn GenerateStrings(size_t num, LengthDistribution dist, char first, uint32_t seed) {
+	std::mt19937 re(seed);
+	std::uniform_int_distribution<int> percent(0, 99);
+	std::uniform_int_distribution<int> letter(0, 25);
+	auto uniform = [&re](uint32_t lo, uint32_t hi) {
+		return std::uniform_int_distribution<uint32_t>(lo, hi)(re);
+	};
+
+	OwnedStringColumn column;
+	column.offsets.reserve(num + 1);
+	column.offsets.push_back(0);
+	for (size_t i = 0; i < num; i++) {
+		uint32_t len = 0;
+		switch (dist) {
+		case LengthDistribution::FIXED_8:
+			len = 8;
+			break;
+		case LengthDistribution::UNIFORM_1_16:
+			len = uniform(1, 16);
+			break;
+		case LengthDistribution::MIXED:
+			len = percent(re) < 80 ? uniform(4, 16) : uniform(17, 64);
+			break;
+		case LengthDistribution::LONG:
+			len = uniform(32, 128);
+			break;
+		}
+		column.data.push_back(static_cast<uint8_t>(first + letter(re)));
+		for (uint32_t j = 1; j < len; j++) {
+			column.data.push_back(static_cast<uint8_t>(uniform(33, 126)));
+		}
+		column.offsets.push_back(static_cast<int32_t>(column.data.size()));
+	}
+	return column;
+}
+
+template <typename BloomFilterType, typename HashType>
+void RunStringBenchmark(const std::string &title, LengthDistribution dist, size_t num_bits_per_key, size_t num_keys) {
+	BloomFilterType bf(num_keys, num_bits_per_key);
+	OwnedStringColumn build = GenerateStrings(num_keys, dist, 'a', 42);
+	OwnedStringColumn probe = GenerateStrings(num_keys, dist, 'A', 4242);
+	double avg_len = static_cast<double>(build.data.size()) / static_cast<double>(num_keys);
+
+	// Hashing alone, into a materialized hash array. The first pass only warms up the caches.
+	std::vector<HashType> hashes(num_keys);
+	bloom_filters::HashStringVector(num_keys, probe.View(), 0, hashes.data());
+	uint64_t start = GetCycleCount();
+	bloom_filters::HashStringVector(num_keys, probe.View(), 0, hashes.data());
+	uint64_t end = GetCycleCount();
+	double hash_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	// Reference: one string at a time, no vectorized finalizer
+	start = GetCycleCount();
+	for (size_t i = 0; i < num_keys; i++) {
+		int32_t offset = probe.offsets[i];
+		uint32_t len = static_cast<uint32_t>(probe.offsets[i + 1] - offset);
+		if (sizeof(HashType) == sizeof(uint32_t)) {
+			hashes[i] = bloom_filters::StringHash32(probe.data.data() + offset, len);
+		} else {
+			hashes[i] = bloom_filters::StringHash64(probe.data.data() + offset, len);
+		}
+	}
+	end = GetCycleCount();
+	double scalar_hash_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	// Insert
+	start = GetCycleCount();
+	bloom_filters::InsertStrings<BloomFilterType, HashType>(bf, num_keys, build.View());
+	end = GetCycleCount();
+	double insert_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	// Correctness Check
+	std::vector<uint32_t> out(num_keys, 0);
+	bloom_filters::LookupStrings<BloomFilterType, HashType>(bf, num_keys, build.View(), out.data());
+	size_t positives = 0;
+	for (size_t i = 0; i < num_keys; i++) {
+		positives += out[i] != 0;
+	}
+	if (positives != num_keys) {
+		std::cout << "ERROR: Correctness check failed! Passed queries: " << positives << "/" << num_keys << '\n';
+	}
+
+	// Lookup
+	start = GetCycleCount();
+	bloom_filters::LookupStrings<BloomFilterType, HashType>(bf, num_keys, probe.View(), out.data());
+	end = GetCycleCount();
+	double lookup_cpt = static_cast<double>(end - start) / static_cast<double>(num_keys);
+
+	size_t false_positives = 0;
+	for (size_t i = 0; i < num_keys; i++) {
+		false_positives += out[i] != 0;
+	}
+	double fp_rate = static_cast<double>(false_positives) / static_cast<double>(num_keys);
+
+	std::cout << "[" << title << ", " << LengthDistributionName(dist) << ", avg " << avg_len << " bytes]\n"
+	          << "Hash took " << hash_cpt << " cycles per string (one at a time: " << scalar_hash_cpt << ")\n"
+	          << "Insert took " << insert_cpt << " cycles per string\n"
+	          << "Lookup took " << lookup_cpt << " cycles per string\n"
+	          << "False-positive rate ~ " << fp_rate << "\n\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = (1 << 17);
+	size_t num_bits_per_key = 16;
+	if (argc == 3) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n\n";
+
+	for (auto dist : {LengthDistribution::FIXED_8, LengthDistribution::UNIFORM_1_16, LengthDistribution::MIXED,
+	                  LengthDistribution::LONG}) {
+		RunStringBenchmark<bloom_filters::RegisterBlockedBF32Bit, uint32_t>("32-bit Vectorized Register-Blocked BF",
+		                                                                     dist, num_bits_per_key, num_keys);
+		RunStringBenchmark<bloom_filters::CacheSectorizedBF32Bit, uint64_t>("32-bit Vectorized Cache-sectorized BF",
+		                                                                     dist, num_bits_per_key, num_keys);
+		RunStringBenchmark<bloom_filters::NewCacheSectorizedBF32Bit, uint64_t>(
+		    "New 32-bit Vectorized Cache-sectorized BF", dist, num_bits_per_key, num_keys);
+	}
+	return 0;
+}
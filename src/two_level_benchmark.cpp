@@ -0,0 +1,97 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#if defined(__AVX2__)
+#include "impala_blocked_BF_64bit.h"
+#endif
+#include "two_level_filter.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// num_probe keys of which about hit_rate are build keys [0, num_keys), the others come from [num_keys, 2 * num_keys).
+std::vector<uint64_t> GenerateProbe(size_t num_keys, size_t num_probe, double hit_rate, uint32_t seed) {
+	std::mt19937_64 re(seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	std::uniform_int_distribution<uint64_t> key_dist(0, num_keys - 1);
+	std::vector<uint64_t> probe(num_probe);
+	for (auto &key : probe) {
+		key = key_dist(re) + (coin(re) < hit_rate ? 0 : num_keys);
+	}
+	return probe;
+}
+
+template <typename LargeFilter>
+void RunTwoLevelBenchmark(const std::string &title, size_t num_bits_per_key, size_t filter_bytes) {
+	size_t num_keys = filter_bytes * 8 / num_bits_per_key;
+	size_t num_probe = std::min<size_t>(num_keys, 1 << 24);
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+
+	bloom_filters::TwoLevelFilterOptions options;
+	bloom_filters::TwoLevelFilter<LargeFilter> bf(num_keys, num_bits_per_key, options);
+	bf.Insert(num_keys, hashes.data());
+	size_t prefilter_bytes = bf.PreFilterBytes();
+	std::cout << "[" << title << ", " << (filter_bytes >> 20) << " MiB] pre-filter " << (prefilter_bytes >> 10)
+	          << " KiB, k = " << bf.PreFilterK() << " (model for " << options.expected_hit_rate * 100
+	          << "% hits), model FPR "
+	          << bloom_filters::PreFilterModel::FalsePositiveRate(num_keys, prefilter_bytes, bf.PreFilterK()) << "\n"
+	          << "hit rate   single-level  two-level  (cycles per key)  pre-filter pass rate\n";
+
+	std::vector<uint32_t> single(num_probe), two_level(num_probe);
+	hashes.resize(num_probe);
+	for (int percent : {0, 1, 5, 10, 25, 50, 100}) {
+		auto probe = GenerateProbe(num_keys, num_probe, percent / 100.0, 42);
+		bloom_filters::HashVector(num_probe, probe.data(), hashes.data());
+
+		uint64_t start = GetCycleCount();
+		bf.Large().Lookup(num_probe, hashes.data(), single.data());
+		uint64_t mid = GetCycleCount();
+		bf.ResetCounters();
+		bf.Lookup(num_probe, hashes.data(), two_level.data());
+		uint64_t end = GetCycleCount();
+		// the pre-filter may only remove false positives of the large filter: no key may pass that the large filter
+		// rejects, and every build key must pass
+		size_t wrong = 0;
+		for (size_t i = 0; i < num_probe; i++) {
+			wrong += two_level[i] > single[i] || (probe[i] < num_keys && !two_level[i]);
+		}
+		if (wrong > 0) {
+			std::cout << "ERROR: two-level filter differs from the large filter on " << wrong << " keys!\n";
+		}
+		std::cout << percent << "%\t   " << static_cast<double>(mid - start) / static_cast<double>(num_probe)
+		          << "\t " << static_cast<double>(end - mid) / static_cast<double>(num_probe) << "\t\t\t   "
+		          << bf.PreFilterPassRate() << "\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_bits_per_key = 16;
+	size_t max_bytes_log = 27;
+	if (argc == 3) {
+		num_bits_per_key = std::stoi(argv[1]);
+		max_bytes_log = std::stoi(argv[2]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_bits_per_key> <log2_max_filter_bytes>\n";
+		return 1;
+	}
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n\n";
+
+	for (size_t bytes_log = 22; bytes_log <= max_bytes_log; bytes_log += 2) {
+		RunTwoLevelBenchmark<bloom_filters::CacheSectorizedBF32Bit>("32-bit Vectorized Cache-sectorized BF",
+		                                                           num_bits_per_key, 1ULL << bytes_log);
+#if defined(__AVX2__)
+		RunTwoLevelBenchmark<bloom_filters::ImpalaBlockedBF64Bit>("Impala Blocked BF", num_bits_per_key,
+		                                                         1ULL << bytes_log);
+#endif
+	}
+	return 0;
+}
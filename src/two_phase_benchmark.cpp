@@ -0,0 +1,98 @@
+#include "base.h"
+#include "cache_sectorized_BF_32bit.h"
+#include "new_cache_sectorized_BF_32bit.h"
+
+#include "benchmark_utils.h"
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+const char *ProbeKernelName(bloom_filters::ProbeKernel kernel) {
+	switch (kernel) {
+	case bloom_filters::ProbeKernel::AUTO:
+		return "auto";
+	case bloom_filters::ProbeKernel::BRANCHLESS:
+		return "branchless";
+	case bloom_filters::ProbeKernel::TWO_PHASE:
+		return "two-phase";
+	}
+	return "unknown";
+}
+
+// Probe keys of which about hit_rate are build keys [0, num_keys), the others come from [num_keys, 2 * num_keys).
+std::vector<uint64_t> GenerateProbe(size_t num_keys, double hit_rate, uint32_t seed) {
+	std::mt19937_64 re(seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	std::uniform_int_distribution<uint64_t> key_dist(0, num_keys - 1);
+	std::vector<uint64_t> probe(num_keys);
+	for (auto &key : probe) {
+		key = key_dist(re) + (coin(re) < hit_rate ? 0 : num_keys);
+	}
+	return probe;
+}
+
+template <typename BloomFilterType>
+void RunTwoPhaseBenchmark(const std::string &title, size_t num_bits_per_key, size_t num_keys,
+                          size_t num_lookup_times) {
+	BloomFilterType bf(num_keys, num_bits_per_key);
+	std::vector<uint64_t> keys(num_keys);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<uint64_t> hashes(num_keys);
+	bloom_filters::HashVector(num_keys, keys.data(), hashes.data());
+	bf.Insert(num_keys, hashes.data());
+
+	const size_t lookupRepeat = std::max(num_lookup_times / num_keys, 1UL);
+	std::vector<uint32_t> out(num_keys), reference(num_keys);
+	std::cout << "[" << title << "] cycles per key\n"
+	          << "hit rate   branchless  two-phase  auto\n";
+	for (int percent = 0; percent <= 100; percent += 10) {
+		auto probe = GenerateProbe(num_keys, percent / 100.0, 42);
+		bloom_filters::HashVector(num_keys, probe.data(), hashes.data());
+
+		std::cout << percent << "%\t";
+		for (auto kernel : {bloom_filters::ProbeKernel::BRANCHLESS, bloom_filters::ProbeKernel::TWO_PHASE,
+		                    bloom_filters::ProbeKernel::AUTO}) {
+			bf.SetProbeKernel(kernel);
+			uint64_t start = GetCycleCount();
+			for (size_t r = 0; r < lookupRepeat; r++) {
+				bf.Lookup(num_keys, hashes.data(), out.data());
+			}
+			uint64_t end = GetCycleCount();
+			if (kernel == bloom_filters::ProbeKernel::BRANCHLESS) {
+				reference = out;
+			} else if (out != reference) {
+				std::cout << "ERROR: " << ProbeKernelName(kernel) << " kernel differs from the branchless kernel!\n";
+			}
+			std::cout << "   " << static_cast<double>(end - start) / static_cast<double>(lookupRepeat * num_keys);
+		}
+		std::cout << "   (auto ended on " << (bf.KernelSwitch().UseTwoPhase() ? "two-phase" : "branchless") << ")\n";
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+	size_t num_keys = (1 << 20);
+	size_t num_bits_per_key = 16;
+	size_t num_lookup_times = (1 << 24);
+	if (argc == 4) {
+		num_keys = 1 << std::stoi(argv[1]);
+		num_bits_per_key = std::stoi(argv[2]);
+		num_lookup_times = 1 << std::stoi(argv[3]);
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " <num_keys> <num_bits_per_key> <num_lookup_times>\n";
+		return 1;
+	}
+	std::cout << "Number of keys: " << num_keys << "\n";
+	std::cout << "Number of bits per key: " << num_bits_per_key << "\n";
+	std::cout << "Number of lookup times: " << num_lookup_times << "\n\n";
+
+	RunTwoPhaseBenchmark<bloom_filters::CacheSectorizedBF32Bit>("32-bit Vectorized Cache-sectorized BF",
+	                                                           num_bits_per_key, num_keys, num_lookup_times);
+	RunTwoPhaseBenchmark<bloom_filters::NewCacheSectorizedBF32Bit>("New 32-bit Vectorized Cache-sectorized BF",
+	                                                              num_bits_per_key, num_keys, num_lookup_times);
+	return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Order in which probes visit the key space.
+enum class KeyDistribution : uint8_t {
+	// Every key equally likely.
+	UNIFORM,
+	// Key of rank r drawn with probability proportional to 1 / (r + 1)^theta: a few hot keys take most probes.
+	ZIPF,
+	// Probes come in runs that stay inside a small window of keys before jumping elsewhere (temporal locality, e.g.
+	// a probe side sorted or clustered on a correlated column).
+	CLUSTERED,
+};
+
+inline const char *KeyDistributionName(KeyDistribution distribution) {
+	switch (distribution) {
+	case KeyDistribution::ZIPF: return "zipf";
+	case KeyDistribution::CLUSTERED: return "clustered";
+	default: return "uniform";
+	}
+}
+
+inline KeyDistribution ParseKeyDistribution(const std::string &name) {
+	if (name == "uniform") {
+		return KeyDistribution::UNIFORM;
+	} else if (name == "zipf") {
+		return KeyDistribution::ZIPF;
+	} else if (name == "clustered") {
+		return KeyDistribution::CLUSTERED;
+	}
+	throw std::invalid_argument("unknown key distribution: " + name);
+}
+
+struct WorkloadOptions {
+	size_t num_keys = 1 << 20;
+	size_t num_lookups = 1 << 24;
+	// Fraction of the probes that are build keys, the others are keys that were never inserted.
+	double hit_rate = 0;
+	KeyDistribution distribution = KeyDistribution::UNIFORM;
+	// Skew of ZIPF, in (0, 1).
+	double zipf_theta = 0.99;
+	// Window of CLUSTERED, in keys; each run of 4 * cluster_size probes stays in one window.
+	size_t cluster_size = 1024;
+	uint64_t seed = 42;
+};
+
+// Build keys and probe keys of one benchmark run. Key i of the key space is Scramble(i): build keys are i in
+// [0, num_keys), keys that are never inserted are i in [num_keys, 2 * num_keys), so both look random and never collide.
+struct Workload {
+	std::vector<uint64_t> build;
+	std::vector<uint64_t> probe;
+	// is_hit[i] is 1 if probe[i] is a build key.
+	std::vector<uint8_t> is_hit;
+	size_t num_hits = 0;
+};
+
+// Bijective 64-bit mix (the splitmix64 finalizer).
+inline uint64_t Scramble(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Zipf-distributed ranks in [0, n), after Gray et al., "Quickly Generating Billion-Record Synthetic Databases" (the
+// YCSB generator). Setup is O(n).
+class ZipfGenerator {
+public:
+	ZipfGenerator(size_t n, double theta) : n_(n) {
+		if (theta <= 0 || theta >= 1) {
+			throw std::invalid_argument("zipf theta must be in (0, 1)");
+		}
+		double zeta_n = 0;
+		for (size_t i = 1; i <= n; i++) {
+			zeta_n += 1.0 / std::pow(static_cast<double>(i), theta);
+		}
+		double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta);
+		zeta_n_ = zeta_n;
+		alpha_ = 1.0 / (1.0 - theta);
+		eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+		second_ = 1.0 + std::pow(0.5, theta);
+	}
+
+	template <typename Engine>
+	size_t operator()(Engine &re) {
+		double u = std::uniform_real_distribution<double>(0.0, 1.0)(re);
+		double uz = u * zeta_n_;
+		if (uz < 1.0) {
+			return 0;
+		}
+		if (uz < second_) {
+			return std::min<size_t>(1, n_ - 1);
+		}
+		auto rank = static_cast<size_t>(static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+		return std::min(rank, n_ - 1);
+	}
+
+private:
+	size_t n_;
+	double zeta_n_;
+	double alpha_;
+	double eta_;
+	double second_;
+};
+
+inline Workload GenerateWorkload(const WorkloadOptions &options) {
+	const size_t n = options.num_keys;
+	Workload workload;
+	workload.build.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		workload.build[i] = Scramble(i);
+	}
+
+	std::mt19937_64 re(options.seed);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+	std::uniform_int_distribution<size_t> uniform(0, n - 1);
+	std::vector<ZipfGenerator> zipf;
+	if (options.distribution == KeyDistribution::ZIPF) {
+		zipf.emplace_back(n, options.zipf_theta);
+	}
+	const size_t window = std::max<size_t>(1, std::min(options.cluster_size, n));
+	const size_t run_length = 4 * window;
+	std::uniform_int_distribution<size_t> in_window(0, window - 1);
+	std::uniform_int_distribution<size_t> window_base(0, n - window);
+	size_t base = 0;
+
+	workload.probe.resize(options.num_lookups);
+	workload.is_hit.resize(options.num_lookups);
+	for (size_t i = 0; i < options.num_lookups; i++) {
+		size_t rank;
+		switch (options.distribution) {
+		case KeyDistribution::ZIPF:
+			rank = zipf[0](re);
+			break;
+		case KeyDistribution::CLUSTERED:
+			if (i % run_length == 0) {
+				base = window_base(re);
+			}
+			rank = base + in_window(re);
+			break;
+		default:
+			rank = uniform(re);
+			break;
+		}
+		bool hit = coin(re) < options.hit_rate;
+		workload.is_hit[i] = hit;
+		workload.num_hits += hit;
+		workload.probe[i] = Scramble(hit ? rank : n + rank);
+	}
+	return workload;
+}